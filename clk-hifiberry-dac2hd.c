@@ -27,6 +27,25 @@
 #include <linux/platform_device.h>
 #include <linux/i2c.h>
 #include <linux/regmap.h>
+#include <linux/sort.h>
+#include <linux/bsearch.h>
+#include <linux/delay.h>
+#include <linux/debugfs.h>
+#include <linux/ktime.h>
+#include <linux/workqueue.h>
+#include <linux/completion.h>
+#include <linux/pm_runtime.h>
+#include <linux/firmware.h>
+#include <linux/crc32.h>
+#include <linux/version.h>
+#include <linux/list.h>
+#include <linux/kref.h>
+#include <linux/mutex.h>
+#include <linux/overflow.h>
+
+#include "dd-utils.h"
+#include "dd-debug.h"
+#include "dd-trace.h"
 
 #define DRV_VERSION "5.2.1"
 
@@ -35,27 +54,91 @@
 #define CLK_DAC2HD_PLL_MAX_REGISTER	256
 #define CLK_DAC2HD_DEFAULT_RATE		44100
 
-static const struct reg_default clk_hb_dac2hd_pll_reg_soft_reset = {177, 0xAC};
+#if defined(CLK_DAC2HD_ASYNC_INIT) && !defined(CLK_DAC2HD_PREPARE_INIT)
+#error "CLK_DAC2HD_ASYNC_INIT requires CLK_DAC2HD_PREPARE_INIT"
+#endif
+#if defined(CLK_DAC2HD_FW_PROFILE) && !defined(CLK_DAC2HD_PREPARE_INIT)
+#error "CLK_DAC2HD_FW_PROFILE requires CLK_DAC2HD_PREPARE_INIT"
+#endif
+#if defined(CLK_DAC2HD_FW_PROFILE) && defined(CLK_DAC2HD_STATIC_DEFAULTS)
+#error "CLK_DAC2HD_FW_PROFILE and CLK_DAC2HD_STATIC_DEFAULTS are exclusive"
+#endif
+
+#define CLK_DAC2HD_REG_DEVICE_STATUS	0x00
+#define CLK_DAC2HD_REG_INT_STATUS	0x01
+#define CLK_DAC2HD_REG_PLL_RESET	177
+#define CLK_DAC2HD_STATUS_SYS_INIT	0x80
+#define CLK_DAC2HD_STATUS_LOL_A		0x20
+#define CLK_DAC2HD_STATUS_NOT_LOCKED	(CLK_DAC2HD_STATUS_SYS_INIT |\
+					 CLK_DAC2HD_STATUS_LOL_A)
+#define CLK_DAC2HD_REG_PLL_INPUT_SRC	0x0F
+#define CLK_DAC2HD_REG_MSNA_FIRST	0x1A
+#define CLK_DAC2HD_REG_MSNB_LAST	0x29
+#define CLK_DAC2HD_REG_XTAL_LOAD	0xB7
+#define CLK_DAC2HD_PLL_LOCK_POLL_US	100
+#define CLK_DAC2HD_PLL_LOCK_TIMEOUT_US	20000
+#define CLK_DAC2HD_REG_OUTPUT_EN	0x03
+#define CLK_DAC2HD_REG_CLK0_CTRL	0x10
+#define CLK_DAC2HD_REG_CLK7_CTRL	0x17
+#define CLK_DAC2HD_NUM_CLK_CTRL		(CLK_DAC2HD_REG_CLK7_CTRL -\
+					 CLK_DAC2HD_REG_CLK0_CTRL + 1)
+#define CLK_DAC2HD_CLK_PDN		0x80
+#define CLK_DAC2HD_OUTPUTS_OFF		0xFF
+#define CLK_DAC2HD_AUTOSUSPEND_MS	2000
+
+#ifdef CLK_DAC2HD_FW_PROFILE
+#define CLK_DAC2HD_FW_NAME		"hifiberry-dac2hd-pll.bin"
+#define CLK_DAC2HD_FW_MAGIC		0x4C503244	/* "D2PL" */
+#define CLK_DAC2HD_FW_VERSION		1
+#define CLK_DAC2HD_FW_COMMON		0
 
-static struct reg_default clk_hb_dac2hd_pll_reg_defaults[] = {
+/*
+ * PLL profile blob, all fields little endian:
+ *   header, then num_sections sections. Each section is followed by
+ *   num_runs runs of { u8 first_reg, u8 len, u8 val[len] }, ascending.
+ *   A section with rate CLK_DAC2HD_FW_COMMON holds the common registers and
+ *   is mandatory; a rate without a section is disabled.
+ * crc32 is crc32_le(~0, ...) over the size bytes following the header.
+ */
+struct clk_hb_dac2hd_fw_header {
+	__le32 magic;
+	__le16 version;
+	__le16 num_sections;
+	__le32 size;
+	__le32 crc32;
+} __packed;
+
+struct clk_hb_dac2hd_fw_section {
+	__le32 rate;
+	u8 num_runs;
+	u8 reserved[3];
+} __packed;
+#endif /* CLK_DAC2HD_FW_PROFILE */
+
+static const struct reg_default clk_hb_dac2hd_pll_reg_soft_reset = {
+					CLK_DAC2HD_REG_PLL_RESET, 0xAC};
+
+/*
+ * Keep reg/val tables sorted by register: clk_hb_dac2hd_write_pll_regs()
+ * sends each run of consecutive registers as a single burst.
+ */
+static const struct reg_default clk_hb_dac2hd_pll_reg_defaults[] = {
 	{0x02, 0x53}, {0x03, 0x00}, {0x07, 0x20}, {0x0F, 0x00},
 	{0x10, 0x0D}, {0x11, 0x1D}, {0x12, 0x0D}, {0x13, 0x8C},
 	{0x14, 0x8C}, {0x15, 0x8C}, {0x16, 0x8C}, {0x17, 0x8C},
-	{0x18, 0x2A}, {0x1C, 0x00}, {0x1D, 0x0F}, {0x1F, 0x00},
-	{0x2A, 0x00}, {0x2C, 0x00}, {0x2F, 0x00}, {0x30, 0x00},
-	{0x31, 0x00}, {0x32, 0x00}, {0x34, 0x00}, {0x37, 0x00},
-	{0x38, 0x00}, {0x39, 0x00}, {0x3A, 0x00}, {0x3B, 0x01},
+	{0x18, 0x2A}, {0x1A, 0x3D}, {0x1B, 0x09}, {0x1C, 0x00},
+	{0x1D, 0x0F}, {0x1E, 0xF3}, {0x1F, 0x00}, {0x20, 0x13},
+	{0x21, 0x75}, {0x2A, 0x00}, {0x2B, 0x04}, {0x2C, 0x00},
+	{0x2D, 0x11}, {0x2E, 0xE0}, {0x2F, 0x00}, {0x30, 0x00},
+	{0x31, 0x00}, {0x32, 0x00}, {0x34, 0x00}, {0x35, 0x9D},
+	{0x36, 0x00}, {0x37, 0x00}, {0x38, 0x00}, {0x39, 0x00},
+	{0x3A, 0x00}, {0x3B, 0x01}, {0x3C, 0x42}, {0x3D, 0x7A},
 	{0x3E, 0x00}, {0x3F, 0x00}, {0x40, 0x00}, {0x41, 0x00},
 	{0x5A, 0x00}, {0x5B, 0x00}, {0x95, 0x00}, {0x96, 0x00},
 	{0x97, 0x00}, {0x98, 0x00}, {0x99, 0x00}, {0x9A, 0x00},
 	{0x9B, 0x00}, {0xA2, 0x00}, {0xA3, 0x00}, {0xA4, 0x00},
 	{0xB7, 0x92},
 
-	{0x1A, 0x3D}, {0x1B, 0x09}, {0x1E, 0xF3}, {0x20, 0x13},
-	{0x21, 0x75}, {0x2B, 0x04}, {0x2D, 0x11}, {0x2E, 0xE0},
-	              {0x35, 0x9D}, {0x36, 0x00}, {0x3C, 0x42},
-	{0x3D, 0x7A},
-
 //	{177, 0xAC},
 };
 
@@ -63,7 +146,7 @@ static struct reg_default clk_hb_dac2hd_pll_reg_defaults[] = {
 /*
  * DT reg defaults
  */
-static struct reg_default clk_hb_dac2hd_common_pll_regs[] = {
+static const struct reg_default clk_hb_dac2hd_common_pll_regs[] = {
 	{0x02, 0x53}, {0x03, 0x00}, {0x07, 0x20}, {0x0F, 0x00},
 	{0x10, 0x0D}, {0x11, 0x1D}, {0x12, 0x0D}, {0x13, 0x8C},
 	{0x14, 0x8C}, {0x15, 0x8C}, {0x16, 0x8C}, {0x17, 0x8C},
@@ -77,95 +160,195 @@ static struct reg_default clk_hb_dac2hd_common_pll_regs[] = {
 	{0x9B, 0x00}, {0xA2, 0x00}, {0xA3, 0x00}, {0xA4, 0x00},
 	{0xB7, 0x92},
 };
-static int clk_hb_dac2hd_num_common_pll_regs =
-			ARRAY_SIZE(clk_hb_dac2hd_common_pll_regs);
 
-static struct reg_default clk_hb_dac2hd_dedicated_192k_pll_regs[] = {
+static const struct reg_default clk_hb_dac2hd_dedicated_192k_pll_regs[] = {
 	{0x1A, 0x0C}, {0x1B, 0x35}, {0x1E, 0xF0}, {0x20, 0x09},
 	{0x21, 0x50}, {0x2B, 0x02}, {0x2D, 0x10}, {0x2E, 0x40},
 	{0x33, 0x01}, {0x35, 0x22}, {0x36, 0x80}, {0x3C, 0x22},
 	{0x3D, 0x46},
 };
-static int clk_hb_dac2hd_num_dedicated_192k_pll_regs =
-			ARRAY_SIZE(clk_hb_dac2hd_dedicated_192k_pll_regs);
 
-static struct reg_default clk_hb_dac2hd_dedicated_96k_pll_regs[] = {
+static const struct reg_default clk_hb_dac2hd_dedicated_96k_pll_regs[] = {
 	{0x1A, 0x0C}, {0x1B, 0x35}, {0x1E, 0xF0}, {0x20, 0x09},
 	{0x21, 0x50}, {0x2B, 0x02}, {0x2D, 0x10}, {0x2E, 0x40},
 	{0x33, 0x01}, {0x35, 0x47}, {0x36, 0x00}, {0x3C, 0x32},
 	{0x3D, 0x46},
 };
-static int clk_hb_dac2hd_num_dedicated_96k_pll_regs = 
-			ARRAY_SIZE(clk_hb_dac2hd_dedicated_96k_pll_regs);
 
-static struct reg_default clk_hb_dac2hd_dedicated_48k_pll_regs[] = {
+static const struct reg_default clk_hb_dac2hd_dedicated_48k_pll_regs[] = {
 	{0x1A, 0x0C}, {0x1B, 0x35}, {0x1E, 0xF0}, {0x20, 0x09},
 	{0x21, 0x50}, {0x2B, 0x02}, {0x2D, 0x10}, {0x2E, 0x40},
 	{0x33, 0x01}, {0x35, 0x90}, {0x36, 0x00}, {0x3C, 0x42},
 	{0x3D, 0x46},
 };
-static int clk_hb_dac2hd_num_dedicated_48k_pll_regs = 
-			ARRAY_SIZE(clk_hb_dac2hd_dedicated_48k_pll_regs);
 
-static struct reg_default clk_hb_dac2hd_dedicated_176k4_pll_regs[] = {
+static const struct reg_default clk_hb_dac2hd_dedicated_176k4_pll_regs[] = {
 	{0x1A, 0x3D}, {0x1B, 0x09}, {0x1E, 0xF3}, {0x20, 0x13},
 	{0x21, 0x75}, {0x2B, 0x04}, {0x2D, 0x11}, {0x2E, 0xE0},
 	{0x33, 0x02}, {0x35, 0x25}, {0x36, 0xC0}, {0x3C, 0x22},
 	{0x3D, 0x7A},
 };
-static int clk_hb_dac2hd_num_dedicated_176k4_pll_regs =
-			ARRAY_SIZE(clk_hb_dac2hd_dedicated_176k4_pll_regs);
 
-static struct reg_default clk_hb_dac2hd_dedicated_88k2_pll_regs[] = {
+static const struct reg_default clk_hb_dac2hd_dedicated_88k2_pll_regs[] = {
 	{0x1A, 0x3D}, {0x1B, 0x09}, {0x1E, 0xF3}, {0x20, 0x13},
 	{0x21, 0x75}, {0x2B, 0x04}, {0x2D, 0x11}, {0x2E, 0xE0},
 	{0x33, 0x01}, {0x35, 0x4D}, {0x36, 0x80}, {0x3C, 0x32},
 	{0x3D, 0x7A},
 };
-static int clk_hb_dac2hd_num_dedicated_88k2_pll_regs =
-			ARRAY_SIZE(clk_hb_dac2hd_dedicated_88k2_pll_regs);
 
-static struct reg_default clk_hb_dac2hd_dedicated_44k1_pll_regs[] = {
+static const struct reg_default clk_hb_dac2hd_dedicated_44k1_pll_regs[] = {
 	{0x1A, 0x3D}, {0x1B, 0x09}, {0x1E, 0xF3}, {0x20, 0x13},
 	{0x21, 0x75}, {0x2B, 0x04}, {0x2D, 0x11}, {0x2E, 0xE0},
 	{0x33, 0x01}, {0x35, 0x9D}, {0x36, 0x00}, {0x3C, 0x42},
 	{0x3D, 0x7A},
 };
-static int clk_hb_dac2hd_num_dedicated_44k1_pll_regs =
-			ARRAY_SIZE(clk_hb_dac2hd_dedicated_44k1_pll_regs);
-#else
-static struct reg_default
-	clk_hb_dac2hd_common_pll_regs[CLK_DAC2HD_PLL_MAX_REGISTER];
-static int clk_hb_dac2hd_num_common_pll_regs;
+#endif /* CLK_DAC2HD_STATIC_DEFAULTS */
 
-static struct reg_default 
-	clk_hb_dac2hd_dedicated_192k_pll_regs[CLK_DAC2HD_PLL_MAX_REGISTER];
-static int clk_hb_dac2hd_num_dedicated_192k_pll_regs;
+/**
+ * struct clk_hb_dac2hd_rate - Supported rate descriptor
+ * @rate: rate (as requested by the codec, i.e. the sample rate)
+ * @prop_name: DT property holding the dedicated reg/val pairs
+ * @family: base rate of the PLL family (VCO configuration)
+ * @lock_timeout_us: bound for the PLL lock poll after a reset
+ */
+struct clk_hb_dac2hd_rate {
+	unsigned long rate;
+	const char *prop_name;
+	unsigned long family;
+	unsigned int lock_timeout_us;
+};
 
-static struct reg_default
-	clk_hb_dac2hd_dedicated_96k_pll_regs[CLK_DAC2HD_PLL_MAX_REGISTER];
-static int clk_hb_dac2hd_num_dedicated_96k_pll_regs;
+#define CLK_DAC2HD_RATE(_rate, _name, _family)				\
+{									\
+	.rate		 = _rate,					\
+	.prop_name	 = #_name "_pll_regs",				\
+	.family		 = _family,					\
+	.lock_timeout_us = CLK_DAC2HD_PLL_LOCK_TIMEOUT_US,		\
+}
 
-static struct reg_default
-	clk_hb_dac2hd_dedicated_48k_pll_regs[CLK_DAC2HD_PLL_MAX_REGISTER];
-static int clk_hb_dac2hd_num_dedicated_48k_pll_regs;
+/*
+ * Rate registry, must be sorted by rate. Adding a rate only needs an entry
+ * here (plus its register table in clk_hb_dac2hd_static_profile, at the
+ * same index, or the matching DT property).
+ */
+static const struct clk_hb_dac2hd_rate clk_hb_dac2hd_rates[] = {
+	CLK_DAC2HD_RATE(44100,  44k1,  44100),
+	CLK_DAC2HD_RATE(48000,  48k,   48000),
+	CLK_DAC2HD_RATE(88200,  88k2,  44100),
+	CLK_DAC2HD_RATE(96000,  96k,   48000),
+	CLK_DAC2HD_RATE(176400, 176k4, 44100),
+	CLK_DAC2HD_RATE(192000, 192k,  48000),
+};
 
-static struct reg_default
-	clk_hb_dac2hd_dedicated_176k4_pll_regs[CLK_DAC2HD_PLL_MAX_REGISTER];
-static int clk_hb_dac2hd_num_dedicated_176k4_pll_regs;
+/**
+ * struct clk_hb_dac2hd_table - reg/val table, sorted by register
+ * @regs: reg/val pairs
+ * @num_regs: number of entries in @regs, <= 0 if absent (rate disabled)
+ */
+struct clk_hb_dac2hd_table {
+	const struct reg_default *regs;
+	int num_regs;
+};
 
-static struct reg_default
-	clk_hb_dac2hd_dedicated_88k2_pll_regs[CLK_DAC2HD_PLL_MAX_REGISTER];
-static int clk_hb_dac2hd_num_dedicated_88k2_pll_regs;
+/**
+ * struct clk_hb_dac2hd_profile - PLL tables of a board
+ * @common: registers shared by all rates
+ * @rates: dedicated tables, indexed like clk_hb_dac2hd_rates
+ * @node: entry in clk_hb_dac2hd_profiles
+ * @ref: number of instances using the profile
+ * @pool: backing store for all the tables of a loaded profile
+ *
+ * A profile is never modified once built, so instances whose tables are
+ * identical share one (see clk_hb_dac2hd_profile_share()).
+ */
+struct clk_hb_dac2hd_profile {
+	struct clk_hb_dac2hd_table common;
+	struct clk_hb_dac2hd_table rates[ARRAY_SIZE(clk_hb_dac2hd_rates)];
+#ifndef CLK_DAC2HD_STATIC_DEFAULTS
+	struct list_head node;
+	struct kref ref;
+	struct reg_default pool[];
+#endif /* CLK_DAC2HD_STATIC_DEFAULTS */
+};
 
-static struct reg_default
-	clk_hb_dac2hd_dedicated_44k1_pll_regs[CLK_DAC2HD_PLL_MAX_REGISTER];
-static int clk_hb_dac2hd_num_dedicated_44k1_pll_regs;
+#ifdef CLK_DAC2HD_STATIC_DEFAULTS
+#define CLK_DAC2HD_TABLE(_regs) { .regs = _regs, .num_regs = ARRAY_SIZE(_regs) }
+
+/* shared by all instances */
+static const struct clk_hb_dac2hd_profile clk_hb_dac2hd_static_profile = {
+	.common = CLK_DAC2HD_TABLE(clk_hb_dac2hd_common_pll_regs),
+	.rates  = {
+		CLK_DAC2HD_TABLE(clk_hb_dac2hd_dedicated_44k1_pll_regs),
+		CLK_DAC2HD_TABLE(clk_hb_dac2hd_dedicated_48k_pll_regs),
+		CLK_DAC2HD_TABLE(clk_hb_dac2hd_dedicated_88k2_pll_regs),
+		CLK_DAC2HD_TABLE(clk_hb_dac2hd_dedicated_96k_pll_regs),
+		CLK_DAC2HD_TABLE(clk_hb_dac2hd_dedicated_176k4_pll_regs),
+		CLK_DAC2HD_TABLE(clk_hb_dac2hd_dedicated_192k_pll_regs),
+	},
+};
+#else
+/* loaded profiles, shared between instances with identical tables */
+static LIST_HEAD(clk_hb_dac2hd_profiles);
+static DEFINE_MUTEX(clk_hb_dac2hd_profiles_lock);
 #endif /* CLK_DAC2HD_STATIC_DEFAULTS */
 
+static int clk_hb_dac2hd_rate_cmp(const void *key, const void *elt)
+{
+	unsigned long rate = *(const unsigned long *)key;
+	const struct clk_hb_dac2hd_rate *r = elt;
+
+	if (rate < r->rate)
+		return -1;
+	return rate > r->rate;
+}
+
+static const struct clk_hb_dac2hd_table *clk_hb_dac2hd_rate_table(
+				const struct clk_hb_dac2hd_profile *profile,
+				const struct clk_hb_dac2hd_rate *r)
+{
+	return &profile->rates[r - clk_hb_dac2hd_rates];
+}
+
+static const struct clk_hb_dac2hd_rate *clk_hb_dac2hd_find_rate(
+				const struct clk_hb_dac2hd_profile *profile,
+				unsigned long rate)
+{
+	const struct clk_hb_dac2hd_rate *r;
+
+	r = bsearch(&rate, clk_hb_dac2hd_rates,
+		    ARRAY_SIZE(clk_hb_dac2hd_rates),
+		    sizeof(clk_hb_dac2hd_rates[0]), clk_hb_dac2hd_rate_cmp);
+	if (!r || clk_hb_dac2hd_rate_table(profile, r)->num_regs <= 0)
+		return NULL;
+
+	return r;
+}
+
+/**
+ * struct clk_hb_dac2hd_stats - PLL statistics, exported via debugfs
+ * @rate: last rate successfully set, for the rate switch counters
+ */
+struct clk_hb_dac2hd_stats {
+	unsigned int rate;
+	u32 rate_switches[DD_NUM_RATE_FAMILIES];
+	struct dd_hist set_rate;
+	struct dd_hist runtime_resume;
+	u32 pll_resets;
+	u32 fast_switches;
+	u32 lock_timeouts;
+	u32 last_lock_us;
+	u32 max_lock_us;
+	u32 resumes;
+	u32 state_restores;
+	u32 last_resume_us;
+	u32 max_resume_us;
+};
+
 /**
  * struct clk_hb_dac2hd_drvdata - Common struct to the HiFiBerry DAC2 HD Clk
  * @hw: clk_hw for the common clk framework
+ * @profile: PLL tables, possibly shared with other instances
+ * @cur: rate whose dedicated table is programmed, used to compute deltas
  */
 struct clk_hb_dac2hd_drvdata {
 	struct regmap *regmap;
@@ -175,78 +358,306 @@ struct clk_hb_dac2hd_drvdata {
 	struct device *dev;
 #ifdef CLK_DAC2HD_PREPARE_INIT
 	bool prepared;
+#ifdef CLK_DAC2HD_ASYNC_INIT
+	struct work_struct init_work;
+	struct completion init_done;
+#endif /* CLK_DAC2HD_ASYNC_INIT */
 #endif /* CLK_DAC2HD_PREPARE_INIT */
+#ifdef CLK_DAC2HD_FW_PROFILE
+	/* completed once the firmware (or DT fallback) tables are in place */
+	struct completion profile_done;
+	int profile_ret;
+#endif /* CLK_DAC2HD_FW_PROFILE */
+	const struct clk_hb_dac2hd_profile *profile;
+	/* last dedicated table written to the PLL, NULL if unknown */
+	const struct clk_hb_dac2hd_rate *cur;
+	/* scratch for the registers that differ from cur */
+	struct reg_default delta[CLK_DAC2HD_PLL_MAX_REGISTER];
+	struct clk_hb_dac2hd_stats stats;
+#ifdef CLK_DAC2HD_RUNTIME_PM
+	/* output enable/CLKx_CTRL values to restore on runtime resume */
+	unsigned int pm_output_en;
+	u8 pm_clk_ctrl[CLK_DAC2HD_NUM_CLK_CTRL];
+#endif /* CLK_DAC2HD_RUNTIME_PM */
 };
 
 #define to_clk_hb_dac2hd(_hw)\
 		container_of(_hw, struct clk_hb_dac2hd_drvdata, hw)
 
-static int clk_hb_dac2hd_write_pll_regs(struct device *dev,
-					struct regmap *regmap,
-					struct reg_default *regs,
+#ifdef CLK_DAC2HD_FW_PROFILE
+static int clk_hb_dac2hd_wait_profile(struct clk_hb_dac2hd_drvdata *drvdata)
+{
+	wait_for_completion(&drvdata->profile_done);
+	return drvdata->profile_ret;
+}
+#endif /* CLK_DAC2HD_FW_PROFILE */
+
+/*
+ * Soft reset the PLL and wait for it to lock. Rather than sleeping for a
+ * fixed 10ms the device status register is polled until SYS_INIT and
+ * LOL_A (all outputs are sourced from PLL A) clear.
+ */
+static int clk_hb_dac2hd_pll_reset(struct clk_hb_dac2hd_drvdata *drvdata,
+				   unsigned int timeout_us)
+{
+	int ret;
+	unsigned int status;
+	unsigned int lock_us;
+	ktime_t start;
+	struct device *dev = drvdata->dev;
+
+#ifdef DDEBUG
+	dev_dbg(dev, "%s: re-setting pll\n", __func__);
+#endif /* DDEBUG */
+	ret = regmap_write(drvdata->regmap,
+			   clk_hb_dac2hd_pll_reg_soft_reset.reg,
+			   clk_hb_dac2hd_pll_reg_soft_reset.def);
+	if (ret) {
+		dev_err(dev, "%s: failed to write regmap pll_soft_reset!\n",
+			__func__);
+		return ret;
+	}
+	start = ktime_get();
+	drvdata->stats.pll_resets++;
+
+	usleep_range(CLK_DAC2HD_PLL_LOCK_POLL_US,
+		     CLK_DAC2HD_PLL_LOCK_POLL_US + 50);
+	ret = regmap_read_poll_timeout(drvdata->regmap,
+				       CLK_DAC2HD_REG_DEVICE_STATUS, status,
+				       !(status & CLK_DAC2HD_STATUS_NOT_LOCKED),
+				       CLK_DAC2HD_PLL_LOCK_POLL_US,
+				       timeout_us);
+	lock_us = (unsigned int)ktime_us_delta(ktime_get(), start);
+	if (ret == -ETIMEDOUT) {
+		/* carry on like the fixed sleep did, but make it visible */
+		drvdata->stats.lock_timeouts++;
+		dev_warn(dev, "%s: pll not locked after %uus (status=0x%02x)\n",
+			 __func__, lock_us, status);
+		return 0;
+	}
+	if (ret) {
+		dev_err(dev, "%s: failed to read device status!\n", __func__);
+		return ret;
+	}
+
+	drvdata->stats.last_lock_us = lock_us;
+	if (lock_us > drvdata->stats.max_lock_us)
+		drvdata->stats.max_lock_us = lock_us;
+#ifdef DDEBUG
+	dev_dbg(dev, "%s: pll locked after %uus\n", __func__, lock_us);
+#endif /* DDEBUG */
+	return 0;
+}
+
+/*
+ * Write a reg/val table, coalescing each run of consecutive registers into
+ * one regmap_bulk_write(), i.e. a single auto-incrementing I2C transaction.
+ * Tables are expected to be sorted by register; an unsorted table is still
+ * written correctly, just in more (shorter) bursts.
+ */
+static int clk_hb_dac2hd_write_pll_regs(struct clk_hb_dac2hd_drvdata *drvdata,
+					const struct reg_default *regs,
 					int num, int do_pll_reset)
 {
 	int i;
+	int len;
 	int ret = 0;
+	struct device *dev = drvdata->dev;
+	struct regmap *regmap = drvdata->regmap;
+	u8 vals[CLK_DAC2HD_PLL_MAX_REGISTER];
 //	char pll_soft_reset[] = { 177, 0xAC, };
 
-	dev_dbg(dev, "%s: ENTER: do_pll_reset=%s\n", __func__, 
-		(do_pll_reset ? "true" : "false"));
+	dd_trace(dev, "%s: ENTER: num=%d, do_pll_reset=%s\n", __func__, num,
+		 (do_pll_reset ? "true" : "false"));
 
-	for (i = 0; i < num; i++) {
-		ret |= regmap_write(regmap, regs[i].reg, regs[i].def);
+	for (i = 0; i < num; i += len) {
+		vals[0] = regs[i].def;
+		for (len = 1; i + len < num &&
+			      regs[i + len].reg == regs[i].reg + len; len++)
+			vals[len] = regs[i + len].def;
+
+		if (len == 1)
+			ret = regmap_write(regmap, regs[i].reg, vals[0]);
+		else
+			ret = regmap_bulk_write(regmap, regs[i].reg, vals,
+						len);
 		if (ret) {
-			dev_err(dev, "%s: EXIT [%d]: failed to write regmap!\n",
-				__func__, ret);
+			dev_err(dev, "%s: EXIT [%d]: failed to write regmap "
+				"(reg=0x%02x, len=%d)!\n", __func__, ret,
+				regs[i].reg, len);
 			return ret;
 		}
-	}
-	if (do_pll_reset) {
 #ifdef DDEBUG
-		dev_dbg(dev, "%s: re-setting pll\n", __func__);
+		dev_dbg(dev, "%s: burst reg=0x%02x, len=%d\n", __func__,
+			regs[i].reg, len);
 #endif /* DDEBUG */
-//		ret |= regmap_write(regmap, pll_soft_reset[0],
-//				    pll_soft_reset[1]);
-		ret = regmap_write(regmap, clk_hb_dac2hd_pll_reg_soft_reset.reg,
-				   clk_hb_dac2hd_pll_reg_soft_reset.def);
+	}
+	if (do_pll_reset) {
+		ret = clk_hb_dac2hd_pll_reset(drvdata,
+					      CLK_DAC2HD_PLL_LOCK_TIMEOUT_US);
 		if (ret) {
-			dev_err(dev, "%s: EXIT [%d]: failed to write "
-				"regmap pll_soft_reset!\n", __func__, ret);
+			dev_err(dev, "%s: EXIT [%d]: pll reset failed!\n",
+				__func__, ret);
 			return ret;
 		}
-//		mdelay(10);
-		usleep_range(9950, 10050);
 	}
 
 //	return ret;
-	dev_dbg(dev, "%s: EXIT [0]\n", __func__);
+	dd_trace(dev, "%s: EXIT [0]\n", __func__);
+	return 0;
+}
+/*
+ * Collect the entries of @tgt whose value differs from (or is missing in)
+ * @cur into @delta. Both tables must be sorted by register.
+ */
+static int clk_hb_dac2hd_pll_delta(const struct reg_default *cur, int num_cur,
+				   const struct reg_default *tgt, int num_tgt,
+				   struct reg_default *delta)
+{
+	int i;
+	int j = 0;
+	int num = 0;
+
+	for (i = 0; i < num_tgt; i++) {
+		while (j < num_cur && cur[j].reg < tgt[i].reg)
+			j++;
+		if (j < num_cur && cur[j].reg == tgt[i].reg &&
+		    cur[j].def == tgt[i].def)
+			continue;
+		delta[num++] = tgt[i];
+	}
+
+	return num;
+}
+
+#ifdef CLK_DAC2HD_FAMILY_SWITCH
+/*
+ * True if any register in @regs configures the VCO (PLL input, feedback
+ * multisynths or crystal load) rather than just the output dividers.
+ */
+static bool clk_hb_dac2hd_touches_vco(const struct reg_default *regs, int num)
+{
+	int i;
+
+	for (i = 0; i < num; i++) {
+		if (regs[i].reg == CLK_DAC2HD_REG_PLL_INPUT_SRC ||
+		    regs[i].reg == CLK_DAC2HD_REG_XTAL_LOAD ||
+		    (regs[i].reg >= CLK_DAC2HD_REG_MSNA_FIRST &&
+		     regs[i].reg <= CLK_DAC2HD_REG_MSNB_LAST))
+			return true;
+	}
+
+	return false;
+}
+#endif /* CLK_DAC2HD_FAMILY_SWITCH */
+
+/*
+ * Switch the PLL to the dedicated table of rate @r. If the currently
+ * programmed table is known only the registers that change are written,
+ * and an empty delta skips the PLL reset altogether. With
+ * CLK_DAC2HD_FAMILY_SWITCH a switch within the same family that leaves the
+ * VCO alone only reprograms the output dividers, without reset or relock.
+ */
+static int clk_hb_dac2hd_write_dedicated_regs(
+				struct clk_hb_dac2hd_drvdata *drvdata,
+				const struct clk_hb_dac2hd_rate *r)
+{
+	int ret;
+	int num;
+	const struct reg_default *regs;
+	const struct clk_hb_dac2hd_table *cur;
+	const struct clk_hb_dac2hd_table *tgt =
+			clk_hb_dac2hd_rate_table(drvdata->profile, r);
+	struct device *dev = drvdata->dev;
+
+	dd_trace(dev, "%s: ENTER: rate=%lu\n", __func__, r->rate);
+
+	if (!drvdata->cur) {
+		regs = tgt->regs;
+		num = tgt->num_regs;
+	} else {
+		cur = clk_hb_dac2hd_rate_table(drvdata->profile, drvdata->cur);
+		num = clk_hb_dac2hd_pll_delta(cur->regs, cur->num_regs,
+					      tgt->regs, tgt->num_regs,
+					      drvdata->delta);
+		regs = drvdata->delta;
+#ifdef DDEBUG
+		dev_dbg(dev, "%s: %d of %d registers differ\n", __func__,
+			num, tgt->num_regs);
+#endif /* DDEBUG */
+		if (!num) {
+			ret = 0;
+			goto out;
+		}
+	}
+
+	ret = clk_hb_dac2hd_write_pll_regs(drvdata, regs, num,
+					   CLK_DAC2HD_NO_PLL_RESET);
+	if (ret)
+		goto out;
+#ifdef CLK_DAC2HD_FAMILY_SWITCH
+	if (drvdata->cur && drvdata->cur->family == r->family &&
+	    !clk_hb_dac2hd_touches_vco(regs, num)) {
+#ifdef DDEBUG
+		dev_dbg(dev, "%s: same family (%lu), skip pll reset\n",
+			__func__, r->family);
+#endif /* DDEBUG */
+		drvdata->stats.fast_switches++;
+		goto out;
+	}
+#endif /* CLK_DAC2HD_FAMILY_SWITCH */
+	ret = clk_hb_dac2hd_pll_reset(drvdata, r->lock_timeout_us);
+out:
+	if (ret) {
+		/* chip state unknown, force a full write next time */
+		drvdata->cur = NULL;
+		dev_err(dev, "%s: EXIT [%d]: write_pll_regs failed!\n",
+			__func__, ret);
+		return ret;
+	}
+
+	drvdata->cur = r;
+
+	dd_trace(dev, "%s: EXIT [0]\n", __func__);
 	return 0;
 }
+
 #ifdef CLK_DAC2HD_PREPARE_INIT
+#ifndef CLK_DAC2HD_RUNTIME_PM
 static int clk_hb_dac2hd_is_prepared(struct clk_hw *hw)
 {
 	struct clk_hb_dac2hd_drvdata *drvdata = to_clk_hb_dac2hd(hw);
 	struct device *dev = drvdata->dev;
 	
-	dev_dbg(dev, "%s: ENTER: EXIT [%s]\n", __func__,
-		(drvdata->prepared ? "true" : "false"));
+	dd_trace(dev, "%s: ENTER: EXIT [%s]\n", __func__,
+		 (drvdata->prepared ? "true" : "false"));
 	return drvdata->prepared;
 }
+#endif /* CLK_DAC2HD_RUNTIME_PM */
 
-static int clk_hb_dac2hd_prepare(struct clk_hw *hw)
+/*
+ * Bring the PLL up from scratch: defaults, common table and the dedicated
+ * table of the default rate.
+ */
+static int clk_hb_dac2hd_pll_init(struct clk_hb_dac2hd_drvdata *drvdata)
 {
 	int ret = 0;
-	struct clk_hb_dac2hd_drvdata *drvdata = to_clk_hb_dac2hd(hw);
+	const struct clk_hb_dac2hd_rate *r;
 	struct device *dev = drvdata->dev;
 
-	dev_dbg(dev, "%s: ENTER\n", __func__);
-	
-	if (drvdata->prepared)
-		goto out;
+	dd_trace(dev, "%s: ENTER\n", __func__);
+
+#ifdef CLK_DAC2HD_FW_PROFILE
+	ret = clk_hb_dac2hd_wait_profile(drvdata);
+	if (ret) {
+		dev_err(dev, "%s: EXIT [%d]: no pll profile!\n", __func__, ret);
+		return ret;
+	}
+#endif /* CLK_DAC2HD_FW_PROFILE */
 #ifdef DDEBUG
 	dev_dbg(dev, "%s: load pll_reg_defaults\n", __func__);
 #endif /* DDEBUG */
-	ret = clk_hb_dac2hd_write_pll_regs(dev, drvdata->regmap,
+	ret = clk_hb_dac2hd_write_pll_regs(drvdata,
 				clk_hb_dac2hd_pll_reg_defaults,
 				ARRAY_SIZE(clk_hb_dac2hd_pll_reg_defaults),
 				CLK_DAC2HD_NO_PLL_RESET);
@@ -258,9 +669,9 @@ static int clk_hb_dac2hd_prepare(struct clk_hw *hw)
 #ifdef DDEBUG
 	dev_dbg(dev, "%s: load common_pll_regs\n", __func__);
 #endif /* DDEBUG */
-	ret = clk_hb_dac2hd_write_pll_regs(dev, drvdata->regmap,
-					   clk_hb_dac2hd_common_pll_regs,
-					   clk_hb_dac2hd_num_common_pll_regs,
+	ret = clk_hb_dac2hd_write_pll_regs(drvdata,
+					   drvdata->profile->common.regs,
+					   drvdata->profile->common.num_regs,
 					   CLK_DAC2HD_NO_PLL_RESET);
 	if (ret) {
 		dev_err(dev, "%s: EXIT [%d]: write_pll_regs (common_pll_regs) "
@@ -268,31 +679,95 @@ static int clk_hb_dac2hd_prepare(struct clk_hw *hw)
 		return ret;
 	}
 
-#ifdef DDEBUG
-	dev_dbg(dev, "%s: load 44k1_pll_regs\n", __func__);
-#endif /* DDEBUG */
-	ret = clk_hb_dac2hd_write_pll_regs(dev, drvdata->regmap,
-				clk_hb_dac2hd_dedicated_44k1_pll_regs,
-				clk_hb_dac2hd_num_dedicated_44k1_pll_regs,
-				CLK_DAC2HD_PLL_RESET);
+	r = clk_hb_dac2hd_find_rate(drvdata->profile,
+				    CLK_DAC2HD_DEFAULT_RATE);
+	if (!r) {
+		dev_err(dev, "%s: EXIT [-EINVAL]: no pll_regs for default "
+			"rate=%d!\n", __func__, CLK_DAC2HD_DEFAULT_RATE);
+		return -EINVAL;
+	}
+	drvdata->cur = NULL;
+	ret = clk_hb_dac2hd_write_dedicated_regs(drvdata, r);
 	if (ret) {
-		dev_err(dev, "%s: EXIT [%d]: write_pll_regs (44k1_pll_regs) "
-			"failed!\n", __func__, ret);
+		dev_err(dev, "%s: EXIT [%d]: write_pll_regs (%s) "
+			"failed!\n", __func__, ret, r->prop_name);
 		return ret;
 	}
 	
 	drvdata->rate = CLK_DAC2HD_DEFAULT_RATE;
 	drvdata->prepared = true;
+
+	dd_trace(dev, "%s: EXIT [0]\n", __func__);
+	return 0;
+}
+
+#ifdef CLK_DAC2HD_ASYNC_INIT
+static void clk_hb_dac2hd_init_work(struct work_struct *work)
+{
+	struct clk_hb_dac2hd_drvdata *drvdata =
+		container_of(work, struct clk_hb_dac2hd_drvdata, init_work);
+
+	/* a failure is retried synchronously by the next prepare */
+	clk_hb_dac2hd_pll_init(drvdata);
+	complete_all(&drvdata->init_done);
+#ifdef CLK_DAC2HD_RUNTIME_PM
+	pm_runtime_mark_last_busy(drvdata->dev);
+	pm_runtime_put_autosuspend(drvdata->dev);
+#endif /* CLK_DAC2HD_RUNTIME_PM */
+}
+
+static void clk_hb_dac2hd_cancel_init(void *data)
+{
+	struct clk_hb_dac2hd_drvdata *drvdata = data;
+
+#ifdef CLK_DAC2HD_RUNTIME_PM
+	/* drop the reference of a work that never ran */
+	if (cancel_work_sync(&drvdata->init_work))
+		pm_runtime_put_noidle(drvdata->dev);
+#else
+	cancel_work_sync(&drvdata->init_work);
+#endif /* CLK_DAC2HD_RUNTIME_PM */
+}
+#endif /* CLK_DAC2HD_ASYNC_INIT */
+
+static int clk_hb_dac2hd_prepare(struct clk_hw *hw)
+{
+	int ret = 0;
+	struct clk_hb_dac2hd_drvdata *drvdata = to_clk_hb_dac2hd(hw);
+	struct device *dev = drvdata->dev;
+
+	dd_trace(dev, "%s: ENTER\n", __func__);
+
+#ifdef CLK_DAC2HD_ASYNC_INIT
+	/* bring-up started at probe, usually finished by now */
+	wait_for_completion(&drvdata->init_done);
+#endif /* CLK_DAC2HD_ASYNC_INIT */
+	if (drvdata->prepared)
+		goto out;
+
+	ret = clk_hb_dac2hd_pll_init(drvdata);
+	if (ret) {
+		dev_err(dev, "%s: EXIT [%d]: pll_init failed!\n", __func__,
+			ret);
+		return ret;
+	}
 out:
-	dev_dbg(dev, "%s: EXIT [0]\n", __func__);
+	dd_trace(dev, "%s: EXIT [0]\n", __func__);
 	return 0;
 }
 
 static void clk_hb_dac2hd_unprepare(struct clk_hw *hw)
 {
 	struct clk_hb_dac2hd_drvdata *drvdata = to_clk_hb_dac2hd(hw);
+#ifndef CLK_DAC2HD_RUNTIME_PM
 	drvdata->prepared = false;
-	dev_dbg(drvdata->dev, "%s: ENTER: EXIT [void]\n", __func__);
+#endif /* CLK_DAC2HD_RUNTIME_PM */
+	/*
+	 * With CLK_DAC2HD_RUNTIME_PM the PLL stays configured, runtime
+	 * suspend only powers down the outputs, so the next prepare does not
+	 * have to replay the tables.
+	 */
+	dd_trace(drvdata->dev, "%s: ENTER: EXIT [void]\n", __func__);
 }
 #endif /* CLK_DAC2HD_PREPARE_INIT */
 static unsigned long clk_hb_dac2hd_recalc_rate(struct clk_hw *hw,
@@ -300,32 +775,71 @@ static unsigned long clk_hb_dac2hd_recalc_rate(struct clk_hw *hw,
 {
 	struct clk_hb_dac2hd_drvdata *drvdata = to_clk_hb_dac2hd(hw);
 
-	dev_dbg(drvdata->dev, "%s: ENTER: parent_rate=%lu: EXIT [%lu]\n",
-		__func__, parent_rate, drvdata->rate);	
+	dd_trace(drvdata->dev, "%s: ENTER: parent_rate=%lu: EXIT [%lu]\n",
+		 __func__, parent_rate, drvdata->rate);	
 	return drvdata->rate;
 }
 
-static long clk_hb_dac2hd_round_rate(struct clk_hw *hw,
-	unsigned long rate, unsigned long *parent_rate)
+/*
+ * Snap to the nearest enabled registry rate within the request's bounds, so
+ * the CCF (and clk_round_rate() users) only ever see achievable rates.
+ */
+static int clk_hb_dac2hd_determine_rate(struct clk_hw *hw,
+					struct clk_rate_request *req)
 {
+	int i;
+	unsigned long diff;
+	unsigned long best = 0;
+	unsigned long best_diff = ULONG_MAX;
+	const struct clk_hb_dac2hd_rate *r;
 	struct clk_hb_dac2hd_drvdata *drvdata = to_clk_hb_dac2hd(hw);
 
-	dev_dbg(drvdata->dev, "%s: ENTER: rate=%lu: EXIT [%lu]\n",
-		__func__, rate, rate);
-	return rate;
+#ifdef CLK_DAC2HD_FW_PROFILE
+	/* rate users (the card's constraint) may come before the profile */
+	if (clk_hb_dac2hd_wait_profile(drvdata))
+		return -EINVAL;
+#endif /* CLK_DAC2HD_FW_PROFILE */
+	for (i = 0; i < ARRAY_SIZE(clk_hb_dac2hd_rates); i++) {
+		r = &clk_hb_dac2hd_rates[i];
+		if (drvdata->profile->rates[i].num_regs <= 0 ||
+		    r->rate < req->min_rate ||
+		    r->rate > req->max_rate)
+			continue;
+		diff = (r->rate > req->rate) ? r->rate - req->rate :
+					       req->rate - r->rate;
+		if (diff < best_diff) {
+			best = r->rate;
+			best_diff = diff;
+		}
+	}
+
+	if (!best) {
+		dd_trace(drvdata->dev, "%s: ENTER: rate=%lu: EXIT [-EINVAL]\n",
+			 __func__, req->rate);
+		return -EINVAL;
+	}
+
+	dd_trace(drvdata->dev, "%s: ENTER: rate=%lu: EXIT [0]: %lu\n",
+		 __func__, req->rate, best);
+	req->rate = best;
+	return 0;
 }
 
-static int clk_hb_dac2hd_set_rate(struct clk_hw *hw,
+static int __clk_hb_dac2hd_set_rate(struct clk_hw *hw,
 	unsigned long rate, unsigned long parent_rate)
 {
 	int ret;
+	const struct clk_hb_dac2hd_rate *r;
 	struct clk_hb_dac2hd_drvdata *drvdata = to_clk_hb_dac2hd(hw);
 	struct device *dev = drvdata->dev;
 
-	dev_dbg(dev, "%s: ENTER: rate=%lu, parent_rate=%lu\n", __func__, rate,
-		parent_rate);
+	dd_trace(dev, "%s: ENTER: rate=%lu, parent_rate=%lu\n", __func__, rate,
+		 parent_rate);
 
 #ifdef CLK_DAC2HD_PREPARE_INIT
+#ifdef CLK_DAC2HD_ASYNC_INIT
+	wait_for_completion(&drvdata->init_done);
+#endif /* CLK_DAC2HD_ASYNC_INIT */
 	if (!drvdata->prepared) {
 #ifdef DDEBUG
 		dev_dbg(dev, "%s: prepare clock\n", __func__);
@@ -340,80 +854,22 @@ static int clk_hb_dac2hd_set_rate(struct clk_hw *hw,
 #endif /* CLK_DAC2HD_PREPARE_INIT */
 
 	if (rate == drvdata->rate) {
-		dev_dbg(dev, "%s: EXIT [0]: noop - already running at %lu\n",
-			__func__, rate);
+		dd_trace(dev, "%s: EXIT [0]: noop - already running at %lu\n",
+			 __func__, rate);
 		return 0;
 	}
 
-	switch (rate) {
-	case 44100:
-#ifdef DDEBUG
-		dev_dbg(dev, "%s: loading 44k1_pll_regs\n", __func__);
-#endif /* DDEBUG */
-		ret = clk_hb_dac2hd_write_pll_regs(drvdata->dev,
-			drvdata->regmap,
-			clk_hb_dac2hd_dedicated_44k1_pll_regs,
-			clk_hb_dac2hd_num_dedicated_44k1_pll_regs,
-			CLK_DAC2HD_PLL_RESET);
-		break;
-	case 88200:
-#ifdef DDEBUG
-		dev_dbg(dev, "%s: loading 88k2_pll_regs\n", __func__);
-#endif /* DDEBUG */
-		ret = clk_hb_dac2hd_write_pll_regs(drvdata->dev,
-			drvdata->regmap,
-			clk_hb_dac2hd_dedicated_88k2_pll_regs,
-			clk_hb_dac2hd_num_dedicated_88k2_pll_regs,
-			CLK_DAC2HD_PLL_RESET);
-		break;
-	case 176400:
-#ifdef DDEBUG
-		dev_dbg(dev, "%s: loading 176k4_pll_regs\n", __func__);
-#endif /* DDEBUG */
-		ret = clk_hb_dac2hd_write_pll_regs(drvdata->dev,
-			drvdata->regmap,
-			clk_hb_dac2hd_dedicated_176k4_pll_regs,
-			clk_hb_dac2hd_num_dedicated_176k4_pll_regs,
-			CLK_DAC2HD_PLL_RESET);
-		break;
-	case 48000:
-#ifdef DDEBUG
-		dev_dbg(dev, "%s: loading 48k_pll_regs\n", __func__);
-#endif /* DDEBUG */
-		ret = clk_hb_dac2hd_write_pll_regs(drvdata->dev,
-			drvdata->regmap,
-			clk_hb_dac2hd_dedicated_48k_pll_regs,
-			clk_hb_dac2hd_num_dedicated_48k_pll_regs,
-			CLK_DAC2HD_PLL_RESET);
-		break;
-	case 96000:
-#ifdef DDEBUG
-		dev_dbg(dev, "%s: loading 96k_pll_regs\n", __func__);
-#endif /* DDEBUG */
-		ret = clk_hb_dac2hd_write_pll_regs(drvdata->dev,
-			drvdata->regmap,
-			clk_hb_dac2hd_dedicated_96k_pll_regs,
-			clk_hb_dac2hd_num_dedicated_96k_pll_regs,
-			CLK_DAC2HD_PLL_RESET);
-		break;
-	case 192000:
-#ifdef DDEBUG
-		dev_dbg(dev, "%s: loading dedicated_192k_pll_regs\n", __func__);
-#endif /* DDEBUG */
-		ret = clk_hb_dac2hd_write_pll_regs(drvdata->dev,
-			drvdata->regmap,
-			clk_hb_dac2hd_dedicated_192k_pll_regs,
-			clk_hb_dac2hd_num_dedicated_192k_pll_regs,
-			CLK_DAC2HD_PLL_RESET);
-		break;
-	default:
-//		ret = -EINVAL;
+	r = clk_hb_dac2hd_find_rate(drvdata->profile, rate);
+	if (!r) {
 		dev_err(dev, "%s: EXIT [-EINVAL]: invalid rate=%lu!\n",
 			__func__, rate);
-		return -EINVAL;		
-//		break;
+		return -EINVAL;
 	}
 
+#ifdef DDEBUG
+	dev_dbg(dev, "%s: loading %s\n", __func__, r->prop_name);
+#endif /* DDEBUG */
+	ret = clk_hb_dac2hd_write_dedicated_regs(drvdata, r);
 	if (ret < 0) {
 		dev_err(dev, "%s: EXIT [%d]: error writing pll "
 			"registers for rate=%lu!\n", __func__, ret, rate);
@@ -423,18 +879,130 @@ static int clk_hb_dac2hd_set_rate(struct clk_hw *hw,
 //	to_clk_hb_dac2hd(hw)->rate = rate;
 	drvdata->rate = rate;
 
-	dev_dbg(dev, "%s: EXIT [%d]\n", __func__, ret);
+	dd_trace(dev, "%s: EXIT [%d]\n", __func__, ret);
+	return ret;
+}
+
+static int clk_hb_dac2hd_set_rate(struct clk_hw *hw,
+	unsigned long rate, unsigned long parent_rate)
+{
+	struct clk_hb_dac2hd_drvdata *drvdata = to_clk_hb_dac2hd(hw);
+	unsigned long old_rate = drvdata->rate;
+	struct dd_span span;
+	int ret;
+
+	dd_span_begin(&span, drvdata->regmap);
+	ret = __clk_hb_dac2hd_set_rate(hw, rate, parent_rate);
+	trace_dd_clk_set_rate(drvdata->dev, old_rate, rate, ret, &span);
+	dd_hist_add(&drvdata->stats.set_rate, span.start);
+	if (!ret)
+		dd_rate_switch(drvdata->stats.rate_switches,
+			       &drvdata->stats.rate, rate);
 	return ret;
 }
 #ifndef CLK_DAC2HD_STATIC_DEFAULTS
-static int clk_hb_dac2hd_get_prop_values(struct device *dev, char *prop_name,
+static int clk_hb_dac2hd_reg_cmp(const void *a, const void *b)
+{
+	const struct reg_default *ra = a;
+	const struct reg_default *rb = b;
+
+	return (int)ra->reg - (int)rb->reg;
+}
+
+static bool clk_hb_dac2hd_table_equal(const struct clk_hb_dac2hd_table *a,
+				      const struct clk_hb_dac2hd_table *b)
+{
+	if (a->num_regs != b->num_regs)
+		return false;
+	if (a->num_regs <= 0)
+		return true;
+	return !memcmp(a->regs, b->regs, a->num_regs * sizeof(*a->regs));
+}
+
+static bool clk_hb_dac2hd_profile_equal(const struct clk_hb_dac2hd_profile *a,
+					const struct clk_hb_dac2hd_profile *b)
+{
+	int i;
+
+	if (!clk_hb_dac2hd_table_equal(&a->common, &b->common))
+		return false;
+	for (i = 0; i < ARRAY_SIZE(clk_hb_dac2hd_rates); i++) {
+		if (!clk_hb_dac2hd_table_equal(&a->rates[i], &b->rates[i]))
+			return false;
+	}
+
+	return true;
+}
+
+static struct clk_hb_dac2hd_profile *clk_hb_dac2hd_profile_alloc(int num_pool)
+{
+	struct clk_hb_dac2hd_profile *profile;
+
+	profile = kzalloc(struct_size(profile, pool, num_pool), GFP_KERNEL);
+	if (profile)
+		kref_init(&profile->ref);
+
+	return profile;
+}
+
+/*
+ * Hand out an already loaded profile with the same tables if there is one
+ * (freeing @profile), otherwise register @profile for later instances.
+ */
+static const struct clk_hb_dac2hd_profile *clk_hb_dac2hd_profile_share(
+					struct clk_hb_dac2hd_profile *profile)
+{
+	struct clk_hb_dac2hd_profile *p;
+
+	mutex_lock(&clk_hb_dac2hd_profiles_lock);
+	list_for_each_entry(p, &clk_hb_dac2hd_profiles, node) {
+		if (clk_hb_dac2hd_profile_equal(p, profile)) {
+			kref_get(&p->ref);
+			kfree(profile);
+			profile = p;
+			goto out;
+		}
+	}
+	list_add(&profile->node, &clk_hb_dac2hd_profiles);
+out:
+	mutex_unlock(&clk_hb_dac2hd_profiles_lock);
+	return profile;
+}
+
+static void clk_hb_dac2hd_profile_release(struct kref *ref)
+{
+	struct clk_hb_dac2hd_profile *profile =
+		container_of(ref, struct clk_hb_dac2hd_profile, ref);
+
+	list_del(&profile->node);
+	kfree(profile);
+}
+
+static void clk_hb_dac2hd_profile_put(void *data)
+{
+	struct clk_hb_dac2hd_drvdata *drvdata = data;
+	/* only loaded profiles end up here, those are not really const */
+	struct clk_hb_dac2hd_profile *profile =
+		(struct clk_hb_dac2hd_profile *)drvdata->profile;
+
+	if (!profile)
+		return;
+
+	mutex_lock(&clk_hb_dac2hd_profiles_lock);
+	kref_put(&profile->ref, clk_hb_dac2hd_profile_release);
+	mutex_unlock(&clk_hb_dac2hd_profiles_lock);
+	drvdata->profile = NULL;
+}
+
+static int clk_hb_dac2hd_get_prop_values(struct device *dev,
+					 const char *prop_name,
 					 struct reg_default *regs)
 {
 	int ret;
 	int i;
 	u8 tmp[2 * CLK_DAC2HD_PLL_MAX_REGISTER];
 
-	dev_dbg(dev, "%s: ENTER: prop_name=%s\n", __func__, prop_name);
+	dd_trace(dev, "%s: ENTER: prop_name=%s\n", __func__, prop_name);
 
 	ret = of_property_read_variable_u8_array(dev->of_node, prop_name,
 			tmp, 0, 2 * CLK_DAC2HD_PLL_MAX_REGISTER);
@@ -454,62 +1022,500 @@ static int clk_hb_dac2hd_get_prop_values(struct device *dev, char *prop_name,
 		regs[i].reg = (u32)tmp[2 * i];
 		regs[i].def = (u32)tmp[2 * i + 1];
 	}
+	/* sort once here so the write path can burst consecutive registers */
+	sort(regs, ret, sizeof(*regs), clk_hb_dac2hd_reg_cmp, NULL);
 
-	dev_dbg(dev, "%s: EXIT [%d]\n", __func__, ret);
+	dd_trace(dev, "%s: EXIT [%d]\n", __func__, ret);
 	return ret;
 }
 
-static int clk_hb_dac2hd_dt_parse(struct device *dev)
-{
-	dev_dbg(dev, "%s: ENTER\n", __func__);
-
-	clk_hb_dac2hd_num_common_pll_regs =
-		clk_hb_dac2hd_get_prop_values(dev, "common_pll_regs",
-				clk_hb_dac2hd_common_pll_regs);
-	clk_hb_dac2hd_num_dedicated_44k1_pll_regs =
-		clk_hb_dac2hd_get_prop_values(dev, "44k1_pll_regs",
-				clk_hb_dac2hd_dedicated_44k1_pll_regs);
-	clk_hb_dac2hd_num_dedicated_88k2_pll_regs =
-		clk_hb_dac2hd_get_prop_values(dev, "88k2_pll_regs",
-				clk_hb_dac2hd_dedicated_88k2_pll_regs);
-	clk_hb_dac2hd_num_dedicated_176k4_pll_regs =
-		clk_hb_dac2hd_get_prop_values(dev, "176k4_pll_regs",
-				clk_hb_dac2hd_dedicated_176k4_pll_regs);
-	clk_hb_dac2hd_num_dedicated_48k_pll_regs =
-		clk_hb_dac2hd_get_prop_values(dev, "48k_pll_regs",
-				clk_hb_dac2hd_dedicated_48k_pll_regs);
-	clk_hb_dac2hd_num_dedicated_96k_pll_regs =
-		clk_hb_dac2hd_get_prop_values(dev, "96k_pll_regs",
-				clk_hb_dac2hd_dedicated_96k_pll_regs);
-	clk_hb_dac2hd_num_dedicated_192k_pll_regs =
-		clk_hb_dac2hd_get_prop_values(dev, "192k_pll_regs",
-				clk_hb_dac2hd_dedicated_192k_pll_regs);
-
-	dev_dbg(dev, "%s: EXIT [0]\n", __func__);
+static int clk_hb_dac2hd_dt_parse(struct clk_hb_dac2hd_drvdata *drvdata)
+{
+	int i;
+	int num;
+	int total = 0;
+	struct reg_default *regs;
+	struct clk_hb_dac2hd_profile *profile;
+	const struct clk_hb_dac2hd_rate *r;
+	struct device *dev = drvdata->dev;
+
+	dd_trace(dev, "%s: ENTER\n", __func__);
+
+	/* size the pool first, so all tables fit in one allocation */
+	num = of_property_count_u8_elems(dev->of_node, "common_pll_regs");
+	if (num > 0)
+		total += num / 2;
+	for (i = 0; i < ARRAY_SIZE(clk_hb_dac2hd_rates); i++) {
+		num = of_property_count_u8_elems(dev->of_node,
+						 clk_hb_dac2hd_rates[i].prop_name);
+		if (num > 0)
+			total += num / 2;
+	}
+	profile = clk_hb_dac2hd_profile_alloc(total);
+	if (!profile) {
+		dev_err(dev, "%s: EXIT [-ENOMEM]: profile_alloc failed!\n",
+			__func__);
+		return -ENOMEM;
+	}
+
+	regs = profile->pool;
+	num = clk_hb_dac2hd_get_prop_values(dev, "common_pll_regs", regs);
+	profile->common.regs = regs;
+	profile->common.num_regs = num;
+	if (num > 0)
+		regs += num;
+
+	for (i = 0; i < ARRAY_SIZE(clk_hb_dac2hd_rates); i++) {
+		r = &clk_hb_dac2hd_rates[i];
+		if (!of_find_property(dev->of_node, r->prop_name, NULL)) {
+			/* not an error, the rate is just not supported */
+			dev_info(dev, "%s: no <%s>, rate=%lu disabled\n",
+				 __func__, r->prop_name, r->rate);
+			continue;
+		}
+		num = clk_hb_dac2hd_get_prop_values(dev, r->prop_name, regs);
+		profile->rates[i].regs = regs;
+		profile->rates[i].num_regs = num;
+		if (num > 0)
+			regs += num;
+	}
+
+	drvdata->profile = clk_hb_dac2hd_profile_share(profile);
+
+	dd_trace(dev, "%s: EXIT [0]\n", __func__);
 	return 0;
 }
+
+#ifdef CLK_DAC2HD_FW_PROFILE
+/*
+ * Validate a PLL profile blob and, only if all of it is sane, build a
+ * profile from it. All tables share one allocation sized to the register
+ * count.
+ */
+static int clk_hb_dac2hd_fw_parse(struct clk_hb_dac2hd_drvdata *drvdata,
+				  const u8 *data, size_t size)
+{
+	int i;
+	int pass;
+	int num;
+	int total = 0;
+	unsigned int reg;
+	unsigned int last;
+	size_t pos;
+	u8 j;
+	u8 len;
+	unsigned long rate;
+	struct clk_hb_dac2hd_profile *profile = NULL;
+	struct reg_default *pool = NULL;
+	struct reg_default *regs[ARRAY_SIZE(clk_hb_dac2hd_rates) + 1];
+	int num_regs[ARRAY_SIZE(clk_hb_dac2hd_rates) + 1];
+	const struct clk_hb_dac2hd_fw_header *hdr = (const void *)data;
+	const struct clk_hb_dac2hd_fw_section *sec;
+	const struct clk_hb_dac2hd_rate *r;
+	struct device *dev = drvdata->dev;
+
+	dd_trace(dev, "%s: ENTER: size=%zu\n", __func__, size);
+
+	if (size < sizeof(*hdr) ||
+	    le32_to_cpu(hdr->magic) != CLK_DAC2HD_FW_MAGIC ||
+	    le16_to_cpu(hdr->version) != CLK_DAC2HD_FW_VERSION ||
+	    le32_to_cpu(hdr->size) != size - sizeof(*hdr)) {
+		dev_err(dev, "%s: EXIT [-EINVAL]: bad header!\n", __func__);
+		return -EINVAL;
+	}
+	if (crc32_le(~0, data + sizeof(*hdr), size - sizeof(*hdr)) !=
+	    le32_to_cpu(hdr->crc32)) {
+		dev_err(dev, "%s: EXIT [-EBADMSG]: checksum mismatch!\n",
+			__func__);
+		return -EBADMSG;
+	}
+
+	/* pass 0 validates and counts, pass 1 fills the pool */
+	for (pass = 0; pass < 2; pass++) {
+		memset(num_regs, 0, sizeof(num_regs));
+		pos = sizeof(*hdr);
+		for (i = 0; i < le16_to_cpu(hdr->num_sections); i++) {
+			if (pos + sizeof(*sec) > size)
+				goto bad;
+			sec = (const void *)(data + pos);
+			pos += sizeof(*sec);
+			rate = le32_to_cpu(sec->rate);
+			if (rate == CLK_DAC2HD_FW_COMMON) {
+				num = 0;
+			} else {
+				r = bsearch(&rate, clk_hb_dac2hd_rates,
+					    ARRAY_SIZE(clk_hb_dac2hd_rates),
+					    sizeof(clk_hb_dac2hd_rates[0]),
+					    clk_hb_dac2hd_rate_cmp);
+				if (!r)
+					goto bad;
+				num = r - clk_hb_dac2hd_rates + 1;
+			}
+			if (num_regs[num])
+				goto bad;
+			if (pass)
+				regs[num] = pool + total;
+			last = 0;
+			for (j = 0; j < sec->num_runs; j++) {
+				if (pos + 2 > size)
+					goto bad;
+				reg = data[pos];
+				len = data[pos + 1];
+				pos += 2;
+				/* runs must ascend, the write path bursts them */
+				if (!len || pos + len > size ||
+				    (num_regs[num] && reg <= last) ||
+				    reg + len > CLK_DAC2HD_PLL_MAX_REGISTER)
+					goto bad;
+				for (; len; len--, reg++, pos++) {
+					if (pass) {
+						pool[total].reg = reg;
+						pool[total].def = data[pos];
+					}
+					total++;
+					num_regs[num]++;
+				}
+				last = reg - 1;
+			}
+		}
+		if (pos != size || !num_regs[0])
+			goto bad;
+		if (!pass) {
+			profile = clk_hb_dac2hd_profile_alloc(total);
+			if (!profile) {
+				dev_err(dev, "%s: EXIT [-ENOMEM]: "
+					"profile_alloc failed!\n", __func__);
+				return -ENOMEM;
+			}
+			pool = profile->pool;
+			total = 0;
+		}
+	}
+
+	profile->common.regs = regs[0];
+	profile->common.num_regs = num_regs[0];
+	for (i = 0; i < ARRAY_SIZE(clk_hb_dac2hd_rates); i++) {
+		profile->rates[i].regs = num_regs[i + 1] ? regs[i + 1] : NULL;
+		profile->rates[i].num_regs = num_regs[i + 1];
+	}
+	drvdata->profile = clk_hb_dac2hd_profile_share(profile);
+
+	dd_trace(dev, "%s: EXIT [0]: %d registers\n", __func__, total);
+	return 0;
+bad:
+	kfree(profile);
+	dev_err(dev, "%s: EXIT [-EINVAL]: malformed profile at offset %zu!\n",
+		__func__, pos);
+	return -EINVAL;
+}
+
+static void clk_hb_dac2hd_fw_loaded(const struct firmware *fw, void *context)
+{
+	int ret = -ENOENT;
+	struct clk_hb_dac2hd_drvdata *drvdata = context;
+	struct device *dev = drvdata->dev;
+
+	dd_trace(dev, "%s: ENTER\n", __func__);
+
+	if (fw) {
+		ret = clk_hb_dac2hd_fw_parse(drvdata, fw->data, fw->size);
+		release_firmware(fw);
+	}
+	if (ret) {
+		dev_info(dev, "%s: no usable pll profile, using DT\n",
+			 __func__);
+		ret = clk_hb_dac2hd_dt_parse(drvdata);
+	}
+
+	drvdata->profile_ret = ret;
+	complete_all(&drvdata->profile_done);
+
+	dd_trace(dev, "%s: EXIT [void]: %d\n", __func__, ret);
+}
+
+static void clk_hb_dac2hd_flush_profile(void *data)
+{
+	struct clk_hb_dac2hd_drvdata *drvdata = data;
+
+	/* the firmware callback must not run after drvdata is gone */
+	wait_for_completion(&drvdata->profile_done);
+}
+#endif /* CLK_DAC2HD_FW_PROFILE */
 #endif /* CLK_DAC2HD_STATIC_DEFAULTS */
+static void clk_hb_dac2hd_debug_init(struct clk_hw *hw, struct dentry *dentry)
+{
+	struct clk_hb_dac2hd_drvdata *drvdata = to_clk_hb_dac2hd(hw);
+
+	dd_regmap_i2c_debugfs(drvdata->regmap, dentry);
+	dd_rate_switches_debugfs(dentry, drvdata->stats.rate_switches);
+	dd_hist_debugfs("set_rate_us", dentry, &drvdata->stats.set_rate);
+	debugfs_create_u32("pll_resets", 0444, dentry,
+			   &drvdata->stats.pll_resets);
+	debugfs_create_u32("fast_switches", 0444, dentry,
+			   &drvdata->stats.fast_switches);
+	debugfs_create_u32("lock_timeouts", 0444, dentry,
+			   &drvdata->stats.lock_timeouts);
+	debugfs_create_u32("last_lock_us", 0444, dentry,
+			   &drvdata->stats.last_lock_us);
+	debugfs_create_u32("max_lock_us", 0444, dentry,
+			   &drvdata->stats.max_lock_us);
+#ifdef CLK_DAC2HD_RUNTIME_PM
+	debugfs_create_u32("resumes", 0444, dentry,
+			   &drvdata->stats.resumes);
+	debugfs_create_u32("state_restores", 0444, dentry,
+			   &drvdata->stats.state_restores);
+	debugfs_create_u32("last_resume_us", 0444, dentry,
+			   &drvdata->stats.last_resume_us);
+	debugfs_create_u32("max_resume_us", 0444, dentry,
+			   &drvdata->stats.max_resume_us);
+	dd_hist_debugfs("runtime_resume_us", dentry,
+			&drvdata->stats.runtime_resume);
+#endif /* CLK_DAC2HD_RUNTIME_PM */
+}
+
 const struct clk_ops clk_hb_dac2hd_clk_ops = {
-	.recalc_rate = clk_hb_dac2hd_recalc_rate,
-	.round_rate  = clk_hb_dac2hd_round_rate,
-	.set_rate    = clk_hb_dac2hd_set_rate,
+	.recalc_rate    = clk_hb_dac2hd_recalc_rate,
+	.determine_rate = clk_hb_dac2hd_determine_rate,
+	.set_rate       = clk_hb_dac2hd_set_rate,
+	.debug_init     = clk_hb_dac2hd_debug_init,
 #ifdef CLK_DAC2HD_PREPARE_INIT
-	.prepare     = clk_hb_dac2hd_prepare,
-	.unprepare   = clk_hb_dac2hd_unprepare,
-	.is_prepared = clk_hb_dac2hd_is_prepared,
+	.prepare        = clk_hb_dac2hd_prepare,
+	.unprepare      = clk_hb_dac2hd_unprepare,
+#ifndef CLK_DAC2HD_RUNTIME_PM
+	/* with runtime PM, prepared only means the PLL has been initialised */
+	.is_prepared    = clk_hb_dac2hd_is_prepared,
+#endif /* CLK_DAC2HD_RUNTIME_PM */
 #endif /* CLK_DAC2HD_PREPARE_INIT */
 };
 
+static bool clk_hb_dac2hd_volatile_reg(struct device *dev, unsigned int reg)
+{
+	switch (reg) {
+	case CLK_DAC2HD_REG_DEVICE_STATUS:
+	case CLK_DAC2HD_REG_INT_STATUS:
+	case CLK_DAC2HD_REG_PLL_RESET:
+		return true;
+	default:
+		return false;
+	}
+}
+
 const struct regmap_config clk_hb_dac2hd_pll_regmap_cfg = {
 	.reg_bits         = 8,
 	.val_bits         = 8,
 	.max_register     = CLK_DAC2HD_PLL_MAX_REGISTER,
 	.reg_defaults     = clk_hb_dac2hd_pll_reg_defaults,
 	.num_reg_defaults = ARRAY_SIZE(clk_hb_dac2hd_pll_reg_defaults),
+	.volatile_reg     = clk_hb_dac2hd_volatile_reg,
 	.cache_type       = REGCACHE_RBTREE,
 };
 EXPORT_SYMBOL_GPL(clk_hb_dac2hd_pll_regmap_cfg);
 
+#ifdef CLK_DAC2HD_RUNTIME_PM
+/*
+ * Rewrite the whole PLL configuration (defaults, common and the dedicated
+ * table of the current rate) after the chip has lost its state.
+ */
+static int clk_hb_dac2hd_pll_restore(struct clk_hb_dac2hd_drvdata *drvdata)
+{
+	int ret;
+	const struct clk_hb_dac2hd_rate *r;
+	struct device *dev = drvdata->dev;
+
+	dd_trace(dev, "%s: ENTER: rate=%lu\n", __func__, drvdata->rate);
+
+	drvdata->cur = NULL;
+	drvdata->stats.state_restores++;
+	ret = clk_hb_dac2hd_write_pll_regs(drvdata,
+				clk_hb_dac2hd_pll_reg_defaults,
+				ARRAY_SIZE(clk_hb_dac2hd_pll_reg_defaults),
+				CLK_DAC2HD_NO_PLL_RESET);
+	if (!ret)
+		ret = clk_hb_dac2hd_write_pll_regs(drvdata,
+					drvdata->profile->common.regs,
+					drvdata->profile->common.num_regs,
+					CLK_DAC2HD_NO_PLL_RESET);
+	if (ret) {
+		dev_err(dev, "%s: EXIT [%d]: write_pll_regs failed!\n",
+			__func__, ret);
+		return ret;
+	}
+
+	r = clk_hb_dac2hd_find_rate(drvdata->profile, drvdata->rate);
+	if (!r) {
+		dev_err(dev, "%s: EXIT [-EINVAL]: invalid rate=%lu!\n",
+			__func__, drvdata->rate);
+		return -EINVAL;
+	}
+	ret = clk_hb_dac2hd_write_dedicated_regs(drvdata, r);
+
+	dd_trace(dev, "%s: EXIT [%d]\n", __func__, ret);
+	return ret;
+}
+
+/*
+ * True if the chip no longer holds what the cache says, e.g. after it lost
+ * power during system sleep. The crystal load register is always written
+ * with a non-reset value, so read it back bypassing the cache.
+ */
+static bool clk_hb_dac2hd_lost_state(struct clk_hb_dac2hd_drvdata *drvdata)
+{
+	int ret;
+	unsigned int cached;
+	unsigned int val;
+
+	ret = regmap_read(drvdata->regmap, CLK_DAC2HD_REG_XTAL_LOAD, &cached);
+	if (ret)
+		return true;
+	regcache_cache_bypass(drvdata->regmap, true);
+	ret = regmap_read(drvdata->regmap, CLK_DAC2HD_REG_XTAL_LOAD, &val);
+	regcache_cache_bypass(drvdata->regmap, false);
+
+	return ret || val != cached;
+}
+
+/*
+ * Power down the PLL outputs. The VCO keeps running, so resume only has to
+ * power the outputs back up and does not wait for a relock.
+ */
+static int clk_hb_dac2hd_runtime_suspend(struct device *dev)
+{
+	int i;
+	int ret;
+	unsigned int val;
+	u8 pdn[CLK_DAC2HD_NUM_CLK_CTRL];
+	struct clk_hb_dac2hd_drvdata *drvdata = dev_get_drvdata(dev);
+	struct regmap *regmap = drvdata->regmap;
+
+	dd_trace(dev, "%s: ENTER\n", __func__);
+
+	ret = regmap_read(regmap, CLK_DAC2HD_REG_OUTPUT_EN,
+			  &drvdata->pm_output_en);
+	for (i = 0; !ret && i < CLK_DAC2HD_NUM_CLK_CTRL; i++) {
+		ret = regmap_read(regmap, CLK_DAC2HD_REG_CLK0_CTRL + i, &val);
+		drvdata->pm_clk_ctrl[i] = val;
+		pdn[i] = val | CLK_DAC2HD_CLK_PDN;
+	}
+	if (ret) {
+		dev_err(dev, "%s: EXIT [%d]: failed to read regmap cache!\n",
+			__func__, ret);
+		return ret;
+	}
+
+	ret = regmap_write(regmap, CLK_DAC2HD_REG_OUTPUT_EN,
+			   CLK_DAC2HD_OUTPUTS_OFF);
+	if (!ret)
+		ret = regmap_bulk_write(regmap, CLK_DAC2HD_REG_CLK0_CTRL, pdn,
+					CLK_DAC2HD_NUM_CLK_CTRL);
+	if (ret) {
+		dev_err(dev, "%s: EXIT [%d]: failed to power down outputs!\n",
+			__func__, ret);
+		return ret;
+	}
+	regcache_cache_only(regmap, true);
+
+	dd_trace(dev, "%s: EXIT [0]\n", __func__);
+	return 0;
+}
+
+/*
+ * Put the saved output values back into the cache while still cache-only,
+ * then flush just those two register ranges (CLKx_CTRL first, so outputs
+ * are enabled last) instead of replaying the PLL tables. Only if the chip
+ * lost its state is the full configuration rewritten.
+ */
+static int clk_hb_dac2hd_runtime_resume(struct device *dev)
+{
+	int ret;
+	unsigned int status;
+	unsigned int resume_us;
+	ktime_t start;
+	struct clk_hb_dac2hd_drvdata *drvdata = dev_get_drvdata(dev);
+	struct regmap *regmap = drvdata->regmap;
+
+	dd_trace(dev, "%s: ENTER\n", __func__);
+
+	start = ktime_get();
+	ret = regmap_write(regmap, CLK_DAC2HD_REG_OUTPUT_EN,
+			   drvdata->pm_output_en);
+	if (!ret)
+		ret = regmap_bulk_write(regmap, CLK_DAC2HD_REG_CLK0_CTRL,
+					drvdata->pm_clk_ctrl,
+					CLK_DAC2HD_NUM_CLK_CTRL);
+	regcache_cache_only(regmap, false);
+	if (ret) {
+		dev_err(dev, "%s: EXIT [%d]: failed to update regmap cache!\n",
+			__func__, ret);
+		return ret;
+	}
+
+	if (clk_hb_dac2hd_lost_state(drvdata)) {
+		dev_warn(dev, "%s: pll lost its configuration, restoring\n",
+			 __func__);
+#ifdef CLK_DAC2HD_PREPARE_INIT
+		if (!drvdata->prepared)
+			goto out;
+#endif /* CLK_DAC2HD_PREPARE_INIT */
+		ret = clk_hb_dac2hd_pll_restore(drvdata);
+		if (ret) {
+#ifdef CLK_DAC2HD_PREPARE_INIT
+			/* let the next prepare start from scratch */
+			drvdata->prepared = false;
+#endif /* CLK_DAC2HD_PREPARE_INIT */
+			dev_err(dev, "%s: EXIT [%d]: pll_restore failed!\n",
+				__func__, ret);
+			return ret;
+		}
+		goto out;
+	}
+
+	ret = regcache_sync_region(regmap, CLK_DAC2HD_REG_CLK0_CTRL,
+				   CLK_DAC2HD_REG_CLK7_CTRL);
+	if (!ret)
+		ret = regcache_sync_region(regmap, CLK_DAC2HD_REG_OUTPUT_EN,
+					   CLK_DAC2HD_REG_OUTPUT_EN);
+	if (ret) {
+		dev_err(dev, "%s: EXIT [%d]: failed to sync regmap cache!\n",
+			__func__, ret);
+		return ret;
+	}
+
+	ret = regmap_read_poll_timeout(regmap, CLK_DAC2HD_REG_DEVICE_STATUS,
+				       status,
+				       !(status & CLK_DAC2HD_STATUS_NOT_LOCKED),
+				       CLK_DAC2HD_PLL_LOCK_POLL_US,
+				       CLK_DAC2HD_PLL_LOCK_TIMEOUT_US);
+	if (ret == -ETIMEDOUT) {
+		drvdata->stats.lock_timeouts++;
+		dev_warn(dev, "%s: pll not locked after resume "
+			 "(status=0x%02x)\n", __func__, status);
+	} else if (ret) {
+		dev_err(dev, "%s: EXIT [%d]: failed to read device status!\n",
+			__func__, ret);
+		return ret;
+	}
+out:
+	resume_us = (unsigned int)ktime_us_delta(ktime_get(), start);
+	drvdata->stats.resumes++;
+	drvdata->stats.last_resume_us = resume_us;
+	if (resume_us > drvdata->stats.max_resume_us)
+		drvdata->stats.max_resume_us = resume_us;
+	dd_hist_add(&drvdata->stats.runtime_resume, start);
+
+	dd_trace(dev, "%s: EXIT [0]: resume_us=%u\n", __func__, resume_us);
+	return 0;
+}
+
+static void clk_hb_dac2hd_pm_disable(void *data)
+{
+	struct device *dev = data;
+
+	pm_runtime_disable(dev);
+	pm_runtime_dont_use_autosuspend(dev);
+	pm_runtime_set_suspended(dev);
+}
+#endif /* CLK_DAC2HD_RUNTIME_PM */
+
 static int clk_hb_dac2hd_i2c_probe(struct i2c_client *i2c,
 				   const struct i2c_device_id *id)
 {
@@ -519,8 +1525,14 @@ static int clk_hb_dac2hd_i2c_probe(struct i2c_client *i2c,
 	struct device *dev = &i2c->dev;
 	struct device_node *dev_node = dev->of_node;
 	struct regmap_config config = clk_hb_dac2hd_pll_regmap_cfg;
+#ifdef CLK_DAC2HD_RUNTIME_PM
+	u32 autosuspend_ms;
+#endif /* CLK_DAC2HD_RUNTIME_PM */
+#ifdef CLK_DAC2HD_FW_PROFILE
+	const char *fw_name = CLK_DAC2HD_FW_NAME;
+#endif /* CLK_DAC2HD_FW_PROFILE */
 
-	dev_dbg(dev, "%s: ENTER\n", __func__);
+	dd_trace(dev, "%s: ENTER\n", __func__);
 
 	drvdata = devm_kzalloc(&i2c->dev, sizeof(struct clk_hb_dac2hd_drvdata),
 			       GFP_KERNEL);
@@ -531,8 +1543,9 @@ static int clk_hb_dac2hd_i2c_probe(struct i2c_client *i2c,
 	}
 
 	i2c_set_clientdata(i2c, drvdata);
+	drvdata->dev = dev;
 
-	drvdata->regmap = devm_regmap_init_i2c(i2c, &config);
+	drvdata->regmap = dd_regmap_init_i2c(i2c, &config);
 
 	if (IS_ERR(drvdata->regmap)) {
 		ret = PTR_ERR(drvdata->regmap);
@@ -541,39 +1554,121 @@ static int clk_hb_dac2hd_i2c_probe(struct i2c_client *i2c,
 		return ret;
 	}
 
-#ifndef CLK_DAC2HD_STATIC_DEFAULTS
-	/* populate reg_defaults configs from DT */
-	clk_hb_dac2hd_dt_parse(dev);
+#ifdef CLK_DAC2HD_STATIC_DEFAULTS
+	drvdata->profile = &clk_hb_dac2hd_static_profile;
+#else
+	ret = devm_add_action_or_reset(dev, clk_hb_dac2hd_profile_put,
+				       drvdata);
+	if (ret) {
+		dev_err(dev, "%s: EXIT [%d]: devm_add_action failed!\n",
+			__func__, ret);
+		return ret;
+	}
 #endif /* CLK_DAC2HD_STATIC_DEFAULTS */
 
+#if defined(CLK_DAC2HD_FW_PROFILE)
+	/* load the pll profile in the background, DT is the fallback */
+	init_completion(&drvdata->profile_done);
+	of_property_read_string(dev_node, "firmware-name", &fw_name);
+	ret = devm_add_action_or_reset(dev, clk_hb_dac2hd_flush_profile,
+				       drvdata);
+	if (ret) {
+		dev_err(dev, "%s: EXIT [%d]: devm_add_action failed!\n",
+			__func__, ret);
+		return ret;
+	}
+	ret = request_firmware_nowait(THIS_MODULE,
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,14,0)
+				      FW_ACTION_UEVENT,
+#else
+				      FW_ACTION_HOTPLUG,
+#endif
+				      fw_name, dev, GFP_KERNEL, drvdata,
+				      clk_hb_dac2hd_fw_loaded);
+	if (ret) {
+		dev_err(dev, "%s: EXIT [%d]: request_firmware_nowait(%s) "
+			"failed!\n", __func__, ret, fw_name);
+		complete_all(&drvdata->profile_done);
+		return ret;
+	}
+#elif !defined(CLK_DAC2HD_STATIC_DEFAULTS)
+	/* populate reg_defaults configs from DT */
+	ret = clk_hb_dac2hd_dt_parse(drvdata);
+	if (ret) {
+		dev_err(dev, "%s: EXIT [%d]: dt_parse failed!\n", __func__,
+			ret);
+		return ret;
+	}
+#endif /* CLK_DAC2HD_FW_PROFILE */
+
+#ifdef CLK_DAC2HD_RUNTIME_PM
+	/*
+	 * The CCF resumes us for prepare/set_rate. Hold a reference until
+	 * probe (and the async bring-up) is done with the registers.
+	 */
+	autosuspend_ms = CLK_DAC2HD_AUTOSUSPEND_MS;
+	of_property_read_u32(dev_node, "dac2hd,autosuspend-delay-ms",
+			     &autosuspend_ms);
+	pm_runtime_set_autosuspend_delay(dev, autosuspend_ms);
+	pm_runtime_use_autosuspend(dev);
+	pm_runtime_get_noresume(dev);
+	pm_runtime_set_active(dev);
+	pm_runtime_enable(dev);
+	ret = devm_add_action_or_reset(dev, clk_hb_dac2hd_pm_disable, dev);
+	if (ret) {
+		pm_runtime_put_noidle(dev);
+		dev_err(dev, "%s: EXIT [%d]: devm_add_action failed!\n",
+			__func__, ret);
+		return ret;
+	}
+#endif /* CLK_DAC2HD_RUNTIME_PM */
+
+#ifdef CLK_DAC2HD_ASYNC_INIT
+	/* start the PLL bring-up now, prepare/set_rate wait for it */
+	INIT_WORK(&drvdata->init_work, clk_hb_dac2hd_init_work);
+	init_completion(&drvdata->init_done);
+	ret = devm_add_action_or_reset(dev, clk_hb_dac2hd_cancel_init,
+				       drvdata);
+	if (ret) {
+		dev_err(dev, "%s: EXIT [%d]: devm_add_action failed!\n",
+			__func__, ret);
+		goto out;
+	}
+#ifdef CLK_DAC2HD_RUNTIME_PM
+	/* dropped by the work */
+	pm_runtime_get_noresume(dev);
+#endif /* CLK_DAC2HD_RUNTIME_PM */
+	schedule_work(&drvdata->init_work);
+#endif /* CLK_DAC2HD_ASYNC_INIT */
+
 #ifndef CLK_DAC2HD_PREPARE_INIT
 	/* start PLL to allow detection of DAC */
 #ifdef DDEBUG
 	dev_dbg(dev, "%s: load pll_reg_defaults\n",
 		__func__);
 #endif /* DDEBUG */
-	ret = clk_hb_dac2hd_write_pll_regs(dev, drvdata->regmap,
+	ret = clk_hb_dac2hd_write_pll_regs(drvdata,
 				clk_hb_dac2hd_pll_reg_defaults,
 				ARRAY_SIZE(clk_hb_dac2hd_pll_reg_defaults),
 				CLK_DAC2HD_PLL_RESET);
 	if (ret) {
 		dev_err(dev, "%s: EXIT [%d]: write_pll_regs(pll_reg_defaults) "
 			"failed!\n", __func__, ret);
-		return ret;
+		goto out;
 	}
 
 	/* restart PLL with configs from DTB */
 #ifdef DDEBUG
 	dev_dbg(dev, "%s: load common_pll_regs\n", __func__);
 #endif /* DDEBUG */
-	ret = clk_hb_dac2hd_write_pll_regs(dev, drvdata->regmap,
-					   clk_hb_dac2hd_common_pll_regs,
-					   clk_hb_dac2hd_num_common_pll_regs,
+	ret = clk_hb_dac2hd_write_pll_regs(drvdata,
+					   drvdata->profile->common.regs,
+					   drvdata->profile->common.num_regs,
 					   CLK_DAC2HD_NO_PLL_RESET);
 	if (ret) {
 		dev_err(dev, "%s: EXIT [%d]: write_pll_regs(common_pll_regs) "
 			"failed!\n", __func__, ret);
-		return ret;
+		goto out;
 	}
 #endif /* CLK_DAC2HD_PREPARE_INIT */
 
@@ -584,7 +1679,6 @@ static int clk_hb_dac2hd_i2c_probe(struct i2c_client *i2c,
 	init.num_parents = 0;
 
 	drvdata->hw.init = &init;
-	drvdata->dev = dev;
 
 #ifdef DDEBUG
 	dev_dbg(dev, "%s: register clk\n", __func__);
@@ -594,7 +1688,7 @@ static int clk_hb_dac2hd_i2c_probe(struct i2c_client *i2c,
 		ret = PTR_ERR(drvdata->clk);
 		dev_err(dev, "%s: EXIT [%d]: devm_clk_register failed!\n",
 			__func__, ret);
-		return ret;
+		goto out;
 	}
 
 #ifdef DDEBUG
@@ -605,7 +1699,7 @@ static int clk_hb_dac2hd_i2c_probe(struct i2c_client *i2c,
 	if (ret != 0) {
 		dev_err(dev, "%s: EXIT [%d]: of_clk_add_provider failed!\n",
 			__func__, ret);
-		return ret;
+		goto out;
 	}
 
 #ifndef CLK_DAC2HD_PREPARE_INIT
@@ -618,28 +1712,34 @@ static int clk_hb_dac2hd_i2c_probe(struct i2c_client *i2c,
 		dev_err(dev, "%s: EXIT [-EINVAL]: clk_set_rate(%d) "
 			"returns: [%d]\n", __func__, CLK_DAC2HD_DEFAULT_RATE,
 			ret);
-		return -EINVAL;
+		ret = -EINVAL;
+		goto out;
 	}
 #endif /* CLK_DAC2HD_PREPARE_INIT */
 
-	dev_dbg(dev, "%s: EXIT [%d]\n", __func__, ret);
+out:
+#ifdef CLK_DAC2HD_RUNTIME_PM
+	pm_runtime_mark_last_busy(dev);
+	pm_runtime_put_autosuspend(dev);
+#endif /* CLK_DAC2HD_RUNTIME_PM */
+	dd_trace(dev, "%s: EXIT [%d]\n", __func__, ret);
 
 	return ret;
 }
 
 static int clk_hb_dac2hd_remove(struct device *dev)
 {
-	dev_dbg(dev, "%s: ENTER\n", __func__);
+	dd_trace(dev, "%s: ENTER\n", __func__);
 	of_clk_del_provider(dev->of_node);
-	dev_dbg(dev, "%s: EXIT [0]\n", __func__);
+	dd_trace(dev, "%s: EXIT [0]\n", __func__);
 	return 0;
 }
 
 static int clk_hb_dac2hd_i2c_remove(struct i2c_client *i2c)
 {
-	dev_dbg(&i2c->dev, "%s: ENTER\n", __func__);
+	dd_trace(&i2c->dev, "%s: ENTER\n", __func__);
 	clk_hb_dac2hd_remove(&i2c->dev);
-	dev_dbg(&i2c->dev, "%s: EXIT [0]\n", __func__);
+	dd_trace(&i2c->dev, "%s: EXIT [0]\n", __func__);
 	return 0;
 }
 
@@ -655,6 +1755,15 @@ static const struct of_device_id clk_hb_dac2hd_of_dev_ids[] = {
 };
 MODULE_DEVICE_TABLE(of, clk_hb_dac2hd_of_dev_ids);
 
+#ifdef CLK_DAC2HD_RUNTIME_PM
+static const struct dev_pm_ops clk_hb_dac2hd_pm_ops = {
+	SET_SYSTEM_SLEEP_PM_OPS(pm_runtime_force_suspend,
+				pm_runtime_force_resume)
+	SET_RUNTIME_PM_OPS(clk_hb_dac2hd_runtime_suspend,
+			   clk_hb_dac2hd_runtime_resume, NULL)
+};
+#endif /* CLK_DAC2HD_RUNTIME_PM */
+
 static struct i2c_driver clk_hb_dac2hd_i2c_drv = {
 	.probe    = clk_hb_dac2hd_i2c_probe,
 	.remove   = clk_hb_dac2hd_i2c_remove,
@@ -662,6 +1771,9 @@ static struct i2c_driver clk_hb_dac2hd_i2c_drv = {
 	.driver   = {
 		.name           = "dac2hd-clk",
 		.of_match_table = of_match_ptr(clk_hb_dac2hd_of_dev_ids),
+#ifdef CLK_DAC2HD_RUNTIME_PM
+		.pm             = &clk_hb_dac2hd_pm_ops,
+#endif /* CLK_DAC2HD_RUNTIME_PM */
 	},
 };
 module_i2c_driver(clk_hb_dac2hd_i2c_drv);
@@ -672,3 +1784,6 @@ MODULE_AUTHOR("Joerg Schambacher <joerg@i2audio.com>");
 MODULE_AUTHOR("Clive Messer <clive.messer@digitaldreamtime.co.uk>");
 MODULE_LICENSE("GPL v2");
 MODULE_ALIAS("platform:clk-hifiberry-dac2hd");
+#ifdef CLK_DAC2HD_FW_PROFILE
+MODULE_FIRMWARE(CLK_DAC2HD_FW_NAME);
+#endif /* CLK_DAC2HD_FW_PROFILE */
@@ -25,6 +25,14 @@
 #include <linux/of.h>
 #include <linux/slab.h>
 #include <linux/platform_device.h>
+#include <linux/i2c.h>
+#include <linux/regmap.h>
+#include <linux/delay.h>
+
+#include "zpcm512x.h"
+#include "dd-utils.h"
+#include "dd-debug.h"
+#include "dd-trace.h"
 
 #define DRV_VERSION "4.0.0"
 
@@ -33,28 +41,82 @@
 /* Clock rate of CLK48EN attached to GPIO3 pin */
 #define CLK_48EN_RATE 24576000UL
 
+/* oscillator enables, driven by the codec GPIO3/GPIO6 outputs */
+#define CLK_DACPRO_GPIO_MASK	0x24
+#define CLK_DACPRO_GPIO_44EN	0x20
+#define CLK_DACPRO_GPIO_48EN	0x04
+
 /**
  * struct clk_hb_dacpro_drvdata - Common struct to the HiFiBerry DAC+ Pro
  * @hw: clk_hw for the common clk framework
  * @mode: 0 => CLK44EN, 1 => CLK48EN
+ * @codec_node: PCM512x whose GPIO3/GPIO6 select the oscillator
  */
 struct clk_hb_dacpro_drvdata {
 	struct clk_hw hw;
 	uint8_t mode;
 	struct device *dev;
+	struct device_node *codec_node;
 };
 
 #define to_clk_hb_dacpro(_hw)\
 		 container_of(_hw, struct clk_hb_dacpro_drvdata, hw)
 
+/*
+ * The codec regmap is looked up on every use rather than cached, so an
+ * unbound codec never leaves us with a stale pointer. Returns the codec
+ * with a reference held, NULL on legacy overlays without one.
+ */
+static struct i2c_client *clk_hb_dacpluspro_codec(
+				struct clk_hb_dacpro_drvdata *clk,
+				struct regmap **regmap)
+{
+	struct i2c_client *codec;
+
+	if (!clk->codec_node)
+		return NULL;
+	codec = of_find_i2c_device_by_node(clk->codec_node);
+	if (!codec)
+		return NULL;
+	*regmap = dev_get_regmap(&codec->dev, NULL);
+	if (!*regmap) {
+		put_device(&codec->dev);
+		return NULL;
+	}
+
+	return codec;
+}
+
+/*
+ * Card detection and codec resets drive the select GPIOs behind our back,
+ * so the clock is registered CLK_GET_RATE_NOCACHE and the rate follows
+ * what GPIO_CONTROL_1 (a regmap cache hit) says is selected. Without a
+ * codec, or with neither oscillator selected, the last set mode stands.
+ */
 static unsigned long clk_hb_dacpluspro_recalc_rate(struct clk_hw *hw,
 						   unsigned long parent_rate)
 {
 	struct clk_hb_dacpro_drvdata *clk = to_clk_hb_dacpro(hw);
-	unsigned long rate = (clk->mode == 0) ? CLK_44EN_RATE : CLK_48EN_RATE;
+	struct i2c_client *codec;
+	struct regmap *regmap;
+	unsigned int val;
+	unsigned long rate;
+
+	codec = clk_hb_dacpluspro_codec(clk, &regmap);
+	if (codec) {
+		if (!regmap_read(regmap, PCM512x_GPIO_CONTROL_1, &val)) {
+			val &= CLK_DACPRO_GPIO_MASK;
+			if (val == CLK_DACPRO_GPIO_44EN)
+				clk->mode = 0;
+			else if (val == CLK_DACPRO_GPIO_48EN)
+				clk->mode = 1;
+		}
+		put_device(&codec->dev);
+	}
+	rate = (clk->mode == 0) ? CLK_44EN_RATE : CLK_48EN_RATE;
 
-	dev_dbg(clk->dev, "%s: ENTER: parent_rate=%lu: EXIT [%lu]\n",
-		__func__, parent_rate, rate);
+	dd_trace(clk->dev, "%s: ENTER: parent_rate=%lu: EXIT [%lu]\n",
+		 __func__, parent_rate, rate);
 	return rate;
 }
 
@@ -64,7 +126,7 @@ static long clk_hb_dacpluspro_round_rate(struct clk_hw *hw,
 	long actual_rate;
 	struct clk_hb_dacpro_drvdata *clk = to_clk_hb_dacpro(hw);
 
-	dev_dbg(clk->dev, "%s: ENTER: rate=%lu\n", __func__, rate);
+	dd_trace(clk->dev, "%s: ENTER: rate=%lu\n", __func__, rate);
 
 	if (rate <= CLK_44EN_RATE) {
 		actual_rate = (long)CLK_44EN_RATE;
@@ -80,27 +142,109 @@ static long clk_hb_dacpluspro_round_rate(struct clk_hw *hw,
 			actual_rate = (long)CLK_48EN_RATE;
 	}
 
-	dev_dbg(clk->dev, "%s: EXIT [%ld]\n", __func__, actual_rate);
+	dd_trace(clk->dev, "%s: EXIT [%ld]\n", __func__, actual_rate);
 	return actual_rate;
 }
 
-static int clk_hb_dacpluspro_set_rate(struct clk_hw *hw, unsigned long rate,
-				      unsigned long parent_rate)
+/*
+ * Switch oscillators through the codec's GPIO_CONTROL_1 and let the new one
+ * settle. The selection is read back first (cache hit), so a switch the
+ * hardware already agrees with costs neither the write nor the settle.
+ */
+static int clk_hb_dacpluspro_select(struct clk_hb_dacpro_drvdata *clk,
+				    uint8_t mode)
 {
+	int ret;
+	unsigned int val, sel;
+	struct i2c_client *codec;
+	struct regmap *regmap;
+
+	sel = mode ? CLK_DACPRO_GPIO_48EN : CLK_DACPRO_GPIO_44EN;
+
+	/* legacy overlay: the machine driver drives the select itself */
+	if (!clk->codec_node) {
+		clk->mode = mode;
+		dd_trace(clk->dev, "%s: EXIT [0]: no codec, %s left to the "
+			 "card\n", __func__, mode ? "CLK48EN" : "CLK44EN");
+		return 0;
+	}
+	codec = clk_hb_dacpluspro_codec(clk, &regmap);
+	if (!codec) {
+		dev_err(clk->dev, "%s: EXIT [-ENODEV]: codec not found!\n",
+			__func__);
+		return -ENODEV;
+	}
+
+	ret = regmap_read(regmap, PCM512x_GPIO_CONTROL_1, &val);
+	if (ret)
+		goto out;
+	if ((val & CLK_DACPRO_GPIO_MASK) == sel) {
+		clk->mode = mode;
+		put_device(&codec->dev);
+		dd_trace(clk->dev, "%s: EXIT [0]: noop - %s already "
+			 "selected\n", __func__, mode ? "CLK48EN" : "CLK44EN");
+		return 0;
+	}
+
+	ret = regmap_update_bits(regmap, PCM512x_GPIO_CONTROL_1,
+				 CLK_DACPRO_GPIO_MASK, sel);
+out:
+	put_device(&codec->dev);
+	if (ret) {
+		dev_err(clk->dev, "%s: EXIT [%d]: failed to select %s!\n",
+			__func__, ret, mode ? "CLK48EN" : "CLK44EN");
+		return ret;
+	}
+	clk->mode = mode;
+
+#ifdef DDEBUG
+	dev_dbg(clk->dev, "%s: sleeping... usleep_range(2000, 2100)\n",
+		__func__);
+#endif /* DDEBUG */
+	usleep_range(2000, 2100);
+
+	return 0;
+}
+
+static int __clk_hb_dacpluspro_set_rate(struct clk_hw *hw, unsigned long rate,
+					unsigned long parent_rate)
+{
+	int ret;
+	uint8_t mode;
 	unsigned long actual_rate;
 	struct clk_hb_dacpro_drvdata *clk = to_clk_hb_dacpro(hw);
 
-	dev_dbg(clk->dev, "%s: ENTER: rate=%lu, parent_rate=%lu\n",
-		__func__, rate, parent_rate);
+	dd_trace(clk->dev, "%s: ENTER: rate=%lu, parent_rate=%lu\n",
+		 __func__, rate, parent_rate);
 
 	actual_rate = (unsigned long)clk_hb_dacpluspro_round_rate(hw, rate,
 								&parent_rate);
-	clk->mode = (actual_rate == CLK_44EN_RATE) ? 0 : 1;
+	mode = (actual_rate == CLK_44EN_RATE) ? 0 : 1;
+
+	ret = clk_hb_dacpluspro_select(clk, mode);
+	if (ret)
+		return ret;
 
-	dev_dbg(clk->dev, "%s: EXIT [0]\n", __func__);
+	dd_trace(clk->dev, "%s: EXIT [0]\n", __func__);
 	return 0;
 }
 
+static int clk_hb_dacpluspro_set_rate(struct clk_hw *hw, unsigned long rate,
+				      unsigned long parent_rate)
+{
+	struct clk_hb_dacpro_drvdata *clk = to_clk_hb_dacpro(hw);
+	unsigned long old_rate = (clk->mode == 0) ? CLK_44EN_RATE
+						  : CLK_48EN_RATE;
+	struct dd_span span;
+	int ret;
+
+	/* the select gpios are driven through the codec */
+	dd_span_begin(&span, dd_of_i2c_regmap(clk->codec_node));
+	ret = __clk_hb_dacpluspro_set_rate(hw, rate, parent_rate);
+	trace_dd_clk_set_rate(clk->dev, old_rate, rate, ret, &span);
+	return ret;
+}
+
 const struct clk_ops clk_hb_dacpluspro_rate_ops = {
 	.recalc_rate = clk_hb_dacpluspro_recalc_rate,
 	.round_rate = clk_hb_dacpluspro_round_rate,
@@ -117,7 +261,7 @@ static int clk_hb_dacpluspro_probe(struct platform_device *pdev)
 
 	dev = &pdev->dev;
 
-	dev_dbg(dev, "%s: ENTER\n", __func__);
+	dd_trace(dev, "%s: ENTER\n", __func__);
 
 	proclk = kzalloc(sizeof(struct clk_hb_dacpro_drvdata), GFP_KERNEL);
 	if (!proclk) {
@@ -128,23 +272,32 @@ static int clk_hb_dacpluspro_probe(struct platform_device *pdev)
 
 	init.name = "clk-hifiberry-dacpluspro";
 	init.ops = &clk_hb_dacpluspro_rate_ops;
-	init.flags = 0;
+	init.flags = CLK_GET_RATE_NOCACHE;
 	init.parent_names = NULL;
 	init.num_parents = 0;
 
+	/* card detection leaves CLK48EN selected */
 	proclk->mode = 1;
 	proclk->hw.init = &init;
 	proclk->dev = dev;
+	proclk->codec_node = of_parse_phandle(dev->of_node, "hifiberry,codec",
+					      0);
+	if (!proclk->codec_node)
+		dev_warn(dev, "%s: no hifiberry,codec, the card has to "
+			 "switch oscillators!\n", __func__);
 
 	clk = devm_clk_register(dev, &proclk->hw);
 	if (IS_ERR(clk)) {
 		ret = PTR_ERR(clk);
 		dev_err(dev, "%s: EXIT [%d]: failed to register clock "
 			"driver!\n", __func__, ret);
+		of_node_put(proclk->codec_node);
 		kfree(proclk);
 		return ret;
 	}
 
+	platform_set_drvdata(pdev, proclk);
+
 	ret = of_clk_add_provider(dev->of_node, of_clk_src_simple_get,
 				  clk);
 	if (ret < 0) {
@@ -153,16 +306,19 @@ static int clk_hb_dacpluspro_probe(struct platform_device *pdev)
 		else
 			dev_err(dev, "%s: EXIT [%d]\n", __func__, ret);
 	} else
-		dev_dbg(dev, "%s: EXIT [%d]\n", __func__, ret);
+		dd_trace(dev, "%s: EXIT [%d]\n", __func__, ret);
 
 	return ret;
 }
 
 static int clk_hb_dacpluspro_remove(struct platform_device *pdev)
 {
-	dev_dbg(&pdev->dev, "%s: ENTER\n", __func__);
+	struct clk_hb_dacpro_drvdata *proclk = platform_get_drvdata(pdev);
+
+	dd_trace(&pdev->dev, "%s: ENTER\n", __func__);
 	of_clk_del_provider(pdev->dev.of_node);
-	dev_dbg(&pdev->dev, "%s: EXIT [0]\n", __func__);
+	of_node_put(proclk->codec_node);
+	dd_trace(&pdev->dev, "%s: EXIT [0]\n", __func__);
 	return 0;
 }
 
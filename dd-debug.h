@@ -0,0 +1,46 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * dd-debug.h
+ *
+ * Author: Clive Messer <clive.messer@digitaldreamtime.co.uk>
+ *         Copyright (c) Digital Dreamtime Ltd 2020-2021
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#ifndef __DD_DEBUG_H
+#define __DD_DEBUG_H
+
+#include <linux/device.h>
+
+/*
+ * Function ENTER/EXIT tracing.
+ *
+ * With DD_TRACE (debug profile) this is plain dev_dbg(). Without it
+ * (release profile) the call compiles away; the arguments stay visible
+ * to the compiler only so that format checking and 'used' variables
+ * behave the same in both profiles.
+ *
+ * All other dev_dbg() output is left to the kernel: built without DEBUG
+ * it becomes a dynamic debug callsite, a static key that costs a single
+ * patched branch until enabled at runtime through
+ * <debugfs>/dynamic_debug/control.
+ */
+#ifdef DD_TRACE
+#define dd_trace(dev, fmt, ...) dev_dbg(dev, fmt, ##__VA_ARGS__)
+#else
+#define dd_trace(dev, fmt, ...)					\
+do {								\
+	if (0)							\
+		dev_dbg(dev, fmt, ##__VA_ARGS__);		\
+} while (0)
+#endif /* DD_TRACE */
+
+#endif /* __DD_DEBUG_H */
@@ -0,0 +1,302 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * dd-dummy-i2s.c
+ *
+ * Dummy I2S CPU DAI and timer driven PCM, standing in for the bcm2835-i2s
+ * controller when the cards are instantiated on the emulated I2C bus.
+ * Samples go nowhere; the hardware pointer advances in real time at the
+ * stream rate, so period wakeups and delays look like the real thing.
+ *
+ * Author: Clive Messer <clive.messer@digitaldreamtime.co.uk>
+ *         Copyright (c) Digital Dreamtime Ltd 2020-2021
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#include <linux/module.h>
+#include <linux/hrtimer.h>
+#include <linux/ktime.h>
+#include <linux/of.h>
+#include <linux/platform_device.h>
+#include <linux/slab.h>
+#include <linux/version.h>
+#include <sound/core.h>
+#include <sound/pcm.h>
+#include <sound/pcm_params.h>
+#include <sound/soc.h>
+
+#include "dd-debug.h"
+
+#define DRV_VERSION "1.0.0"
+
+/* component PCM ops with the component argument and managed buffers */
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5,6,0)
+#error "dd-dummy-i2s requires kernel 5.6 or later"
+#endif
+
+#define DD_DUMMY_I2S_FORMATS	(SNDRV_PCM_FMTBIT_S16_LE |\
+				 SNDRV_PCM_FMTBIT_S24_LE |\
+				 SNDRV_PCM_FMTBIT_S32_LE)
+
+/**
+ * struct dd_dummy_i2s_stream - Per substream transport state
+ * @timer: fires once per period while running
+ * @period: period length at the stream rate
+ * @base: time the transport was (re)started
+ * @offset: frame position at @base
+ * @running: transport is running
+ * @substream: the substream being clocked
+ */
+struct dd_dummy_i2s_stream {
+	struct hrtimer timer;
+	ktime_t period;
+	ktime_t base;
+	snd_pcm_uframes_t offset;
+	bool running;
+	struct snd_pcm_substream *substream;
+};
+
+static const struct snd_pcm_hardware dd_dummy_i2s_pcm_hw = {
+	.info = SNDRV_PCM_INFO_INTERLEAVED |
+		SNDRV_PCM_INFO_BLOCK_TRANSFER |
+		SNDRV_PCM_INFO_MMAP |
+		SNDRV_PCM_INFO_MMAP_VALID |
+		SNDRV_PCM_INFO_PAUSE,
+	.formats = DD_DUMMY_I2S_FORMATS,
+	.rates = SNDRV_PCM_RATE_8000_384000,
+	.rate_min = 8000,
+	.rate_max = 384000,
+	.channels_min = 2,
+	.channels_max = 2,
+	/* as bcm2835-i2s through the dmaengine pcm */
+	.buffer_bytes_max = 128 * 1024,
+	.period_bytes_min = 32,
+	.period_bytes_max = 64 * 1024,
+	.periods_min = 2,
+	.periods_max = 255,
+};
+
+/*
+ * DAI
+ */
+static int dd_dummy_i2s_set_fmt(struct snd_soc_dai *dai, unsigned int fmt)
+{
+	dd_trace(dai->dev, "%s: ENTER: fmt=0x%x\n", __func__, fmt);
+
+	return 0;
+}
+
+static int dd_dummy_i2s_set_bclk_ratio(struct snd_soc_dai *dai,
+				       unsigned int ratio)
+{
+	dd_trace(dai->dev, "%s: ENTER: ratio=%u\n", __func__, ratio);
+
+	return 0;
+}
+
+static const struct snd_soc_dai_ops dd_dummy_i2s_dai_ops = {
+	.set_fmt = dd_dummy_i2s_set_fmt,
+	.set_bclk_ratio = dd_dummy_i2s_set_bclk_ratio,
+};
+
+static struct snd_soc_dai_driver dd_dummy_i2s_dai = {
+	.name = "dd-dummy-i2s",
+	.playback = {
+		.channels_min = 2,
+		.channels_max = 2,
+		.rates = SNDRV_PCM_RATE_8000_384000,
+		.formats = DD_DUMMY_I2S_FORMATS,
+	},
+	.ops = &dd_dummy_i2s_dai_ops,
+};
+
+/*
+ * PCM
+ */
+static snd_pcm_uframes_t dd_dummy_i2s_pos(struct dd_dummy_i2s_stream *s,
+					  struct snd_pcm_runtime *runtime)
+{
+	u64 frames = s->offset;
+
+	if (s->running)
+		frames += mul_u64_u32_div(ktime_to_ns(ktime_sub(ktime_get(),
+								s->base)),
+					  runtime->rate, NSEC_PER_SEC);
+
+	return frames % runtime->buffer_size;
+}
+
+static enum hrtimer_restart dd_dummy_i2s_timer(struct hrtimer *timer)
+{
+	struct dd_dummy_i2s_stream *s =
+			container_of(timer, struct dd_dummy_i2s_stream, timer);
+
+	if (!READ_ONCE(s->running))
+		return HRTIMER_NORESTART;
+
+	snd_pcm_period_elapsed(s->substream);
+	/* an xrun in period_elapsed stops the stream from under us */
+	if (!READ_ONCE(s->running))
+		return HRTIMER_NORESTART;
+
+	hrtimer_forward_now(timer, s->period);
+
+	return HRTIMER_RESTART;
+}
+
+static int dd_dummy_i2s_open(struct snd_soc_component *component,
+			     struct snd_pcm_substream *substream)
+{
+	struct dd_dummy_i2s_stream *s;
+
+	dd_trace(component->dev, "%s: ENTER\n", __func__);
+
+	s = kzalloc(sizeof(*s), GFP_KERNEL);
+	if (!s)
+		return -ENOMEM;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,13,0)
+	hrtimer_setup(&s->timer, dd_dummy_i2s_timer, CLOCK_MONOTONIC,
+		      HRTIMER_MODE_REL_SOFT);
+#else
+	hrtimer_init(&s->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL_SOFT);
+	s->timer.function = dd_dummy_i2s_timer;
+#endif
+	s->substream = substream;
+	substream->runtime->private_data = s;
+
+	return snd_soc_set_runtime_hwparams(substream, &dd_dummy_i2s_pcm_hw);
+}
+
+static int dd_dummy_i2s_close(struct snd_soc_component *component,
+			      struct snd_pcm_substream *substream)
+{
+	struct dd_dummy_i2s_stream *s = substream->runtime->private_data;
+
+	dd_trace(component->dev, "%s: ENTER\n", __func__);
+
+	hrtimer_cancel(&s->timer);
+	kfree(s);
+
+	return 0;
+}
+
+static int dd_dummy_i2s_prepare(struct snd_soc_component *component,
+				struct snd_pcm_substream *substream)
+{
+	struct snd_pcm_runtime *runtime = substream->runtime;
+	struct dd_dummy_i2s_stream *s = runtime->private_data;
+
+	dd_trace(component->dev, "%s: ENTER: rate=%u, period_size=%lu\n",
+		 __func__, runtime->rate, runtime->period_size);
+
+	/* a stopped timer callback may still be finishing */
+	hrtimer_cancel(&s->timer);
+	s->period = ns_to_ktime(div_u64((u64)runtime->period_size *
+					NSEC_PER_SEC, runtime->rate));
+	s->offset = 0;
+
+	return 0;
+}
+
+static int dd_dummy_i2s_trigger(struct snd_soc_component *component,
+				struct snd_pcm_substream *substream, int cmd)
+{
+	struct snd_pcm_runtime *runtime = substream->runtime;
+	struct dd_dummy_i2s_stream *s = runtime->private_data;
+
+	switch (cmd) {
+	case SNDRV_PCM_TRIGGER_START:
+	case SNDRV_PCM_TRIGGER_RESUME:
+	case SNDRV_PCM_TRIGGER_PAUSE_RELEASE:
+		s->base = ktime_get();
+		WRITE_ONCE(s->running, true);
+		hrtimer_start(&s->timer, s->period, HRTIMER_MODE_REL_SOFT);
+		return 0;
+	case SNDRV_PCM_TRIGGER_STOP:
+	case SNDRV_PCM_TRIGGER_SUSPEND:
+	case SNDRV_PCM_TRIGGER_PAUSE_PUSH:
+		s->offset = dd_dummy_i2s_pos(s, runtime);
+		WRITE_ONCE(s->running, false);
+		/* atomic context, the callback bails out on !running */
+		hrtimer_try_to_cancel(&s->timer);
+		return 0;
+	default:
+		return -EINVAL;
+	}
+}
+
+static snd_pcm_uframes_t dd_dummy_i2s_pointer(
+	struct snd_soc_component *component,
+	struct snd_pcm_substream *substream)
+{
+	struct snd_pcm_runtime *runtime = substream->runtime;
+
+	return dd_dummy_i2s_pos(runtime->private_data, runtime);
+}
+
+static int dd_dummy_i2s_pcm_new(struct snd_soc_component *component,
+				struct snd_soc_pcm_runtime *rtd)
+{
+	snd_pcm_set_managed_buffer_all(rtd->pcm, SNDRV_DMA_TYPE_VMALLOC, NULL,
+				       0, 0);
+
+	return 0;
+}
+
+static const struct snd_soc_component_driver dd_dummy_i2s_component = {
+	.name = "dd-dummy-i2s",
+	.open = dd_dummy_i2s_open,
+	.close = dd_dummy_i2s_close,
+	.prepare = dd_dummy_i2s_prepare,
+	.trigger = dd_dummy_i2s_trigger,
+	.pointer = dd_dummy_i2s_pointer,
+	.pcm_construct = dd_dummy_i2s_pcm_new,
+};
+
+static int dd_dummy_i2s_probe(struct platform_device *pdev)
+{
+	struct device *dev = &pdev->dev;
+	int ret;
+
+	dd_trace(dev, "%s: ENTER\n", __func__);
+
+	ret = devm_snd_soc_register_component(dev, &dd_dummy_i2s_component,
+					      &dd_dummy_i2s_dai, 1);
+	if (ret) {
+		dev_err(dev, "%s: EXIT [%d]: failed to register component!\n",
+			__func__, ret);
+		return ret;
+	}
+
+	dd_trace(dev, "%s: EXIT [0]\n", __func__);
+
+	return 0;
+}
+
+static const struct of_device_id dd_dummy_i2s_of_dev_ids[] = {
+	{ .compatible = "dd,dummy-i2s", },
+	{ },
+};
+MODULE_DEVICE_TABLE(of, dd_dummy_i2s_of_dev_ids);
+
+static struct platform_driver dd_dummy_i2s_driver = {
+	.driver = {
+		.name = "dd-dummy-i2s",
+		.of_match_table = dd_dummy_i2s_of_dev_ids,
+	},
+	.probe = dd_dummy_i2s_probe,
+};
+module_platform_driver(dd_dummy_i2s_driver);
+
+MODULE_VERSION(DRV_VERSION);
+MODULE_DESCRIPTION("Digital Dreamtime Dummy I2S CPU DAI");
+MODULE_AUTHOR("Clive Messer <clive.messer@digitaldreamtime.co.uk>");
+MODULE_LICENSE("GPL");
@@ -0,0 +1,833 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * dd-i2c-emu.c
+ *
+ * Emulated I2C bus carrying register models of the PCM512x and PCM1796
+ * codecs and the DAC2HD Si5351 PLL, so the hb-dacplus and hb-dac2hd cards
+ * can be instantiated and measured on a machine without the HAT.
+ *
+ * Author: Clive Messer <clive.messer@digitaldreamtime.co.uk>
+ *         Copyright (c) Digital Dreamtime Ltd 2020-2021
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#include <linux/module.h>
+#include <linux/delay.h>
+#include <linux/firmware.h>
+#include <linux/i2c.h>
+#include <linux/ktime.h>
+#include <linux/mm.h>
+#include <linux/of.h>
+#include <linux/of_platform.h>
+#include <linux/platform_device.h>
+#include <linux/version.h>
+
+#include "dd-debug.h"
+#include "pcm1796.h"
+#include "zpcm512x.h"
+
+#define DRV_VERSION "1.0.0"
+
+/*
+ * MODULE PARAMETERS
+ *
+ * Read on every transaction, so they can be changed at runtime through
+ * /sys/module/snd_soc_dd_i2c_emu/parameters/ between benchmark runs.
+ */
+static unsigned int xfer_delay_us;
+module_param(xfer_delay_us, uint, 0644);
+MODULE_PARM_DESC(xfer_delay_us, "Fixed latency added to every I2C "
+		 "transaction, in us (default 0)");
+
+static unsigned int bus_khz = 100;
+module_param(bus_khz, uint, 0644);
+MODULE_PARM_DESC(bus_khz, "Emulated SCL rate for the wire time of each "
+		 "message, 9 clocks per byte (default 100, 0 disables)");
+
+static bool dacpro = true;
+module_param(dacpro, bool, 0644);
+MODULE_PARM_DESC(dacpro, "PCM512x has the DAC+ Pro oscillators on "
+		 "GPIO3/GPIO6 (default true)");
+
+static unsigned int pll_lock_us = 1500;
+module_param(pll_lock_us, uint, 0644);
+MODULE_PARM_DESC(pll_lock_us, "Time for a PLL to report lock after it is "
+		 "enabled or reset, in us (default 1500)");
+
+static unsigned int mute_ramp_us = 1000;
+module_param(mute_ramp_us, uint, 0644);
+MODULE_PARM_DESC(mute_ramp_us, "Time for PCM512x ANALOG_MUTE_DET to follow "
+		 "a MUTE/POWER write, in us (default 1000)");
+
+static bool clk_fault;
+module_param(clk_fault, bool, 0644);
+MODULE_PARM_DESC(clk_fault, "Report clock errors and never unmute, to "
+		 "exercise the timeout paths (default false)");
+
+#ifdef CONFIG_OF_OVERLAY
+static char *overlay;
+module_param(overlay, charp, 0444);
+MODULE_PARM_DESC(overlay, "Overlay (firmware file) to apply on load, for "
+		 "machines without a bootloader overlay, eg. "
+		 "hb-dac2hd-emu.dtbo");
+
+static int dd_i2c_emu_ovcs_id;
+#endif /* CONFIG_OF_OVERLAY */
+
+struct dd_i2c_emu_target;
+
+/**
+ * struct dd_i2c_emu_model - A register model of one chip type
+ * @compatible: DT compatibles of the nodes this model serves
+ * @size: size of the model private data
+ * @inc_flag: register address bit requesting auto-increment, 0 if the
+ *            chip always auto-increments
+ * @reg_mask: register address bits after @inc_flag is removed
+ * @init: set up power-on state
+ * @read: read a register, or return a negative error code to NACK
+ * @write: write a register, or return a negative error code to NACK
+ */
+struct dd_i2c_emu_model {
+	const char * const *compatible;
+	size_t size;
+	u8 inc_flag;
+	u8 reg_mask;
+	void (*init)(struct dd_i2c_emu_target *target);
+	int (*read)(struct dd_i2c_emu_target *target, u8 reg);
+	int (*write)(struct dd_i2c_emu_target *target, u8 reg, u8 val);
+};
+
+/**
+ * struct dd_i2c_emu_target - An emulated chip on the bus
+ * @model: register model
+ * @addr: 7-bit I2C address
+ * @ptr: register pointer, set by the first byte of a write message
+ * @inc: auto-increment @ptr after each data byte
+ * @priv: model private data
+ */
+struct dd_i2c_emu_target {
+	const struct dd_i2c_emu_model *model;
+	u16 addr;
+	u8 ptr;
+	bool inc;
+	void *priv;
+};
+
+struct dd_i2c_emu_drvdata {
+	struct device *dev;
+	struct i2c_adapter adap;
+	struct dd_i2c_emu_target *targets;
+	int num_targets;
+};
+
+static ktime_t dd_i2c_emu_after(unsigned int us)
+{
+	return ktime_add_us(ktime_get(), us);
+}
+
+static bool dd_i2c_emu_passed(ktime_t at)
+{
+	return ktime_compare(ktime_get(), at) >= 0;
+}
+
+/*
+ * PCM512x
+ *
+ * 256 pages of 128 registers, selected through register 0 of every page.
+ * Bit 7 of the register address requests auto-increment. Status registers
+ * are computed from the control registers on every read.
+ */
+#define DD_I2C_EMU_PCM512X_PAGES	256
+#define DD_I2C_EMU_PCM512X_PAGE_LEN	128
+
+/* page 0 register number of a PCM512x_* define */
+#define DD_I2C_EMU_P0(reg)	((reg) - PCM512x_PAGE_BASE(0))
+
+#define DD_I2C_EMU_PCM512X_CDST6	0x40	/* RATE_DET_4: SCK missing */
+#define DD_I2C_EMU_PCM512X_CDST4	0x10	/* RATE_DET_4: BCK missing */
+#define DD_I2C_EMU_PCM512X_CLK_ERR	0x01	/* CLOCK_STATUS: error */
+#define DD_I2C_EMU_PCM512X_OSC_MASK	0x24	/* GPIO3 and GPIO6 */
+
+struct dd_i2c_emu_pcm512x {
+	u8 regs[DD_I2C_EMU_PCM512X_PAGES][DD_I2C_EMU_PCM512X_PAGE_LEN];
+	u8 page;
+	/* ANALOG_MUTE_DET reads @det_from until @det_at, then @det_to */
+	u8 det_from;
+	u8 det_to;
+	ktime_t det_at;
+	ktime_t lock_at;
+};
+
+static const char * const dd_i2c_emu_pcm512x_compatible[] = {
+	"ti,zpcm5121", "ti,zpcm5122", "ti,zpcm5141", "ti,zpcm5142", NULL,
+};
+
+/* bit 0 right channel, bit 1 left channel playing, as the driver polls */
+static u8 dd_i2c_emu_pcm512x_mute_det(struct dd_i2c_emu_pcm512x *chip)
+{
+	u8 power = chip->regs[0][DD_I2C_EMU_P0(PCM512x_POWER)];
+	u8 mute = chip->regs[0][DD_I2C_EMU_P0(PCM512x_MUTE)];
+	u8 det = 0;
+
+	if (clk_fault || (power & (PCM512x_RQPD | PCM512x_RQST)))
+		return 0;
+	if (!(mute & PCM512x_RQMR))
+		det |= 0x01;
+	if (!(mute & PCM512x_RQML))
+		det |= 0x02;
+
+	return det;
+}
+
+static u8 dd_i2c_emu_pcm512x_det_now(struct dd_i2c_emu_pcm512x *chip)
+{
+	return dd_i2c_emu_passed(chip->det_at) ? chip->det_to : chip->det_from;
+}
+
+/* start the output ramp towards whatever MUTE/POWER now ask for */
+static void dd_i2c_emu_pcm512x_ramp(struct dd_i2c_emu_pcm512x *chip)
+{
+	u8 det = dd_i2c_emu_pcm512x_mute_det(chip);
+
+	if (det == chip->det_to)
+		return;
+	chip->det_from = dd_i2c_emu_pcm512x_det_now(chip);
+	chip->det_to = det;
+	chip->det_at = dd_i2c_emu_after(mute_ramp_us);
+}
+
+/* an oscillator is fitted, driven and selected by GPIO3 or GPIO6 */
+static bool dd_i2c_emu_pcm512x_sck(struct dd_i2c_emu_pcm512x *chip)
+{
+	u8 en = chip->regs[0][DD_I2C_EMU_P0(PCM512x_GPIO_EN)];
+	u8 out = chip->regs[0][DD_I2C_EMU_P0(PCM512x_GPIO_CONTROL_1)];
+
+	return dacpro && (en & out & DD_I2C_EMU_PCM512X_OSC_MASK);
+}
+
+/* datasheet reset values (zpcm512x_reg_defaults), everything else is 0 */
+static const struct reg_default dd_i2c_emu_pcm512x_defaults[] = {
+	{ PCM512x_DAC_ROUTING,       0x11 },
+	{ PCM512x_DSP_PROGRAM,       0x01 },
+	{ PCM512x_DIGITAL_VOLUME_2,  0x30 },
+	{ PCM512x_DIGITAL_VOLUME_3,  0x30 },
+	{ PCM512x_DIGITAL_MUTE_1,    0x22 },
+	{ PCM512x_DIGITAL_MUTE_3,    0x07 },
+	{ PCM512x_VCOM_CTRL_2,       0x01 },
+	{ PCM512x_MASTER_MODE,       0x7c },
+	{ PCM512x_SYNCHRONIZE,       0x10 },
+	{ PCM512x_IDAC_1,            0x01 },
+};
+
+static void dd_i2c_emu_pcm512x_reset(struct dd_i2c_emu_pcm512x *chip)
+{
+	unsigned int reg;
+	int i;
+
+	memset(chip->regs, 0, sizeof(chip->regs));
+	for (i = 0; i < ARRAY_SIZE(dd_i2c_emu_pcm512x_defaults); i++) {
+		reg = dd_i2c_emu_pcm512x_defaults[i].reg - PCM512x_PAGE_BASE(0);
+		chip->regs[reg / PCM512x_PAGE_LEN][reg % PCM512x_PAGE_LEN] =
+					dd_i2c_emu_pcm512x_defaults[i].def;
+	}
+}
+
+static void dd_i2c_emu_pcm512x_init(struct dd_i2c_emu_target *target)
+{
+	struct dd_i2c_emu_pcm512x *chip = target->priv;
+
+	dd_i2c_emu_pcm512x_reset(chip);
+	chip->page = 0;
+	chip->det_from = chip->det_to = dd_i2c_emu_pcm512x_mute_det(chip);
+	chip->det_at = ktime_get();
+	chip->lock_at = ktime_get();
+}
+
+static int dd_i2c_emu_pcm512x_read(struct dd_i2c_emu_target *target, u8 reg)
+{
+	struct dd_i2c_emu_pcm512x *chip = target->priv;
+	u8 val;
+
+	if (reg == PCM512x_PAGE)
+		return chip->page;
+	if (chip->page)
+		return chip->regs[chip->page][reg];
+
+	switch (reg) {
+	case DD_I2C_EMU_P0(PCM512x_PLL_EN):
+		val = chip->regs[0][reg] & ~PCM512x_PLCK;
+		/* PLCK reads 1 while the PLL is still acquiring lock */
+		if ((val & PCM512x_PLLE) && !dd_i2c_emu_passed(chip->lock_at))
+			val |= PCM512x_PLCK;
+		return val;
+	case DD_I2C_EMU_P0(PCM512x_RATE_DET_4):
+		val = 0;
+		if (!dd_i2c_emu_pcm512x_sck(chip))
+			val |= DD_I2C_EMU_PCM512X_CDST6;
+		if (clk_fault)
+			val |= DD_I2C_EMU_PCM512X_CDST4;
+		return val;
+	case DD_I2C_EMU_P0(PCM512x_CLOCK_STATUS):
+		return clk_fault ? DD_I2C_EMU_PCM512X_CLK_ERR : 0;
+	case DD_I2C_EMU_P0(PCM512x_ANALOG_MUTE_DET):
+		return dd_i2c_emu_pcm512x_det_now(chip);
+	default:
+		return chip->regs[0][reg];
+	}
+}
+
+static int dd_i2c_emu_pcm512x_write(struct dd_i2c_emu_target *target, u8 reg,
+				    u8 val)
+{
+	struct dd_i2c_emu_pcm512x *chip = target->priv;
+	u8 old;
+
+	if (reg == PCM512x_PAGE) {
+		chip->page = val;
+		return 0;
+	}
+	if (chip->page) {
+		chip->regs[chip->page][reg] = val;
+		return 0;
+	}
+
+	switch (reg) {
+	case DD_I2C_EMU_P0(PCM512x_RESET):
+		/* self clearing */
+		if (val & PCM512x_RSTR) {
+			dd_i2c_emu_pcm512x_reset(chip);
+			dd_i2c_emu_pcm512x_ramp(chip);
+		}
+		if (val & PCM512x_RSTM) {
+			chip->det_from = chip->det_to =
+					dd_i2c_emu_pcm512x_mute_det(chip);
+			chip->det_at = ktime_get();
+		}
+		return 0;
+	case DD_I2C_EMU_P0(PCM512x_POWER):
+	case DD_I2C_EMU_P0(PCM512x_MUTE):
+		chip->regs[0][reg] = val;
+		dd_i2c_emu_pcm512x_ramp(chip);
+		return 0;
+	case DD_I2C_EMU_P0(PCM512x_PLL_EN):
+		old = chip->regs[0][reg];
+		chip->regs[0][reg] = val & ~PCM512x_PLCK;
+		if ((val & PCM512x_PLLE) && !(old & PCM512x_PLLE))
+			chip->lock_at = dd_i2c_emu_after(pll_lock_us);
+		return 0;
+	case DD_I2C_EMU_P0(PCM512x_RATE_DET_1):
+	case DD_I2C_EMU_P0(PCM512x_RATE_DET_2):
+	case DD_I2C_EMU_P0(PCM512x_RATE_DET_3):
+	case DD_I2C_EMU_P0(PCM512x_RATE_DET_4):
+	case DD_I2C_EMU_P0(PCM512x_CLOCK_STATUS):
+	case DD_I2C_EMU_P0(PCM512x_ANALOG_MUTE_DET):
+	case DD_I2C_EMU_P0(PCM512x_GPIN):
+	case DD_I2C_EMU_P0(PCM512x_DIGITAL_MUTE_DET):
+		/* read only */
+		return 0;
+	default:
+		chip->regs[0][reg] = val;
+		return 0;
+	}
+}
+
+static const struct dd_i2c_emu_model dd_i2c_emu_pcm512x = {
+	.compatible = dd_i2c_emu_pcm512x_compatible,
+	.size = sizeof(struct dd_i2c_emu_pcm512x),
+	.inc_flag = 0x80,
+	.reg_mask = 0x7f,
+	.init = dd_i2c_emu_pcm512x_init,
+	.read = dd_i2c_emu_pcm512x_read,
+	.write = dd_i2c_emu_pcm512x_write,
+};
+
+/*
+ * PCM1796
+ *
+ * Registers 16-23, anything else is NACKed. Bit 7 of the register address
+ * (INC) requests auto-increment.
+ */
+struct dd_i2c_emu_pcm1796 {
+	u8 regs[PCM1796_REG23 - PCM1796_REG16 + 1];
+};
+
+static const char * const dd_i2c_emu_pcm1796_compatible[] = {
+	"ti,pcm1796", NULL,
+};
+
+static const u8 dd_i2c_emu_pcm1796_defaults[] = {
+	0xFF, 0xFF, 0x50, 0x00, 0x00, 0x01, 0x00, 0x00,
+};
+
+static void dd_i2c_emu_pcm1796_init(struct dd_i2c_emu_target *target)
+{
+	struct dd_i2c_emu_pcm1796 *chip = target->priv;
+
+	memcpy(chip->regs, dd_i2c_emu_pcm1796_defaults, sizeof(chip->regs));
+}
+
+static int dd_i2c_emu_pcm1796_read(struct dd_i2c_emu_target *target, u8 reg)
+{
+	struct dd_i2c_emu_pcm1796 *chip = target->priv;
+
+	if (reg < PCM1796_REG16 || reg > PCM1796_REG23)
+		return -ENXIO;
+
+	return chip->regs[reg - PCM1796_REG16];
+}
+
+static int dd_i2c_emu_pcm1796_write(struct dd_i2c_emu_target *target, u8 reg,
+				    u8 val)
+{
+	struct dd_i2c_emu_pcm1796 *chip = target->priv;
+
+	if (reg < PCM1796_REG16 || reg > PCM1796_REG23)
+		return -ENXIO;
+	/* REG22 (zero flags) and REG23 (device ID) are read only */
+	if (reg < PCM1796_REG22)
+		chip->regs[reg - PCM1796_REG16] = val;
+
+	return 0;
+}
+
+static const struct dd_i2c_emu_model dd_i2c_emu_pcm1796 = {
+	.compatible = dd_i2c_emu_pcm1796_compatible,
+	.size = sizeof(struct dd_i2c_emu_pcm1796),
+	.inc_flag = 0x80,
+	.reg_mask = 0x7f,
+	.init = dd_i2c_emu_pcm1796_init,
+	.read = dd_i2c_emu_pcm1796_read,
+	.write = dd_i2c_emu_pcm1796_write,
+};
+
+/*
+ * DAC2HD PLL (Si5351A)
+ *
+ * 256 flat registers, always auto-incrementing. DEVICE_STATUS reports
+ * SYS_INIT until power-up has finished and LOL_A until PLL A has relocked
+ * after a soft reset.
+ */
+#define DD_I2C_EMU_SI5351_DEVICE_STATUS	0x00
+#define DD_I2C_EMU_SI5351_SYS_INIT	0x80
+#define DD_I2C_EMU_SI5351_LOL_A		0x20
+#define DD_I2C_EMU_SI5351_LOS_XTAL	0x08
+#define DD_I2C_EMU_SI5351_OUTPUT_EN	0x03
+#define DD_I2C_EMU_SI5351_PLL_RESET	0xB1
+#define DD_I2C_EMU_SI5351_PLLA_RST	0x20
+#define DD_I2C_EMU_SI5351_XTAL_LOAD	0xB7
+
+struct dd_i2c_emu_si5351 {
+	u8 regs[256];
+	ktime_t init_at;
+	ktime_t lock_at;
+};
+
+static const char * const dd_i2c_emu_si5351_compatible[] = {
+	"hifiberry,dac2hd-clk", NULL,
+};
+
+static void dd_i2c_emu_si5351_init(struct dd_i2c_emu_target *target)
+{
+	struct dd_i2c_emu_si5351 *chip = target->priv;
+	int i;
+
+	memset(chip->regs, 0, sizeof(chip->regs));
+	chip->regs[DD_I2C_EMU_SI5351_OUTPUT_EN] = 0xFF;
+	for (i = 0x10; i <= 0x17; i++)
+		chip->regs[i] = 0x80;
+	/* reset value differs from what the driver writes (lost_state) */
+	chip->regs[DD_I2C_EMU_SI5351_XTAL_LOAD] = 0xD2;
+	chip->init_at = dd_i2c_emu_after(pll_lock_us);
+	chip->lock_at = chip->init_at;
+}
+
+static int dd_i2c_emu_si5351_read(struct dd_i2c_emu_target *target, u8 reg)
+{
+	struct dd_i2c_emu_si5351 *chip = target->priv;
+	u8 val;
+
+	if (reg != DD_I2C_EMU_SI5351_DEVICE_STATUS)
+		return chip->regs[reg];
+
+	val = 0;
+	if (!dd_i2c_emu_passed(chip->init_at))
+		val |= DD_I2C_EMU_SI5351_SYS_INIT;
+	if (clk_fault || !dd_i2c_emu_passed(chip->lock_at))
+		val |= DD_I2C_EMU_SI5351_LOL_A;
+	if (clk_fault)
+		val |= DD_I2C_EMU_SI5351_LOS_XTAL;
+
+	return val;
+}
+
+static int dd_i2c_emu_si5351_write(struct dd_i2c_emu_target *target, u8 reg,
+				   u8 val)
+{
+	struct dd_i2c_emu_si5351 *chip = target->priv;
+
+	switch (reg) {
+	case DD_I2C_EMU_SI5351_DEVICE_STATUS:
+		/* read only */
+		return 0;
+	case DD_I2C_EMU_SI5351_PLL_RESET:
+		/* PLLA_RST/PLLB_RST are self clearing */
+		if (val & DD_I2C_EMU_SI5351_PLLA_RST)
+			chip->lock_at = dd_i2c_emu_after(pll_lock_us);
+		chip->regs[reg] = val & 0x5f;
+		return 0;
+	default:
+		chip->regs[reg] = val;
+		return 0;
+	}
+}
+
+static const struct dd_i2c_emu_model dd_i2c_emu_si5351 = {
+	.compatible = dd_i2c_emu_si5351_compatible,
+	.size = sizeof(struct dd_i2c_emu_si5351),
+	.inc_flag = 0,
+	.reg_mask = 0xff,
+	.init = dd_i2c_emu_si5351_init,
+	.read = dd_i2c_emu_si5351_read,
+	.write = dd_i2c_emu_si5351_write,
+};
+
+static const struct dd_i2c_emu_model *dd_i2c_emu_models[] = {
+	&dd_i2c_emu_pcm512x,
+	&dd_i2c_emu_pcm1796,
+	&dd_i2c_emu_si5351,
+};
+
+/*
+ * BUS
+ */
+static struct dd_i2c_emu_target *dd_i2c_emu_find(
+	struct dd_i2c_emu_drvdata *drvdata, u16 addr)
+{
+	int i;
+
+	for (i = 0; i < drvdata->num_targets; i++)
+		if (drvdata->targets[i].addr == addr)
+			return &drvdata->targets[i];
+
+	return NULL;
+}
+
+/* first byte sets the register pointer, the rest are data */
+static int dd_i2c_emu_msg_write(struct dd_i2c_emu_target *target,
+				struct i2c_msg *msg)
+{
+	const struct dd_i2c_emu_model *model = target->model;
+	int i, ret;
+
+	if (!msg->len)
+		return 0;
+
+	target->ptr = msg->buf[0] & model->reg_mask;
+	target->inc = !model->inc_flag || (msg->buf[0] & model->inc_flag);
+	for (i = 1; i < msg->len; i++) {
+		ret = model->write(target, target->ptr, msg->buf[i]);
+		if (ret < 0)
+			return ret;
+		if (target->inc)
+			target->ptr = (target->ptr + 1) & model->reg_mask;
+	}
+
+	return 0;
+}
+
+static int dd_i2c_emu_msg_read(struct dd_i2c_emu_target *target,
+			       struct i2c_msg *msg)
+{
+	const struct dd_i2c_emu_model *model = target->model;
+	int i, ret;
+
+	for (i = 0; i < msg->len; i++) {
+		ret = model->read(target, target->ptr);
+		if (ret < 0)
+			return ret;
+		msg->buf[i] = ret;
+		if (target->inc)
+			target->ptr = (target->ptr + 1) & model->reg_mask;
+	}
+
+	return 0;
+}
+
+/*
+ * Charge the transaction what a real bus would: the fixed latency plus
+ * 9 SCL clocks (8 bits + ACK) for each address and data byte.
+ */
+static void dd_i2c_emu_delay(struct i2c_msg *msgs, int num)
+{
+	unsigned int khz = READ_ONCE(bus_khz);
+	unsigned long bytes = 0;
+	unsigned long us;
+	int i;
+
+	for (i = 0; i < num; i++)
+		bytes += msgs[i].len + 1;
+
+	us = READ_ONCE(xfer_delay_us);
+	if (khz)
+		us += DIV_ROUND_UP(bytes * 9 * 1000, khz);
+	if (!us)
+		return;
+
+	if (us < 10)
+		udelay(us);
+	else
+		usleep_range(us, us + us / 8);
+}
+
+static int dd_i2c_emu_xfer(struct i2c_adapter *adap, struct i2c_msg *msgs,
+			   int num)
+{
+	struct dd_i2c_emu_drvdata *drvdata = i2c_get_adapdata(adap);
+	struct dd_i2c_emu_target *target;
+	int i, ret;
+
+	dd_i2c_emu_delay(msgs, num);
+
+	for (i = 0; i < num; i++) {
+		target = dd_i2c_emu_find(drvdata, msgs[i].addr);
+		if (!target)
+			return -ENXIO;
+		if (msgs[i].flags & I2C_M_RD)
+			ret = dd_i2c_emu_msg_read(target, &msgs[i]);
+		else
+			ret = dd_i2c_emu_msg_write(target, &msgs[i]);
+		if (ret < 0)
+			return ret;
+	}
+
+	return num;
+}
+
+static u32 dd_i2c_emu_func(struct i2c_adapter *adap)
+{
+	return I2C_FUNC_I2C | I2C_FUNC_SMBUS_EMUL;
+}
+
+static const struct i2c_algorithm dd_i2c_emu_algo = {
+	.master_xfer = dd_i2c_emu_xfer,
+	.functionality = dd_i2c_emu_func,
+};
+
+/*
+ * PLATFORM DRIVER
+ */
+static const struct dd_i2c_emu_model *dd_i2c_emu_match(struct device_node *np)
+{
+	const char * const *compatible;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(dd_i2c_emu_models); i++)
+		for (compatible = dd_i2c_emu_models[i]->compatible;
+		     *compatible; compatible++)
+			if (of_device_is_compatible(np, *compatible))
+				return dd_i2c_emu_models[i];
+
+	return NULL;
+}
+
+static void dd_i2c_emu_kvfree(void *data)
+{
+	kvfree(data);
+}
+
+/* one emulated chip per child node, before the adapter creates clients */
+static int dd_i2c_emu_add_targets(struct dd_i2c_emu_drvdata *drvdata)
+{
+	struct device *dev = drvdata->dev;
+	struct dd_i2c_emu_target *target;
+	struct device_node *child;
+	u32 addr;
+	int ret;
+
+	drvdata->targets = devm_kcalloc(dev,
+				of_get_available_child_count(dev->of_node),
+				sizeof(*drvdata->targets), GFP_KERNEL);
+	if (!drvdata->targets)
+		return -ENOMEM;
+
+	for_each_available_child_of_node(dev->of_node, child) {
+		target = &drvdata->targets[drvdata->num_targets];
+		target->model = dd_i2c_emu_match(child);
+		if (!target->model) {
+			dev_warn(dev, "%s: no model for %pOF, skipping\n",
+				 __func__, child);
+			continue;
+		}
+		if (of_property_read_u32(child, "reg", &addr)) {
+			dev_err(dev, "%s: %pOF has no reg property!\n",
+				__func__, child);
+			of_node_put(child);
+			return -EINVAL;
+		}
+		target->addr = addr;
+
+		target->priv = kvzalloc(target->model->size, GFP_KERNEL);
+		if (!target->priv) {
+			of_node_put(child);
+			return -ENOMEM;
+		}
+		ret = devm_add_action_or_reset(dev, dd_i2c_emu_kvfree,
+					       target->priv);
+		if (ret) {
+			of_node_put(child);
+			return ret;
+		}
+		target->model->init(target);
+		drvdata->num_targets++;
+
+		dev_info(dev, "%s: emulating %pOFn at 0x%02x\n", __func__,
+			 child, target->addr);
+	}
+
+	return 0;
+}
+
+static int dd_i2c_emu_probe(struct platform_device *pdev)
+{
+	struct device *dev = &pdev->dev;
+	struct dd_i2c_emu_drvdata *drvdata;
+	int ret;
+
+	dd_trace(dev, "%s: ENTER\n", __func__);
+
+	drvdata = devm_kzalloc(dev, sizeof(*drvdata), GFP_KERNEL);
+	if (!drvdata) {
+		dev_err(dev, "%s: EXIT [-ENOMEM]: failed to allocate "
+			"drvdata!\n", __func__);
+		return -ENOMEM;
+	}
+	drvdata->dev = dev;
+
+	ret = dd_i2c_emu_add_targets(drvdata);
+	if (ret) {
+		dev_err(dev, "%s: EXIT [%d]: failed to add targets!\n",
+			__func__, ret);
+		return ret;
+	}
+
+	drvdata->adap.owner = THIS_MODULE;
+	drvdata->adap.algo = &dd_i2c_emu_algo;
+	drvdata->adap.dev.parent = dev;
+	/* i2c core instantiates a client for every child node */
+	drvdata->adap.dev.of_node = dev->of_node;
+	strscpy(drvdata->adap.name, "dd-i2c-emu", sizeof(drvdata->adap.name));
+	i2c_set_adapdata(&drvdata->adap, drvdata);
+
+	ret = devm_i2c_add_adapter(dev, &drvdata->adap);
+	if (ret) {
+		dev_err(dev, "%s: EXIT [%d]: failed to add adapter!\n",
+			__func__, ret);
+		return ret;
+	}
+	platform_set_drvdata(pdev, drvdata);
+
+	dd_trace(dev, "%s: EXIT [0]\n", __func__);
+
+	return 0;
+}
+
+static const struct of_device_id dd_i2c_emu_of_dev_ids[] = {
+	{ .compatible = "dd,i2c-emu", },
+	{ },
+};
+MODULE_DEVICE_TABLE(of, dd_i2c_emu_of_dev_ids);
+
+static struct platform_driver dd_i2c_emu_driver = {
+	.driver = {
+		.name = "dd-i2c-emu",
+		.of_match_table = dd_i2c_emu_of_dev_ids,
+	},
+	.probe = dd_i2c_emu_probe,
+};
+
+#ifdef CONFIG_OF_OVERLAY
+/*
+ * Apply the overlay named by the overlay parameter and create platform
+ * devices for its new top level nodes. On a Pi the overlay notifier has
+ * already done this and the populate is a no-op; on a machine booted
+ * without a device tree nothing else would.
+ */
+static int dd_i2c_emu_apply_overlay(void)
+{
+	const struct firmware *fw;
+	int ret;
+
+	ret = request_firmware(&fw, overlay, NULL);
+	if (ret) {
+		pr_err("%s: failed to load overlay %s: [%d]\n", __func__,
+		       overlay, ret);
+		return ret;
+	}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,6,0)
+	ret = of_overlay_fdt_apply(fw->data, fw->size, &dd_i2c_emu_ovcs_id,
+				   NULL);
+#else
+	ret = of_overlay_fdt_apply(fw->data, fw->size, &dd_i2c_emu_ovcs_id);
+#endif
+	release_firmware(fw);
+	if (ret) {
+		pr_err("%s: failed to apply overlay %s: [%d]\n", __func__,
+		       overlay, ret);
+		return ret;
+	}
+
+	ret = of_platform_default_populate(NULL, NULL, NULL);
+	if (ret) {
+		pr_err("%s: failed to populate overlay %s: [%d]\n", __func__,
+		       overlay, ret);
+		of_overlay_remove(&dd_i2c_emu_ovcs_id);
+	}
+
+	return ret;
+}
+#endif /* CONFIG_OF_OVERLAY */
+
+static int __init dd_i2c_emu_init(void)
+{
+	int ret;
+
+	ret = platform_driver_register(&dd_i2c_emu_driver);
+	if (ret)
+		return ret;
+
+#ifdef CONFIG_OF_OVERLAY
+	if (overlay && *overlay) {
+		ret = dd_i2c_emu_apply_overlay();
+		if (ret)
+			platform_driver_unregister(&dd_i2c_emu_driver);
+	}
+#endif /* CONFIG_OF_OVERLAY */
+
+	return ret;
+}
+module_init(dd_i2c_emu_init);
+
+static void __exit dd_i2c_emu_exit(void)
+{
+#ifdef CONFIG_OF_OVERLAY
+	if (dd_i2c_emu_ovcs_id)
+		of_overlay_remove(&dd_i2c_emu_ovcs_id);
+#endif /* CONFIG_OF_OVERLAY */
+	platform_driver_unregister(&dd_i2c_emu_driver);
+}
+module_exit(dd_i2c_emu_exit);
+
+MODULE_VERSION(DRV_VERSION);
+MODULE_DESCRIPTION("Digital Dreamtime Emulated I2C PCM512x/PCM1796/DAC2HD "
+		   "PLL");
+MODULE_AUTHOR("Clive Messer <clive.messer@digitaldreamtime.co.uk>");
+MODULE_LICENSE("GPL");
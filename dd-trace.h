@@ -0,0 +1,260 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * dd-trace.h
+ *
+ * Author: Clive Messer <clive.messer@digitaldreamtime.co.uk>
+ *         Copyright (c) Digital Dreamtime Ltd 2020-2021
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#ifndef __DD_TRACE_SPAN_H
+#define __DD_TRACE_SPAN_H
+
+#include <linux/ktime.h>
+#include <linux/version.h>
+
+struct regmap;
+
+/* 6.10 dropped the source argument, __string() already names it */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,10,0)
+#define dd_assign_dev(dev)	__assign_str(dev)
+#else
+#define dd_assign_dev(dev)	__assign_str(dev, dev_name(dev))
+#endif /* LINUX_VERSION_CODE >= KERNEL_VERSION(6,10,0) */
+
+/*
+ * Start of a traced operation: when it began and how many I2C transfers
+ * had been issued through the dd_regmap_init_i2c() regmaps it touches.
+ * The event records the elapsed time and the transfer delta. Nested work
+ * on another regmap (codec -> clock) is only included once added with
+ * dd_span_add().
+ */
+#define DD_SPAN_MAPS	2
+
+struct dd_span {
+	ktime_t start;
+	unsigned int xfers;
+	struct regmap *map[DD_SPAN_MAPS];
+};
+
+unsigned int dd_regmap_xfers(struct regmap *regmap);
+
+static inline unsigned int dd_span_xfers(const struct dd_span *span)
+{
+	unsigned int xfers = 0;
+	int i;
+
+	for (i = 0; i < DD_SPAN_MAPS; i++)
+		if (span->map[i])
+			xfers += dd_regmap_xfers(span->map[i]);
+
+	return xfers;
+}
+
+static inline void dd_span_begin(struct dd_span *span, struct regmap *map)
+{
+	span->start = ktime_get();
+	span->map[0] = map;
+	span->map[1] = NULL;
+	span->xfers = dd_span_xfers(span);
+}
+
+static inline void dd_span_add(struct dd_span *span, struct regmap *map)
+{
+	if (!map || map == span->map[0])
+		return;
+	span->map[1] = map;
+	span->xfers += dd_regmap_xfers(map);
+}
+#endif /* __DD_TRACE_SPAN_H */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM dd_hifiberry
+
+#if !defined(__DD_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define __DD_TRACE_H
+
+#include <linux/device.h>
+#include <linux/tracepoint.h>
+
+DECLARE_EVENT_CLASS(dd_op,
+
+	TP_PROTO(struct device *dev, unsigned long a, unsigned long b, int ret,
+		 const struct dd_span *span),
+
+	TP_ARGS(dev, a, b, ret, span),
+
+	TP_STRUCT__entry(
+		__string(	dev,	dev_name(dev)		)
+		__field(	unsigned long,	a		)
+		__field(	unsigned long,	b		)
+		__field(	int,		ret		)
+		__field(	s64,		dur_ns		)
+		__field(	unsigned int,	xfers		)
+	),
+
+	TP_fast_assign(
+		dd_assign_dev(dev);
+		__entry->a = a;
+		__entry->b = b;
+		__entry->ret = ret;
+		__entry->dur_ns = ktime_to_ns(ktime_sub(ktime_get(),
+							span->start));
+		__entry->xfers = dd_span_xfers(span) - span->xfers;
+	),
+
+	TP_printk("%s a=%lu b=%lu ret=%d dur_ns=%lld xfers=%u",
+		  __get_str(dev), __entry->a, __entry->b, __entry->ret,
+		  __entry->dur_ns, __entry->xfers)
+);
+
+/* a = substream->stream */
+DEFINE_EVENT_PRINT(dd_op, dd_startup,
+	TP_PROTO(struct device *dev, unsigned long a, unsigned long b, int ret,
+		 const struct dd_span *span),
+	TP_ARGS(dev, a, b, ret, span),
+	TP_printk("%s stream=%lu ret=%d dur_ns=%lld xfers=%u",
+		  __get_str(dev), __entry->a, __entry->ret, __entry->dur_ns,
+		  __entry->xfers)
+);
+
+/* a = rate, b = sample width */
+DEFINE_EVENT_PRINT(dd_op, dd_hw_params,
+	TP_PROTO(struct device *dev, unsigned long a, unsigned long b, int ret,
+		 const struct dd_span *span),
+	TP_ARGS(dev, a, b, ret, span),
+	TP_printk("%s rate=%lu width=%lu ret=%d dur_ns=%lld xfers=%u",
+		  __get_str(dev), __entry->a, __entry->b, __entry->ret,
+		  __entry->dur_ns, __entry->xfers)
+);
+
+/* a = rate, b = sclk rate */
+DEFINE_EVENT_PRINT(dd_op, dd_set_dividers,
+	TP_PROTO(struct device *dev, unsigned long a, unsigned long b, int ret,
+		 const struct dd_span *span),
+	TP_ARGS(dev, a, b, ret, span),
+	TP_printk("%s rate=%lu sclk=%lu ret=%d dur_ns=%lld xfers=%u",
+		  __get_str(dev), __entry->a, __entry->b, __entry->ret,
+		  __entry->dur_ns, __entry->xfers)
+);
+
+/* a = old rate, b = new rate */
+DEFINE_EVENT_PRINT(dd_op, dd_clk_set_rate,
+	TP_PROTO(struct device *dev, unsigned long a, unsigned long b, int ret,
+		 const struct dd_span *span),
+	TP_ARGS(dev, a, b, ret, span),
+	TP_printk("%s old=%lu new=%lu ret=%d dur_ns=%lld xfers=%u",
+		  __get_str(dev), __entry->a, __entry->b, __entry->ret,
+		  __entry->dur_ns, __entry->xfers)
+);
+
+/* a = mute, b = substream->stream */
+DEFINE_EVENT_PRINT(dd_op, dd_mute_stream,
+	TP_PROTO(struct device *dev, unsigned long a, unsigned long b, int ret,
+		 const struct dd_span *span),
+	TP_ARGS(dev, a, b, ret, span),
+	TP_printk("%s mute=%lu stream=%lu ret=%d dur_ns=%lld xfers=%u",
+		  __get_str(dev), __entry->a, __entry->b, __entry->ret,
+		  __entry->dur_ns, __entry->xfers)
+);
+
+/* a = ANALOG_MUTE_DET read back, b = value waited for */
+DEFINE_EVENT_PRINT(dd_op, dd_mute_poll,
+	TP_PROTO(struct device *dev, unsigned long a, unsigned long b, int ret,
+		 const struct dd_span *span),
+	TP_ARGS(dev, a, b, ret, span),
+	TP_printk("%s det=0x%lx expect=0x%lx ret=%d dur_ns=%lld xfers=%u",
+		  __get_str(dev), __entry->a, __entry->b, __entry->ret,
+		  __entry->dur_ns, __entry->xfers)
+);
+
+/* a = old bias level, b = new bias level */
+DEFINE_EVENT_PRINT(dd_op, dd_bias_level,
+	TP_PROTO(struct device *dev, unsigned long a, unsigned long b, int ret,
+		 const struct dd_span *span),
+	TP_ARGS(dev, a, b, ret, span),
+	TP_printk("%s from=%lu to=%lu ret=%d dur_ns=%lld xfers=%u",
+		  __get_str(dev), __entry->a, __entry->b, __entry->ret,
+		  __entry->dur_ns, __entry->xfers)
+);
+
+/* marks the start of a mute_stream, paired with dd_mute_stream */
+TRACE_EVENT(dd_mute_stream_begin,
+
+	TP_PROTO(struct device *dev, int mute, int stream),
+
+	TP_ARGS(dev, mute, stream),
+
+	TP_STRUCT__entry(
+		__string(	dev,	dev_name(dev)		)
+		__field(	int,		mute		)
+		__field(	int,		stream		)
+	),
+
+	TP_fast_assign(
+		dd_assign_dev(dev);
+		__entry->mute = mute;
+		__entry->stream = stream;
+	),
+
+	TP_printk("%s mute=%d stream=%d", __get_str(dev), __entry->mute,
+		  __entry->stream)
+);
+
+TRACE_EVENT(dd_pll_coeff,
+
+	TP_PROTO(struct device *dev, unsigned long pllin_rate,
+		 unsigned long pll_rate, int p, int j, int d, int r, int ret,
+		 const struct dd_span *span),
+
+	TP_ARGS(dev, pllin_rate, pll_rate, p, j, d, r, ret, span),
+
+	TP_STRUCT__entry(
+		__string(	dev,	dev_name(dev)		)
+		__field(	unsigned long,	pllin_rate	)
+		__field(	unsigned long,	pll_rate	)
+		__field(	int,		p		)
+		__field(	int,		j		)
+		__field(	int,		d		)
+		__field(	int,		r		)
+		__field(	int,		ret		)
+		__field(	s64,		dur_ns		)
+		__field(	unsigned int,	xfers		)
+	),
+
+	TP_fast_assign(
+		dd_assign_dev(dev);
+		__entry->pllin_rate = pllin_rate;
+		__entry->pll_rate = pll_rate;
+		__entry->p = p;
+		__entry->j = j;
+		__entry->d = d;
+		__entry->r = r;
+		__entry->ret = ret;
+		__entry->dur_ns = ktime_to_ns(ktime_sub(ktime_get(),
+							span->start));
+		__entry->xfers = dd_span_xfers(span) - span->xfers;
+	),
+
+	TP_printk("%s pllin=%lu pll=%lu P=%d J=%d D=%d R=%d ret=%d "
+		  "dur_ns=%lld xfers=%u", __get_str(dev), __entry->pllin_rate,
+		  __entry->pll_rate, __entry->p, __entry->j, __entry->d,
+		  __entry->r, __entry->ret, __entry->dur_ns, __entry->xfers)
+);
+
+#endif /* __DD_TRACE_H */
+
+/* this part must be outside protection */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE dd-trace
+#include <trace/define_trace.h>
@@ -15,11 +15,24 @@
  * General Public License for more details.
  */
 
+#include <linux/module.h>
+#include <linux/debugfs.h>
+#include <linux/i2c.h>
+#include <linux/list.h>
+#include <linux/of.h>
+#include <linux/rculist.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/tracepoint.h>
+#include <linux/version.h>
+
 #include "dd-utils.h"
 
-//#include <linux/module.h>
+#define CREATE_TRACE_POINTS
+#include "dd-trace.h"
 
-//#define DRV_VERSION "1.0.0"
+#define DRV_VERSION "1.0.0"
 
 #ifdef DDEBUG
 char* dd_utils_log_daifmt_format(unsigned int format)
@@ -43,7 +56,7 @@ char* dd_utils_log_daifmt_format(unsigned int format)
 		return "UNKNOWN";
 	}
 }
-//EXPORT_SYMBOL_GPL(dd_utils_log_daifmt_format);
+EXPORT_SYMBOL_GPL(dd_utils_log_daifmt_format);
 
 char* dd_utils_log_daifmt_clock(unsigned int format)
 {
@@ -56,7 +69,7 @@ char* dd_utils_log_daifmt_clock(unsigned int format)
 		return "UNKNOWN";
 	}
 }
-//EXPORT_SYMBOL_GPL(dd_utils_log_daifmt_clock);
+EXPORT_SYMBOL_GPL(dd_utils_log_daifmt_clock);
 
 char* dd_utils_log_daifmt_inverse(unsigned int format)
 {
@@ -73,7 +86,7 @@ char* dd_utils_log_daifmt_inverse(unsigned int format)
 		return "UNKNOWN";
 	}
 }
-//EXPORT_SYMBOL_GPL(dd_utils_log_daifmt_inverse);
+EXPORT_SYMBOL_GPL(dd_utils_log_daifmt_inverse);
 
 char* dd_utils_log_daifmt_master(unsigned int format)
 {
@@ -90,10 +103,529 @@ char* dd_utils_log_daifmt_master(unsigned int format)
 		return "UNKNOWN";
 	}
 }
-//EXPORT_SYMBOL_GPL(dd_utils_log_daifmt_master);
+EXPORT_SYMBOL_GPL(dd_utils_log_daifmt_master);
+#endif /* DDEBUG */
+
+#ifdef DD_VOLUME_COALESCE
+static void dd_vol_work(struct work_struct *work)
+{
+	int ret;
+	u8 val[2];
+	struct dd_vol *vol = container_of(to_delayed_work(work),
+					  struct dd_vol, work);
+	struct snd_soc_component *component;
+	struct snd_kcontrol *kcontrol;
+	bool lost;
+
+	/* take the newest pair; anything older has already been dropped */
+	mutex_lock(&vol->lock);
+	val[0] = vol->val[0];
+	val[1] = vol->val[1];
+	component = vol->component;
+	kcontrol = vol->kcontrol;
+	mutex_unlock(&vol->lock);
+
+	if (!component)
+		return;
+
+	ret = regmap_bulk_write(vol->regmap, vol->reg_left, val, 2);
+	if (ret < 0) {
+		dev_err(component->dev, "%s: regmap_bulk_write(%u, "
+			"[0x%02x, 0x%02x]) failed: [%d]\n", __func__,
+			vol->reg_left, val[0], val[1], ret);
+		/*
+		 * The pair never reached the chip: unless a newer put is
+		 * already on its way, forget it (and the regcache copy) so
+		 * get reads back what the hardware really has.
+		 */
+		mutex_lock(&vol->lock);
+		lost = vol->val[0] == val[0] && vol->val[1] == val[1];
+		if (lost) {
+			vol->cached = false;
+			regcache_drop_region(vol->regmap, vol->reg_left,
+					     vol->reg_left + 1);
+		}
+		mutex_unlock(&vol->lock);
+
+		if (lost)
+			snd_ctl_notify(component->card->snd_card,
+				       SNDRV_CTL_EVENT_MASK_VALUE,
+				       &kcontrol->id);
+		return;
+	}
+#ifdef DDEBUG
+	dev_dbg(component->dev, "%s: committed [0x%02x, 0x%02x]\n", __func__,
+		val[0], val[1]);
 #endif /* DDEBUG */
+}
+
+void dd_vol_init(struct dd_vol *vol, struct regmap *regmap,
+		 unsigned int reg_left)
+{
+	mutex_init(&vol->lock);
+	vol->regmap = regmap;
+	vol->reg_left = reg_left;
+	vol->cached = false;
+	vol->component = NULL;
+	vol->kcontrol = NULL;
+	INIT_DELAYED_WORK(&vol->work, dd_vol_work);
+}
+EXPORT_SYMBOL_GPL(dd_vol_init);
+
+/* called with vol->lock held */
+static int dd_vol_load(struct dd_vol *vol)
+{
+	int i, ret;
+	unsigned int val;
+
+	if (vol->cached)
+		return 0;
+
+	for (i = 0; i < 2; i++) {
+		ret = regmap_read(vol->regmap, vol->reg_left + i, &val);
+		if (ret < 0)
+			return ret;
+		vol->val[i] = val;
+	}
+	vol->cached = true;
+
+	return 0;
+}
+
+int dd_vol_get(struct dd_vol *vol, struct snd_kcontrol *kcontrol,
+	       struct snd_ctl_elem_value *ucontrol)
+{
+	int i, ret, val;
+	struct soc_mixer_control *mc =
+			(struct soc_mixer_control *)kcontrol->private_value;
+
+	mutex_lock(&vol->lock);
+	ret = dd_vol_load(vol);
+	if (ret < 0) {
+		mutex_unlock(&vol->lock);
+		return ret;
+	}
+	/* same mapping as snd_soc_get_volsw_range() */
+	for (i = 0; i < 2; i++) {
+		val = vol->val[i];
+		if (mc->invert)
+			val = mc->max - val;
+		ucontrol->value.integer.value[i] = val - mc->min;
+	}
+	mutex_unlock(&vol->lock);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(dd_vol_get);
+
+int dd_vol_put(struct dd_vol *vol, struct snd_kcontrol *kcontrol,
+	       struct snd_ctl_elem_value *ucontrol)
+{
+	int i, ret, changed = 0;
+	long val;
+	u8 reg[2];
+	struct soc_mixer_control *mc =
+			(struct soc_mixer_control *)kcontrol->private_value;
+
+	/* same mapping as snd_soc_put_volsw_range() */
+	for (i = 0; i < 2; i++) {
+		val = ucontrol->value.integer.value[i];
+		if (val < 0 || val > mc->max - mc->min)
+			return -EINVAL;
+		val += mc->min;
+		if (mc->invert)
+			val = mc->max - val;
+		reg[i] = val;
+	}
+
+	mutex_lock(&vol->lock);
+	ret = dd_vol_load(vol);
+	if (ret < 0) {
+		mutex_unlock(&vol->lock);
+		return ret;
+	}
+	if (vol->val[0] != reg[0] || vol->val[1] != reg[1]) {
+		vol->val[0] = reg[0];
+		vol->val[1] = reg[1];
+		vol->component = snd_soc_kcontrol_component(kcontrol);
+		vol->kcontrol = kcontrol;
+		changed = 1;
+	}
+	mutex_unlock(&vol->lock);
+
+	/* no-op if a flush is already pending: it will pick up this pair */
+	if (changed)
+		schedule_delayed_work(&vol->work,
+				      msecs_to_jiffies(DD_VOL_FLUSH_DELAY_MS));
+
+	return changed;
+}
+EXPORT_SYMBOL_GPL(dd_vol_put);
+
+void dd_vol_flush(struct dd_vol *vol)
+{
+	flush_delayed_work(&vol->work);
+}
+EXPORT_SYMBOL_GPL(dd_vol_flush);
+
+void dd_vol_cancel(struct dd_vol *vol)
+{
+	cancel_delayed_work_sync(&vol->work);
+}
+EXPORT_SYMBOL_GPL(dd_vol_cancel);
+#endif /* DD_VOLUME_COALESCE */
+
+/*
+ * Plain I2C regmap bus (as regmap-i2c) that counts every transfer of each
+ * regmap, so traced operations can report how much bus traffic they
+ * caused. Adapters without plain I2C get an SMBus byte data bus instead,
+ * counted the same way.
+ *
+ * Reads and writes are counted by the bus, serialised by the regmap lock.
+ * The contexts sit on an RCU list keyed by regmap, so lookups from spans
+ * never block and a regmap that has gone away simply stops counting.
+ */
+struct dd_regmap_i2c {
+	struct list_head list;
+	struct rcu_head rcu;
+	struct i2c_client *i2c;
+	struct regmap *regmap;
+	u32 reads;
+	u32 writes;
+};
+
+static LIST_HEAD(dd_regmap_i2c_list);
+static DEFINE_SPINLOCK(dd_regmap_i2c_lock);
+
+/* caller holds rcu_read_lock() */
+static struct dd_regmap_i2c *dd_regmap_i2c_find(struct regmap *regmap)
+{
+	struct dd_regmap_i2c *ctx;
+
+	list_for_each_entry_rcu(ctx, &dd_regmap_i2c_list, list) {
+		if (ctx->regmap == regmap)
+			return ctx;
+	}
+
+	return NULL;
+}
+
+/* transfers issued so far through a dd_regmap_init_i2c() regmap */
+unsigned int dd_regmap_xfers(struct regmap *regmap)
+{
+	struct dd_regmap_i2c *ctx;
+	unsigned int xfers = 0;
+
+	rcu_read_lock();
+	ctx = dd_regmap_i2c_find(regmap);
+	if (ctx)
+		xfers = READ_ONCE(ctx->reads) + READ_ONCE(ctx->writes);
+	rcu_read_unlock();
+
+	return xfers;
+}
+EXPORT_SYMBOL_GPL(dd_regmap_xfers);
+
+static int dd_regmap_i2c_write(void *context, const void *data, size_t count)
+{
+	struct dd_regmap_i2c *ctx = context;
+	int ret;
+
+	ctx->writes++;
+	ret = i2c_master_send(ctx->i2c, data, count);
+	if (ret == count)
+		return 0;
+	else if (ret < 0)
+		return ret;
+	else
+		return -EIO;
+}
+
+static int dd_regmap_i2c_read(void *context, const void *reg, size_t reg_size,
+			      void *val, size_t val_size)
+{
+	struct dd_regmap_i2c *ctx = context;
+	struct i2c_client *i2c = ctx->i2c;
+	struct i2c_msg xfer[2];
+	int ret;
+
+	xfer[0].addr = i2c->addr;
+	xfer[0].flags = 0;
+	xfer[0].len = reg_size;
+	xfer[0].buf = (void *)reg;
+
+	xfer[1].addr = i2c->addr;
+	xfer[1].flags = I2C_M_RD;
+	xfer[1].len = val_size;
+	xfer[1].buf = val;
+
+	ctx->reads++;
+	ret = i2c_transfer(i2c->adapter, xfer, 2);
+	if (ret == 2)
+		return 0;
+	else if (ret < 0)
+		return ret;
+	else
+		return -EIO;
+}
+
+static int dd_regmap_smbus_reg_write(void *context, unsigned int reg,
+				     unsigned int val)
+{
+	struct dd_regmap_i2c *ctx = context;
+
+	ctx->writes++;
+	return i2c_smbus_write_byte_data(ctx->i2c, reg, val);
+}
+
+static int dd_regmap_smbus_reg_read(void *context, unsigned int reg,
+				    unsigned int *val)
+{
+	struct dd_regmap_i2c *ctx = context;
+	int ret;
+
+	ctx->reads++;
+	ret = i2c_smbus_read_byte_data(ctx->i2c, reg);
+	if (ret < 0)
+		return ret;
+
+	*val = ret;
+	return 0;
+}
+
+/* called from regmap_exit() */
+static void dd_regmap_i2c_free(void *context)
+{
+	struct dd_regmap_i2c *ctx = context;
+
+	spin_lock(&dd_regmap_i2c_lock);
+	list_del_rcu(&ctx->list);
+	spin_unlock(&dd_regmap_i2c_lock);
+	kfree_rcu(ctx, rcu);
+}
+
+static const struct regmap_bus dd_regmap_i2c_bus = {
+	.write = dd_regmap_i2c_write,
+	.read = dd_regmap_i2c_read,
+	.free_context = dd_regmap_i2c_free,
+	.reg_format_endian_default = REGMAP_ENDIAN_BIG,
+	.val_format_endian_default = REGMAP_ENDIAN_BIG,
+};
+
+static const struct regmap_bus dd_regmap_smbus_bus = {
+	.reg_write = dd_regmap_smbus_reg_write,
+	.reg_read = dd_regmap_smbus_reg_read,
+	.free_context = dd_regmap_i2c_free,
+};
+
+/* drop-in for devm_regmap_init_i2c() */
+struct regmap *dd_regmap_init_i2c(struct i2c_client *i2c,
+				  const struct regmap_config *config)
+{
+	const struct regmap_bus *bus;
+	struct dd_regmap_i2c *ctx;
+	struct regmap *regmap;
+
+	if (i2c_check_functionality(i2c->adapter, I2C_FUNC_I2C))
+		bus = &dd_regmap_i2c_bus;
+	else if (config->reg_bits == 8 && config->val_bits == 8 &&
+		 i2c_check_functionality(i2c->adapter,
+					 I2C_FUNC_SMBUS_BYTE_DATA))
+		bus = &dd_regmap_smbus_bus;
+	else
+		/* nothing we can count, let regmap-i2c pick a transport */
+		return devm_regmap_init_i2c(i2c, config);
+
+	ctx = kzalloc(sizeof(*ctx), GFP_KERNEL);
+	if (!ctx)
+		return ERR_PTR(-ENOMEM);
+	ctx->i2c = i2c;
+
+	/* from here on ctx is freed by the bus free_context */
+	regmap = devm_regmap_init(&i2c->dev, bus, ctx, config);
+	if (IS_ERR(regmap)) {
+		kfree(ctx);
+		return regmap;
+	}
+	ctx->regmap = regmap;
+
+	spin_lock(&dd_regmap_i2c_lock);
+	list_add_rcu(&ctx->list, &dd_regmap_i2c_list);
+	spin_unlock(&dd_regmap_i2c_lock);
+
+	return regmap;
+}
+EXPORT_SYMBOL_GPL(dd_regmap_init_i2c);
+
+/*
+ * Regmap of the I2C device behind a DT node, or of the clock provider of
+ * the named (or first) clock. Only meant as a dd_span key: no reference is
+ * kept, so the regmap may be gone by the time it is used.
+ */
+struct regmap *dd_of_i2c_regmap(struct device_node *np)
+{
+	struct i2c_client *client;
+	struct regmap *regmap;
+
+	if (!np)
+		return NULL;
+	client = of_find_i2c_device_by_node(np);
+	if (!client)
+		return NULL;
+	regmap = dev_get_regmap(&client->dev, NULL);
+	put_device(&client->dev);
+
+	return regmap;
+}
+EXPORT_SYMBOL_GPL(dd_of_i2c_regmap);
+
+struct regmap *dd_of_clk_regmap(struct device_node *np, const char *name)
+{
+	struct device_node *clk_np;
+	struct regmap *regmap;
+	int index = 0;
+
+	if (!np)
+		return NULL;
+	if (name) {
+		index = of_property_match_string(np, "clock-names", name);
+		if (index < 0)
+			return NULL;
+	}
+	clk_np = of_parse_phandle(np, "clocks", index);
+	regmap = dd_of_i2c_regmap(clk_np);
+	of_node_put(clk_np);
+
+	return regmap;
+}
+EXPORT_SYMBOL_GPL(dd_of_clk_regmap);
+
+/* regmap of the first codec of a machine driver stream, as a span key */
+struct regmap *dd_substream_codec_regmap(struct snd_pcm_substream *substream)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,9,0)
+	struct snd_soc_pcm_runtime *soc_runtime =
+					asoc_substream_to_rtd(substream);
+
+	return asoc_rtd_to_codec(soc_runtime, 0)->component->regmap;
+#else
+	struct snd_soc_pcm_runtime *soc_runtime = substream->private_data;
+
+	return soc_runtime->codec_dai->component->regmap;
+#endif /* LINUX_VERSION_CODE >= KERNEL_VERSION(5,9,0) */
+}
+EXPORT_SYMBOL_GPL(dd_substream_codec_regmap);
+
+/*
+ * i2c_reads and i2c_writes of a dd_regmap_init_i2c() regmap.
+ * Called by the regmap's owner, so the context outlives the lookup; the
+ * files point into it, so parent must go before the regmap does, e.g. a
+ * component debugfs directory.
+ */
+void dd_regmap_i2c_debugfs(struct regmap *regmap, struct dentry *parent)
+{
+	struct dd_regmap_i2c *ctx;
+
+	rcu_read_lock();
+	ctx = dd_regmap_i2c_find(regmap);
+	rcu_read_unlock();
+	if (!ctx)
+		return;
+
+	debugfs_create_u32("i2c_reads", 0444, parent, &ctx->reads);
+	debugfs_create_u32("i2c_writes", 0444, parent, &ctx->writes);
+}
+EXPORT_SYMBOL_GPL(dd_regmap_i2c_debugfs);
+
+void dd_hist_add(struct dd_hist *hist, ktime_t start)
+{
+	s64 us = ktime_us_delta(ktime_get(), start);
+	unsigned int n = (us > 0) ? fls64(us) : 0;
+
+	hist->bucket[min_t(unsigned int, n, DD_HIST_BUCKETS - 1)]++;
+}
+EXPORT_SYMBOL_GPL(dd_hist_add);
+
+static int dd_hist_show(struct seq_file *s, void *data)
+{
+	struct dd_hist *hist = s->private;
+	int n;
+
+	seq_printf(s, "%20s : count\n", "usecs");
+	seq_printf(s, "%9u -> %-8u : %u\n", 0, 0, hist->bucket[0]);
+	for (n = 1; n < DD_HIST_BUCKETS - 1; n++)
+		seq_printf(s, "%9u -> %-8u : %u\n", 1U << (n - 1),
+			   (1U << n) - 1, hist->bucket[n]);
+	seq_printf(s, "%9u -> %-8s : %u\n", 1U << (n - 1), "",
+		   hist->bucket[n]);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(dd_hist);
+
+void dd_hist_debugfs(const char *name, struct dentry *parent,
+		     struct dd_hist *hist)
+{
+	debugfs_create_file(name, 0444, parent, hist, &dd_hist_fops);
+}
+EXPORT_SYMBOL_GPL(dd_hist_debugfs);
+
+void dd_rate_switches_debugfs(struct dentry *parent, u32 *switches)
+{
+	debugfs_create_u32("rate_switches_44k1", 0444, parent,
+			   &switches[DD_RATE_44K1]);
+	debugfs_create_u32("rate_switches_48k", 0444, parent,
+			   &switches[DD_RATE_48K]);
+}
+EXPORT_SYMBOL_GPL(dd_rate_switches_debugfs);
+
+/* whole frames for the given filter, 0 if the table does not list it */
+snd_pcm_sframes_t dd_filter_delay(const struct dd_filter_delay *table,
+				  unsigned int num, unsigned int filter)
+{
+	unsigned int i;
+
+	for (i = 0; i < num; i++) {
+		if (table[i].filter == filter)
+			return DIV_ROUND_UP(table[i].delay, 10);
+	}
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(dd_filter_delay);
+
+/*
+ * Enum put that also records the written register value in *filter, for
+ * a .delay op that runs under the stream lock and cannot read the chip.
+ */
+int dd_filter_put(struct snd_kcontrol *kcontrol,
+		  struct snd_ctl_elem_value *ucontrol, unsigned int *filter)
+{
+	struct soc_enum *e = (struct soc_enum *)kcontrol->private_value;
+	int ret;
+
+	ret = snd_soc_put_enum_double(kcontrol, ucontrol);
+	if (ret < 0)
+		return ret;
+
+	WRITE_ONCE(*filter, snd_soc_enum_item_to_val(e,
+				ucontrol->value.enumerated.item[0]));
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(dd_filter_put);
+
+EXPORT_TRACEPOINT_SYMBOL_GPL(dd_startup);
+EXPORT_TRACEPOINT_SYMBOL_GPL(dd_hw_params);
+EXPORT_TRACEPOINT_SYMBOL_GPL(dd_set_dividers);
+EXPORT_TRACEPOINT_SYMBOL_GPL(dd_clk_set_rate);
+EXPORT_TRACEPOINT_SYMBOL_GPL(dd_mute_stream_begin);
+EXPORT_TRACEPOINT_SYMBOL_GPL(dd_mute_stream);
+EXPORT_TRACEPOINT_SYMBOL_GPL(dd_mute_poll);
+EXPORT_TRACEPOINT_SYMBOL_GPL(dd_bias_level);
+EXPORT_TRACEPOINT_SYMBOL_GPL(dd_pll_coeff);
 
-//MODULE_VERSION(DRV_VERSION);
-//MODULE_DESCRIPTION("Digital Dreamtine ASoC Utils");
-//MODULE_AUTHOR("Clive Messer <clive.messer@digitaldreamtime.co.uk>");
-//MODULE_LICENSE("GPL");
+MODULE_VERSION(DRV_VERSION);
+MODULE_DESCRIPTION("Digital Dreamtime ASoC Utils");
+MODULE_AUTHOR("Clive Messer <clive.messer@digitaldreamtime.co.uk>");
+MODULE_LICENSE("GPL");
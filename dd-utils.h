@@ -18,8 +18,79 @@
 #ifndef __DD_UTILS_H
 #define __DD_UTILS_H
 
+#include <linux/ktime.h>
+#include <linux/regmap.h>
 #include <sound/soc.h>
 
+#ifdef DD_VOLUME_COALESCE
+#include <linux/mutex.h>
+#include <linux/workqueue.h>
+#endif /* DD_VOLUME_COALESCE */
+
+struct i2c_client;
+struct dentry;
+struct device_node;
+
+struct regmap *dd_regmap_init_i2c(struct i2c_client *i2c,
+				  const struct regmap_config *config);
+void dd_regmap_i2c_debugfs(struct regmap *regmap, struct dentry *parent);
+struct regmap *dd_of_i2c_regmap(struct device_node *np);
+struct regmap *dd_of_clk_regmap(struct device_node *np, const char *name);
+struct regmap *dd_substream_codec_regmap(struct snd_pcm_substream *substream);
+
+/*
+ * log2 latency histogram: bucket 0 counts calls under 1us, bucket n calls
+ * of [2^(n-1), 2^n) us, and the last bucket everything slower. Updated
+ * without locking, callers are expected to be serialised already.
+ */
+#define DD_HIST_BUCKETS		20
+
+struct dd_hist {
+	u32 bucket[DD_HIST_BUCKETS];
+};
+
+void dd_hist_add(struct dd_hist *hist, ktime_t start);
+void dd_hist_debugfs(const char *name, struct dentry *parent,
+		     struct dd_hist *hist);
+
+/* sample rate families, indexes the per family rate switch counters */
+#define DD_RATE_44K1		0
+#define DD_RATE_48K		1
+#define DD_NUM_RATE_FAMILIES	2
+
+static inline unsigned int dd_rate_family(unsigned int rate)
+{
+	return (rate % 11025) ? DD_RATE_48K : DD_RATE_44K1;
+}
+
+/* count a change of rate family, *last is 0 until the first rate is set */
+static inline void dd_rate_switch(u32 *switches, unsigned int *last,
+				  unsigned int rate)
+{
+	unsigned int family = dd_rate_family(rate);
+
+	if (*last && dd_rate_family(*last) != family)
+		switches[family]++;
+	*last = rate;
+}
+
+void dd_rate_switches_debugfs(struct dentry *parent, u32 *switches);
+
+/*
+ * Nominal filter group delay, in tenths of a sample period, keyed on the
+ * filter select register value. Counted in sample periods the delay does
+ * not depend on the sample rate.
+ */
+struct dd_filter_delay {
+	unsigned int filter;
+	unsigned int delay;
+};
+
+snd_pcm_sframes_t dd_filter_delay(const struct dd_filter_delay *table,
+				  unsigned int num, unsigned int filter);
+int dd_filter_put(struct snd_kcontrol *kcontrol,
+		  struct snd_ctl_elem_value *ucontrol, unsigned int *filter);
+
 #ifdef DDEBUG
 char* dd_utils_log_daifmt_format(unsigned int format);
 char* dd_utils_log_daifmt_clock(unsigned int format);
@@ -27,4 +98,56 @@ char* dd_utils_log_daifmt_inverse(unsigned int format);
 char* dd_utils_log_daifmt_master(unsigned int format);
 #endif /* DDEBUG */
 
+#ifdef DD_VOLUME_COALESCE
+/*
+ * Coalesced stereo volume control.
+ *
+ * put() only records the newest left/right register pair and kicks a
+ * deferred worker; the worker writes whatever pair is current at that
+ * moment as a single block write to reg_left/reg_left + 1. put() already
+ * reports the change, so the worker only notifies when the write fails
+ * and the value falls back to what the chip holds. Intermediate targets
+ * from a slider drag are simply overwritten and never reach the bus.
+ *
+ * Both registers must be adjacent, 8 bits wide with shift 0, and the
+ * regmap must support multi-register (auto-increment) writes.
+ */
+#define DD_VOL_FLUSH_DELAY_MS	10
+
+struct dd_vol {
+	struct mutex lock;
+	struct regmap *regmap;
+	unsigned int reg_left;
+	/* target register values, valid once 'cached' is set */
+	u8 val[2];
+	bool cached;
+	/* set on first put, used for the failed commit notification */
+	struct snd_soc_component *component;
+	struct snd_kcontrol *kcontrol;
+	struct delayed_work work;
+};
+
+#define DD_VOL_DOUBLE_R_RANGE_TLV(xname, reg_left, reg_right, xshift, xmin, \
+				  xmax, xinvert, xhandler_get, xhandler_put, \
+				  tlv_array) \
+{	.iface = SNDRV_CTL_ELEM_IFACE_MIXER, .name = (xname), \
+	.access = SNDRV_CTL_ELEM_ACCESS_TLV_READ | \
+		  SNDRV_CTL_ELEM_ACCESS_READWRITE, \
+	.tlv.p = (tlv_array), \
+	.info = snd_soc_info_volsw_range, \
+	.get = xhandler_get, .put = xhandler_put, \
+	.private_value = SOC_DOUBLE_R_RANGE_VALUE(reg_left, reg_right, \
+						  xshift, xmin, xmax, \
+						  xinvert) }
+
+void dd_vol_init(struct dd_vol *vol, struct regmap *regmap,
+		 unsigned int reg_left);
+int dd_vol_get(struct dd_vol *vol, struct snd_kcontrol *kcontrol,
+	       struct snd_ctl_elem_value *ucontrol);
+int dd_vol_put(struct dd_vol *vol, struct snd_kcontrol *kcontrol,
+	       struct snd_ctl_elem_value *ucontrol);
+void dd_vol_flush(struct dd_vol *vol);
+void dd_vol_cancel(struct dd_vol *vol);
+#endif /* DD_VOLUME_COALESCE */
+
 #endif /* __DD_UTILS_H */
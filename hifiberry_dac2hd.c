@@ -34,11 +34,26 @@
 #include <linux/i2c.h>
 #include <linux/clk.h>
 #include <linux/version.h>
+#include <linux/debugfs.h>
 
 #include "pcm1796.h"
+#include "dd-utils.h"
+#include "dd-debug.h"
+#include "dd-trace.h"
 
 #define DRV_VERSION "5.2.1"
 
+/**
+ * struct dac2hd_stats - card level counters and latency histograms, exported
+ * via debugfs
+ * @rate: rate of the last successful hw_params, for the switch counters
+ */
+struct dac2hd_stats {
+	unsigned int rate;
+	u32 rate_switches[DD_NUM_RATE_FAMILIES];
+	struct dd_hist hw_params;
+};
+
 #define DEFAULT_RATE	44100
 #define BCLK_RATIO	64
 
@@ -48,10 +63,17 @@
 //#define CLK_RATE_48K	24576000UL // 24.576  MHz
 //#define CLK_RATE_48K	49152000UL // 49.152  MHz
 
-#ifdef DAC2HD_DRVDATA
+/**
+ * struct dac2hd_drvdata - per card private data
+ * @clk_rates: rates supported by the clock, filled in at probe
+ * @rates_constraint: rates constraint applied at startup
+ * @stats: updated from hw_params, serialised by the card's pcm mutex
+ */
 struct dac2hd_drvdata {
+	unsigned int clk_rates[32];
+	struct snd_pcm_hw_constraint_list rates_constraint;
+	struct dac2hd_stats stats;
 };
-#endif /* DAC2HD_DRVDATA */
 
 static const char dac2hd_rates_texts[] = "44k1,48k,88k2,96k,172k6,192k";
 
@@ -59,10 +81,69 @@ static const unsigned int dac2hd_rates[] = {
 	44100, 48000, 88200, 96000, 176400, 192000,
 };
 
-static struct snd_pcm_hw_constraint_list dac2hd_rates_constraint = {
-	.list	= dac2hd_rates,
-	.count	= ARRAY_SIZE(dac2hd_rates),
-};
+/*
+ * Build the rates constraint from what the DAC2HD clock can actually
+ * generate, by asking it to round each of the standard rates. Overlays
+ * without a clocks property on the card node keep the static list.
+ */
+static int snd_rpi_hb_dac2hd_clk_rates(struct device *dev,
+				       struct dac2hd_drvdata *data)
+{
+	int i;
+	long rate;
+	unsigned int count = 0;
+	struct clk *sclk;
+
+	dd_trace(dev, "%s: ENTER\n", __func__);
+
+	data->rates_constraint.list = dac2hd_rates;
+	data->rates_constraint.count = ARRAY_SIZE(dac2hd_rates);
+
+	sclk = devm_clk_get_optional(dev, NULL);
+	if (IS_ERR(sclk)) {
+		if (PTR_ERR(sclk) != -EPROBE_DEFER)
+			dev_err(dev, "%s: EXIT [%ld]: failed to get clock!\n",
+				__func__, PTR_ERR(sclk));
+		return PTR_ERR(sclk);
+	}
+	if (!sclk) {
+		dd_trace(dev, "%s: EXIT [0]: no clock, using static rates "
+			 "(%s)\n", __func__, dac2hd_rates_texts);
+		return 0;
+	}
+
+	for (i = 0; i < snd_pcm_known_rates.count &&
+		    count < ARRAY_SIZE(data->clk_rates); i++) {
+		rate = clk_round_rate(sclk, snd_pcm_known_rates.list[i]);
+		if (rate == snd_pcm_known_rates.list[i])
+			data->clk_rates[count++] = rate;
+	}
+	devm_clk_put(dev, sclk);
+
+	if (!count) {
+		dev_warn(dev, "%s: EXIT [0]: clock reports no standard rates, "
+			 "using static rates (%s)\n", __func__,
+			 dac2hd_rates_texts);
+		return 0;
+	}
+
+	data->rates_constraint.list = data->clk_rates;
+	data->rates_constraint.count = count;
+
+	dd_trace(dev, "%s: EXIT [0]: %u rates from clock\n", __func__, count);
+	return 0;
+}
+
+#ifdef CONFIG_DEBUG_FS
+static void snd_rpi_hb_dac2hd_debugfs_init(struct snd_soc_card *card)
+{
+	struct dac2hd_drvdata *data = snd_soc_card_get_drvdata(card);
+	struct dentry *dentry = card->debugfs_card_root;
+
+	dd_rate_switches_debugfs(dentry, data->stats.rate_switches);
+	dd_hist_debugfs("hw_params_us", dentry, &data->stats.hw_params);
+}
+#endif /* CONFIG_DEBUG_FS */
 
 static int snd_rpi_hb_dac2hd_init(struct snd_soc_pcm_runtime *soc_runtime)
 {
@@ -76,7 +157,7 @@ static int snd_rpi_hb_dac2hd_init(struct snd_soc_pcm_runtime *soc_runtime)
 #endif /* LINUX_VERSION_CODE >= KERNEL_VERSION(5,9,0) */
 	struct device *dev = soc_runtime->card->dev;
 
-	dev_dbg(dev, "%s: ENTER\n", __func__);
+	dd_trace(dev, "%s: ENTER\n", __func__);
 
 	/*
 	 * allow only fixed 32 clock counts per channel
@@ -100,11 +181,15 @@ static int snd_rpi_hb_dac2hd_init(struct snd_soc_pcm_runtime *soc_runtime)
 		return ret;
 	}
 
-	dev_dbg(dev, "%s: EXIT [0]\n", __func__);
+#ifdef CONFIG_DEBUG_FS
+	snd_rpi_hb_dac2hd_debugfs_init(soc_runtime->card);
+#endif /* CONFIG_DEBUG_FS */
+
+	dd_trace(dev, "%s: EXIT [0]\n", __func__);
 	return 0;
 }
 
-static int snd_rpi_hb_dac2hd_startup(struct snd_pcm_substream *substream)
+static int __snd_rpi_hb_dac2hd_startup(struct snd_pcm_substream *substream)
 {
 	int ret = 0;
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(5,9,0)
@@ -114,29 +199,44 @@ static int snd_rpi_hb_dac2hd_startup(struct snd_pcm_substream *substream)
 	struct snd_soc_pcm_runtime *soc_runtime = substream->private_data;
 #endif /* LINUX_VERSION_CODE >= KERNEL_VERSION(5,9,0) */
 	struct device *dev = soc_runtime->card->dev;
+	struct dac2hd_drvdata *data =
+				snd_soc_card_get_drvdata(soc_runtime->card);
 
-	dev_dbg(dev, "%s: ENTER\n", __func__);
+	dd_trace(dev, "%s: ENTER\n", __func__);
 
 	/*
 	 * constraints for standard sample rates
 	 */
 #ifdef DDEBUG
-	dev_dbg(dev, "%s: set rates (%s) constraint\n", __func__,
-		dac2hd_rates_texts);
+	dev_dbg(dev, "%s: set rates (#%u) constraint\n", __func__,
+		data->rates_constraint.count);
 #endif /* DDEBUG */
 	ret = snd_pcm_hw_constraint_list(substream->runtime, 0,
 					 SNDRV_PCM_HW_PARAM_RATE,
-					 &dac2hd_rates_constraint);
+					 &data->rates_constraint);
 	if (ret < 0) {
-		dev_err(dev, "%s: EXIT [%d]: failed to set rates (%s) "
-			"constraint!\n", __func__, ret, dac2hd_rates_texts);
+		dev_err(dev, "%s: EXIT [%d]: failed to set rates (#%u) "
+			"constraint!\n", __func__, ret,
+			data->rates_constraint.count);
 		return ret;
 	}
 
-	dev_dbg(dev, "%s: EXIT [0]\n", __func__);
+	dd_trace(dev, "%s: EXIT [0]\n", __func__);
 	return 0;
 }
 
+static int snd_rpi_hb_dac2hd_startup(struct snd_pcm_substream *substream)
+{
+	struct dd_span span;
+	int ret;
+
+	dd_span_begin(&span, dd_substream_codec_regmap(substream));
+	ret = __snd_rpi_hb_dac2hd_startup(substream);
+	trace_dd_startup(substream->pcm->card->dev, substream->stream, 0, ret,
+			 &span);
+	return ret;
+}
+
 static int snd_rpi_hb_dac2hd_set_osrate(struct snd_soc_pcm_runtime *soc_runtime,
 					int sample_rate)
 {
@@ -151,7 +251,7 @@ static int snd_rpi_hb_dac2hd_set_osrate(struct snd_soc_pcm_runtime *soc_runtime,
 #endif /* LINUX_VERSION_CODE >= KERNEL_VERSION(5,9,0) */
 	struct device *dev = soc_runtime->card->dev;
 
-	dev_dbg(dev, "%s: ENTER: sample_rate=%d\n", __func__, sample_rate);
+	dd_trace(dev, "%s: ENTER: sample_rate=%d\n", __func__, sample_rate);
 
 	if (sample_rate > 96000) {
 		os_rate = PCM1796_REG20_OS_32;
@@ -181,12 +281,12 @@ static int snd_rpi_hb_dac2hd_set_osrate(struct snd_soc_pcm_runtime *soc_runtime,
 #endif /* DDEBUG */
 	}
 
-	dev_dbg(dev, "%s: EXIT [0]\n", __func__);
+	dd_trace(dev, "%s: EXIT [0]\n", __func__);
 	return 0;
 }
 
-static int snd_rpi_hb_dac2hd_hw_params(struct snd_pcm_substream *substream,
-				       struct snd_pcm_hw_params *params)
+static int __snd_rpi_hb_dac2hd_hw_params(struct snd_pcm_substream *substream,
+					 struct snd_pcm_hw_params *params)
 {
 	int ret = 0;
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(5,9,0)
@@ -202,12 +302,12 @@ static int snd_rpi_hb_dac2hd_hw_params(struct snd_pcm_substream *substream,
 	snd_pcm_format_t format = params_format(params);
 	unsigned int sample_rate = params_rate(params);
 
-	dev_dbg(dev, "%s: ENTER: frequency=%u, format=%s, sample_bits=%u, "
-		"physical_bits=%u, channels=%u\n", __func__,
-                sample_rate, snd_pcm_format_name(format),
-                snd_pcm_format_width(format),
-                snd_pcm_format_physical_width(format),
-                params_channels(params));
+	dd_trace(dev, "%s: ENTER: frequency=%u, format=%s, sample_bits=%u, "
+		 "physical_bits=%u, channels=%u\n", __func__,
+		 sample_rate, snd_pcm_format_name(format),
+		 snd_pcm_format_width(format),
+		 snd_pcm_format_physical_width(format),
+		 params_channels(params));
 
 	ret = snd_soc_dai_set_sysclk(codec_dai, PCM1796_SYSCLK_ID, 
 				     sample_rate, SND_SOC_CLOCK_OUT);
@@ -224,10 +324,37 @@ static int snd_rpi_hb_dac2hd_hw_params(struct snd_pcm_substream *substream,
 		return ret;
 	}
 
-	dev_dbg(dev, "%s: EXIT [0]\n", __func__);
+	dd_trace(dev, "%s: EXIT [0]\n", __func__);
 	return 0;
 }
 
+static int snd_rpi_hb_dac2hd_hw_params(struct snd_pcm_substream *substream,
+				       struct snd_pcm_hw_params *params)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,9,0)
+	struct snd_soc_pcm_runtime *soc_runtime =
+					asoc_substream_to_rtd(substream);
+#else
+	struct snd_soc_pcm_runtime *soc_runtime = substream->private_data;
+#endif /* LINUX_VERSION_CODE >= KERNEL_VERSION(5,9,0) */
+	struct dac2hd_drvdata *data = snd_soc_card_get_drvdata(soc_runtime->card);
+	struct dd_span span;
+	int ret;
+
+	dd_span_begin(&span, dd_substream_codec_regmap(substream));
+	/* set_sysclk reprograms the clock */
+	dd_span_add(&span, dd_of_clk_regmap(substream->pcm->card->dev->of_node,
+					    NULL));
+	ret = __snd_rpi_hb_dac2hd_hw_params(substream, params);
+	trace_dd_hw_params(substream->pcm->card->dev, params_rate(params),
+			   params_width(params), ret, &span);
+	dd_hist_add(&data->stats.hw_params, span.start);
+	if (!ret)
+		dd_rate_switch(data->stats.rate_switches, &data->stats.rate,
+			       params_rate(params));
+	return ret;
+}
+
 /* machine stream operations */
 static struct snd_soc_ops dac2hd_ops = {
 	.startup   = snd_rpi_hb_dac2hd_startup,
@@ -263,17 +390,14 @@ static struct snd_soc_card dac2hd_card = {
 static int snd_rpi_hb_dac2hd_probe(struct platform_device *pdev)
 {
 	int ret = 0;
-#ifdef DAC2HD_DRVDATA
 	struct dac2hd_drvdata *data;
-#endif /* DAC2HD_DRVDATA */
 	struct device *dev = &pdev->dev;
 	struct device_node *i2s_node;
 
-	dev_dbg(dev, "%s: ENTER\n", __func__);
+	dd_trace(dev, "%s: ENTER\n", __func__);
 
 	dac2hd_card.dev = dev;
 
-#ifdef DAC2HD_DRVDATA
 #ifdef DDEBUG
 	dev_dbg(dev, "%s: allocate memory for private data\n", __func__);
 #endif // DDEBUG
@@ -286,7 +410,6 @@ static int snd_rpi_hb_dac2hd_probe(struct platform_device *pdev)
 	}
 
 	snd_soc_card_set_drvdata(&dac2hd_card, data);
-#endif /* DAC2HD_DRVDATA */
 
 	/*
 	 * DEVICE TREE
@@ -312,6 +435,10 @@ static int snd_rpi_hb_dac2hd_probe(struct platform_device *pdev)
 				__func__);
 			goto i2s_err;
 		}
+
+		ret = snd_rpi_hb_dac2hd_clk_rates(dev, data);
+		if (ret < 0)
+			goto i2s_err;
 	} else {
 		ret = -ENODEV;
 		dev_err(dev, "%s: device tree node not found: returning "
@@ -340,7 +467,7 @@ static int snd_rpi_hb_dac2hd_probe(struct platform_device *pdev)
 	
 	of_node_put(i2s_node);
 
-	dev_dbg(dev, "%s: EXIT [0]\n", __func__);
+	dd_trace(dev, "%s: EXIT [0]\n", __func__);
 	return 0;
 
 i2s_err:
@@ -352,7 +479,7 @@ err:
 		else
 			dev_info(dev, "%s: EXIT [-EPROBE_DEFER]\n", __func__);
 	} else
-		dev_dbg(dev, "%s: EXIT [%d]\n", __func__, ret);
+		dd_trace(dev, "%s: EXIT [%d]\n", __func__, ret);
 
 	return ret;
 }
@@ -15,6 +15,8 @@
 #include <linux/regmap.h>
 
 #include "pcm1796.h"
+#include "dd-utils.h"
+#include "dd-debug.h"
 
 #define DRV_VERSION "5.2.1"
 
@@ -24,10 +26,19 @@ static int pcm1796_i2c_probe(struct i2c_client *client,
 	int ret = 0;
 	struct device *dev = &client->dev;
 	struct regmap *regmap;
+#ifdef DD_VOLUME_COALESCE
+	struct regmap_config config = pcm1796_regmap_cfg;
+#endif /* DD_VOLUME_COALESCE */
 
-	dev_dbg(&client->dev, "%s: ENTER\n", __func__);
+	dd_trace(&client->dev, "%s: ENTER\n", __func__);
 
-	regmap = devm_regmap_init_i2c(client, &pcm1796_regmap_cfg);
+#ifdef DD_VOLUME_COALESCE
+	/* INC bit: auto-increment for the REG16/17 volume block write */
+	config.write_flag_mask = 0x80;
+	regmap = dd_regmap_init_i2c(client, &config);
+#else
+	regmap = dd_regmap_init_i2c(client, &pcm1796_regmap_cfg);
+#endif /* DD_VOLUME_COALESCE */
 	if (IS_ERR(regmap)) {
 		ret = PTR_ERR(regmap);
 		dev_err(dev, "%s: EXIT [%d]: regmap_init_i2c failed!\n",
@@ -43,7 +54,7 @@ static int pcm1796_i2c_probe(struct i2c_client *client,
 		else
 			dev_info(dev, "%s: EXIT [-EPROBE_DEFER]\n", __func__);
 	} else 
-		dev_dbg(dev, "%s: EXIT [%d]\n", __func__, ret);
+		dd_trace(dev, "%s: EXIT [%d]\n", __func__, ret);
 
 	return ret;
 }
@@ -51,9 +62,9 @@ static int pcm1796_i2c_probe(struct i2c_client *client,
 static int pcm1796_i2c_remove(struct i2c_client *client)
 {
 	struct device *dev = &client->dev;
-	dev_dbg(dev, "%s: ENTER\n", __func__);
+	dd_trace(dev, "%s: ENTER\n", __func__);
 	pcm1796_remove(dev);
-	dev_dbg(dev, "%s: EXIT [0]\n", __func__);
+	dd_trace(dev, "%s: EXIT [0]\n", __func__);
 	return 0;
 }
 
@@ -17,6 +17,7 @@
 #include <linux/device.h>
 #include <linux/version.h>
 #include <linux/clk.h>
+#include <linux/debugfs.h>
 #include <linux/of.h>
 
 #include <sound/core.h>
@@ -28,6 +29,8 @@
 
 #include "pcm1796.h"
 #include "dd-utils.h"
+#include "dd-debug.h"
+#include "dd-trace.h"
 
 #define DRV_VERSION "5.2.1"
 
@@ -37,8 +40,27 @@
 #define PCM1796_GPIOD_OUT_LOW	GPIOD_OUT_HIGH
 #endif /* PCM1796_GPIO_ACTIVE_HIGH */
 
+/**
+ * struct pcm1796_stats - counters and latency histograms, exported via
+ * debugfs
+ * @rate: rate of the last successful hw_params, for the switch counters
+ */
+struct pcm1796_stats {
+	unsigned int rate;
+	u32 rate_switches[DD_NUM_RATE_FAMILIES];
+	struct dd_hist hw_params;
+	struct dd_hist mute_stream;
+};
+
 struct pcm1796_drvdata {
 	struct mutex mutex;
+	/*
+	 * REG18 mute as last written, bit 0. Written under mutex, read
+	 * locklessly with READ_ONCE() so the mixer never waits on I/O.
+	 */
+	unsigned int mute;
+	/* REG19 FLT as last written, read from the (atomic) delay op */
+	unsigned int filter;
 	unsigned int format;
 	unsigned int bclk_ratio;
 	unsigned int rate;
@@ -47,6 +69,11 @@ struct pcm1796_drvdata {
 	struct gpio_desc *reset_gpio;
 	struct gpio_desc *mute_gpio;
 	bool auto_gpio_mute;
+#ifdef DD_VOLUME_COALESCE
+	/* Digital Playback Volume, flushed to REG16/17 as one block */
+	struct dd_vol vol;
+#endif /* DD_VOLUME_COALESCE */
+	struct pcm1796_stats stats;
 };
 
 static const struct reg_default pcm1796_reg_defaults[] = {
@@ -64,11 +91,11 @@ static bool pcm1796_accessible_reg(struct device *dev, unsigned int reg)
 {
 	bool result;
 #ifdef DDDEBUG
-	dev_dbg(dev, "%s: ENTER: reg=%u\n", __func__, reg);
+	dd_trace(dev, "%s: ENTER: reg=%u\n", __func__, reg);
 #endif /* DDDEBUG */
 	result = (reg >= PCM1796_REG16 && reg <= PCM1796_REG23);
 #ifdef DDDEBUG
-	dev_dbg(dev, "%s: EXIT [%s]\n", __func__, (result ? "true" : "false"));
+	dd_trace(dev, "%s: EXIT [%s]\n", __func__, (result ? "true" : "false"));
 #endif /* DDDEBUG */
 	return result;
 }
@@ -77,11 +104,11 @@ static bool pcm1796_writeable_reg(struct device *dev, unsigned int reg)
 {
 	bool result;
 #ifdef DDDEBUG
-	dev_dbg(dev, "%s: ENTER: reg=%u\n", __func__, reg);
+	dd_trace(dev, "%s: ENTER: reg=%u\n", __func__, reg);
 #endif /* DDDEBUG */
 	result = (reg >= PCM1796_REG16 && reg <= PCM1796_REG21);
 #ifdef DDDEBUG
-	dev_dbg(dev, "%s: EXIT [%s]\n", __func__, (result ? "true" : "false"));
+	dd_trace(dev, "%s: EXIT [%s]\n", __func__, (result ? "true" : "false"));
 #endif /* DDDEBUG */
 	return result;
 }
@@ -90,7 +117,7 @@ static bool pcm1796_volatile_reg(struct device *dev, unsigned int reg)
 {
 	bool result;
 #ifdef DDDEBUG
-	dev_dbg(dev, "%s: ENTER: reg=%u\n", __func__, reg);
+	dd_trace(dev, "%s: ENTER: reg=%u\n", __func__, reg);
 #endif /* DDDEBUG */
 	switch(reg) {
 	case PCM1796_REG22:
@@ -102,7 +129,7 @@ static bool pcm1796_volatile_reg(struct device *dev, unsigned int reg)
 		break;
 	}
 #ifdef DDDEBUG
-	dev_dbg(dev, "%s: EXIT [%s]\n", __func__, (result ? "true" : "false"));
+	dd_trace(dev, "%s: EXIT [%s]\n", __func__, (result ? "true" : "false"));
 #endif /* DDDEBUG */
 	return result;
 }
@@ -112,18 +139,18 @@ static int pcm1796_dai_set_fmt(struct snd_soc_dai *dai, unsigned int fmt)
 	struct snd_soc_component *component = dai->component;
 	struct pcm1796_drvdata *data = snd_soc_component_get_drvdata(component);
 #ifdef DDEBUG
-	dev_dbg(component->dev, "%s: ENTER: fmt=0x%x (MASTER=%s, FORMAT=%s, "
-		"INV=%s, CLOCK=%s)\n", __func__, fmt,
-		dd_utils_log_daifmt_master(fmt),
-		dd_utils_log_daifmt_format(fmt),
-		dd_utils_log_daifmt_inverse(fmt),
-		dd_utils_log_daifmt_clock(fmt));
+	dd_trace(component->dev, "%s: ENTER: fmt=0x%x (MASTER=%s, FORMAT=%s, "
+		 "INV=%s, CLOCK=%s)\n", __func__, fmt,
+		 dd_utils_log_daifmt_master(fmt),
+		 dd_utils_log_daifmt_format(fmt),
+		 dd_utils_log_daifmt_inverse(fmt),
+		 dd_utils_log_daifmt_clock(fmt));
 #else
-	dev_dbg(component->dev, "%s: ENTER: fmt=0x%x\n", __func__, fmt);
+	dd_trace(component->dev, "%s: ENTER: fmt=0x%x\n", __func__, fmt);
 #endif /* DDEBUG */
 	data->format = fmt;
 
-	dev_dbg(component->dev, "%s: EXIT [0]\n", __func__);
+	dd_trace(component->dev, "%s: EXIT [0]\n", __func__);
 	return 0;
 }
 
@@ -133,11 +160,11 @@ static int pcm1796_dai_set_bclk_ratio(struct snd_soc_dai *dai,
 	struct snd_soc_component *component = dai->component;
 	struct pcm1796_drvdata *data = snd_soc_component_get_drvdata(component);
 
-	dev_dbg(component->dev, "%s: ENTER: ratio=%u\n", __func__, ratio);
+	dd_trace(component->dev, "%s: ENTER: ratio=%u\n", __func__, ratio);
 
 	data->bclk_ratio = ratio;
 
-	dev_dbg(component->dev, "%s: EXIT [0]\n", __func__);
+	dd_trace(component->dev, "%s: EXIT [0]\n", __func__);
 	return 0;
 }
 
@@ -149,7 +176,7 @@ static int pcm1796_dai_set_sysclk(struct snd_soc_dai *dai, int clk_id,
 	struct pcm1796_drvdata *data = snd_soc_component_get_drvdata(component);
 	struct device *dev = component->dev;
 
-	dev_dbg(dev, "%s: ENTER: clk_id=%d, freq=%u\n", __func__, clk_id, freq);
+	dd_trace(dev, "%s: ENTER: clk_id=%d, freq=%u\n", __func__, clk_id, freq);
 
 	if (clk_id != PCM1796_SYSCLK_ID) {
 		dev_err(dev, "%s: EXIT [-EINVAL]: (clk_id=%d != "
@@ -170,8 +197,8 @@ static int pcm1796_dai_set_sysclk(struct snd_soc_dai *dai, int clk_id,
 	 * but it is impossible to set. Ignore it here
 	 */
 	if (freq == 0) {
-		dev_dbg(dev, "%s: EXIT [0]: noop - ignoring because freq=0",
-			__func__);
+		dd_trace(dev, "%s: EXIT [0]: noop - ignoring because freq=0",
+			 __func__);
         	return 0;
 	}
 
@@ -187,10 +214,63 @@ static int pcm1796_dai_set_sysclk(struct snd_soc_dai *dai, int clk_id,
 
 	data->sysclk = freq;
 
-	dev_dbg(dev, "%s: EXIT [0]\n", __func__);
+	dd_trace(dev, "%s: EXIT [0]\n", __func__);
 	return 0;
 }
 
+#ifdef PCM1796_SCLK_ON_DEMAND
+/*
+ * Only hold sclk while a stream is open, so an idle clock provider can
+ * runtime suspend (power down its outputs).
+ */
+static int __pcm1796_dai_startup(struct snd_pcm_substream *substream,
+				 struct snd_soc_dai *dai)
+{
+	int ret;
+	struct snd_soc_component *component = dai->component;
+	struct pcm1796_drvdata *data = snd_soc_component_get_drvdata(component);
+	struct device *dev = component->dev;
+
+	dd_trace(dev, "%s: ENTER\n", __func__);
+
+	ret = clk_prepare_enable(data->sclk);
+	if (ret < 0) {
+		dev_err(dev, "%s: EXIT [%d]: clk_prepare_enable(sclk) "
+			"failed!\n", __func__, ret);
+		return ret;
+	}
+
+	dd_trace(dev, "%s: EXIT [0]\n", __func__);
+	return 0;
+}
+
+static int pcm1796_dai_startup(struct snd_pcm_substream *substream,
+			       struct snd_soc_dai *dai)
+{
+	struct dd_span span;
+	int ret;
+
+	dd_span_begin(&span, dai->component->regmap);
+	dd_span_add(&span, dd_of_clk_regmap(dai->dev->of_node, "sclk"));
+	ret = __pcm1796_dai_startup(substream, dai);
+	trace_dd_startup(dai->dev, substream->stream, 0, ret, &span);
+	return ret;
+}
+
+static void pcm1796_dai_shutdown(struct snd_pcm_substream *substream,
+				 struct snd_soc_dai *dai)
+{
+	struct snd_soc_component *component = dai->component;
+	struct pcm1796_drvdata *data = snd_soc_component_get_drvdata(component);
+
+	dd_trace(component->dev, "%s: ENTER\n", __func__);
+
+	clk_disable_unprepare(data->sclk);
+
+	dd_trace(component->dev, "%s: EXIT [void]\n", __func__);
+}
+#endif /* PCM1796_SCLK_ON_DEMAND */
+
 static int pcm1796_gpio_mute_enable(struct snd_soc_component *component,
 				    bool enable)
 {
@@ -198,7 +278,7 @@ static int pcm1796_gpio_mute_enable(struct snd_soc_component *component,
 	struct device *dev = component->dev;
 	int gpio_enable = (enable ? 0 : 1);
 
-	dev_dbg(dev, "%s: ENTER: enable=%s\n", __func__, (enable ? "true"
+	dd_trace(dev, "%s: ENTER: enable=%s\n", __func__, (enable ? "true"
 								 : "false"));
 	if (data->mute_gpio) {
 #ifdef DDEBUG
@@ -213,7 +293,7 @@ static int pcm1796_gpio_mute_enable(struct snd_soc_component *component,
 			__func__);
 #endif /* DDEBUG */
 
-	dev_dbg(dev, "%s: EXIT[0]\n", __func__);
+	dd_trace(dev, "%s: EXIT[0]\n", __func__);
 	return 0;
 }
 
@@ -224,7 +304,7 @@ static int pcm1796_output_enable(struct snd_soc_component *component,
 	char *enable_log = (enable ? "REG19_OPE_ENABLE" : "REG19_OPE_DISABLE");
 	struct device *dev = component->dev;
 
-	dev_dbg(dev, "%s: ENTER: enable=%s\n", __func__, (enable ? "true"
+	dd_trace(dev, "%s: ENTER: enable=%s\n", __func__, (enable ? "true"
 								 : "false"));
 
 	dev_dbg(dev, "%s: set %s\n", __func__, enable_log);
@@ -245,7 +325,7 @@ static int pcm1796_output_enable(struct snd_soc_component *component,
 #endif /* DDEBUG */
 	}
 
-	dev_dbg(dev, "%s: EXIT [0]\n", __func__);
+	dd_trace(dev, "%s: EXIT [0]\n", __func__);
 	return 0;
 }
 
@@ -256,7 +336,7 @@ static int pcm1796_mute_stream(struct snd_soc_component *component, int mute)
 	struct pcm1796_drvdata *data = snd_soc_component_get_drvdata(component);
 	struct device *dev = component->dev;
 	
-	dev_dbg(dev, "%s: ENTER: mute=%d\n", __func__, mute);
+	dd_trace(dev, "%s: ENTER: mute=%d\n", __func__, mute);
 	
 	mutex_lock(&data->mutex);
 
@@ -272,6 +352,8 @@ static int pcm1796_mute_stream(struct snd_soc_component *component, int mute)
 	dev_dbg(dev, "%s: set %s\n", __func__, mute_log);
 	ret = snd_soc_component_update_bits(component, PCM1796_REG18_MUTE,
 					    PCM1796_REG18_MUTE_MASK, !!mute);
+	if (ret >= 0)
+		WRITE_ONCE(data->mute, !!mute);
 	if (ret) {
 		if (ret < 0) {
 			dev_err(dev, "%s: error setting %s: [%d]\n", __func__,
@@ -300,23 +382,23 @@ static int pcm1796_mute_stream(struct snd_soc_component *component, int mute)
 		return ret;
 	}
 
-	dev_dbg(dev, "%s: EXIT [0]\n", __func__);
+	dd_trace(dev, "%s: EXIT [0]\n", __func__);
 	return 0;
 }
 
-static int pcm1796_dai_mute_stream(struct snd_soc_dai *dai, int mute,
-				   int direction)
+static int __pcm1796_dai_mute_stream(struct snd_soc_dai *dai, int mute,
+				     int direction)
 {
 	int ret = 0;
 	struct snd_soc_component *component = dai->component;
 	struct device *dev = component->dev;
 
-	dev_dbg(dev, "%s: ENTER: mute=%d, direction=%d\n", __func__, mute,
-		direction);	
+	dd_trace(dev, "%s: ENTER: mute=%d, direction=%d\n", __func__, mute,
+		 direction);	
 
 	if (direction != SNDRV_PCM_STREAM_PLAYBACK) {
-		dev_dbg(dev, "%s: EXIT [0]: noop - (direction != "
-			"SNDRV_PCM_STREAM_PLAYBACK)\n", __func__);
+		dd_trace(dev, "%s: EXIT [0]: noop - (direction != "
+			 "SNDRV_PCM_STREAM_PLAYBACK)\n", __func__);
 		return 0;
 	}
 
@@ -326,13 +408,29 @@ static int pcm1796_dai_mute_stream(struct snd_soc_dai *dai, int mute,
 		return ret;
 	}
 
-	dev_dbg(dev, "%s: EXIT [0]\n", __func__);
+	dd_trace(dev, "%s: EXIT [0]\n", __func__);
 	return 0;
 }
 
-static int pcm1796_dai_hw_params(struct snd_pcm_substream *substream,
-				 struct snd_pcm_hw_params *params,
-				 struct snd_soc_dai *dai)
+static int pcm1796_dai_mute_stream(struct snd_soc_dai *dai, int mute,
+				   int direction)
+{
+	struct pcm1796_drvdata *data =
+				snd_soc_component_get_drvdata(dai->component);
+	struct dd_span span;
+	int ret;
+
+	trace_dd_mute_stream_begin(dai->dev, mute, direction);
+	dd_span_begin(&span, dai->component->regmap);
+	ret = __pcm1796_dai_mute_stream(dai, mute, direction);
+	trace_dd_mute_stream(dai->dev, mute, direction, ret, &span);
+	dd_hist_add(&data->stats.mute_stream, span.start);
+	return ret;
+}
+
+static int __pcm1796_dai_hw_params(struct snd_pcm_substream *substream,
+				   struct snd_pcm_hw_params *params,
+				   struct snd_soc_dai *dai)
 {
 	int ret, fmt_val = 0;
 	struct snd_soc_component *component = dai->component;
@@ -343,10 +441,10 @@ static int pcm1796_dai_hw_params(struct snd_pcm_substream *substream,
 	snd_pcm_format_t format = params_format(params);
 	unsigned int rate = params_rate(params);
 
-	dev_dbg(dev, "%s: ENTER: frequency=%u, format=%s, sample_bits=%u, "
-		"physical_bits=%u, channels=%u\n", __func__, rate,
-		snd_pcm_format_name(format), snd_pcm_format_width(format),
-		snd_pcm_format_physical_width(format), params_channels(params));
+	dd_trace(dev, "%s: ENTER: frequency=%u, format=%s, sample_bits=%u, "
+		 "physical_bits=%u, channels=%u\n", __func__, rate,
+		 snd_pcm_format_name(format), snd_pcm_format_width(format),
+		 snd_pcm_format_physical_width(format), params_channels(params));
 
 	data->rate = rate;
 
@@ -411,9 +509,30 @@ static int pcm1796_dai_hw_params(struct snd_pcm_substream *substream,
 #endif /* DDEBUG */
 	}
 
-	dev_dbg(dev, "%s: EXIT [0]\n", __func__);
+	dd_trace(dev, "%s: EXIT [0]\n", __func__);
 	return 0;
 }
+
+static int pcm1796_dai_hw_params(struct snd_pcm_substream *substream,
+				 struct snd_pcm_hw_params *params,
+				 struct snd_soc_dai *dai)
+{
+	struct pcm1796_drvdata *data =
+				snd_soc_component_get_drvdata(dai->component);
+	struct dd_span span;
+	int ret;
+
+	dd_span_begin(&span, dai->component->regmap);
+	ret = __pcm1796_dai_hw_params(substream, params, dai);
+	trace_dd_hw_params(dai->dev, params_rate(params), params_width(params),
+			   ret, &span);
+	dd_hist_add(&data->stats.hw_params, span.start);
+	if (!ret)
+		dd_rate_switch(data->stats.rate_switches, &data->stats.rate,
+			       params_rate(params));
+	return ret;
+}
+
 #ifdef PCM1796_MUTE_SWITCH
 static int pcm1796_digital_playback_switch_get(struct snd_kcontrol *kcontrol,
 					    struct snd_ctl_elem_value *ucontrol)
@@ -424,31 +543,17 @@ static int pcm1796_digital_playback_switch_get(struct snd_kcontrol *kcontrol,
 	struct pcm1796_drvdata *data = snd_soc_component_get_drvdata(component);
 	struct device *dev = component->dev;
 
-	mutex_lock(&data->mutex);
 #ifdef DEBUG
-	dev_dbg(dev, "%s: ENTER\n", __func__);
+	dd_trace(dev, "%s: ENTER\n", __func__);
 #endif /* DEBUG */
-#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,9,0)
-	mute = snd_soc_component_read(component, PCM1796_REG18_MUTE);
-#else
-	mute = snd_soc_component_read32(component, PCM1796_REG18_MUTE);
-#endif /* LINUX_VERSION_CODE >= KERNEL_VERSION(5,9,0) */
-	if (mute < 0) {
-		dev_err(dev, "%s: EXIT [%d]: error reading REG18_MUTE!\n",
-			__func__, mute);
-		mutex_unlock(&data->mutex);
-		return mute;
-	}
-
-	mute = !(mute & PCM1796_REG18_MUTE_MASK);
+	mute = !(READ_ONCE(data->mute) & 0x1);
 #ifdef DDEBUG
 	dev_dbg(dev, "%s: populate ucontrol value=%d", __func__, mute);
 #endif /* DDEBUG */
 	ucontrol->value.integer.value[0] = mute;
 #ifdef DEBUG
-	dev_dbg(dev, "%s: EXIT [0]\n", __func__);
+	dd_trace(dev, "%s: EXIT [0]\n", __func__);
 #endif /* DEBUG */
-	mutex_unlock(&data->mutex);
 	return 0;
 }
 
@@ -460,7 +565,7 @@ static int pcm1796_digital_playback_switch_put(struct snd_kcontrol *kcontrol,
 					snd_soc_kcontrol_component(kcontrol);
 	struct device *dev = component->dev;
 #ifdef DEBUG
-	dev_dbg(dev, "%s: ENTER\n", __func__);
+	dd_trace(dev, "%s: ENTER\n", __func__);
 #endif /* DEBUG */
 	ret = pcm1796_mute_stream(component, mute);
 	if (ret < 0) {
@@ -469,11 +574,32 @@ static int pcm1796_digital_playback_switch_put(struct snd_kcontrol *kcontrol,
 		return ret;
 	}	
 #ifdef DEBUG
-	dev_dbg(dev, "%s: EXIT [%d]\n", __func__, ret);
+	dd_trace(dev, "%s: EXIT [%d]\n", __func__, ret);
 #endif /* DEBUG */
 	return ret;
 }
 #endif /* PCM1796_MUTE_SWITCH */
+#ifdef DD_VOLUME_COALESCE
+static int pcm1796_digital_playback_volume_get(struct snd_kcontrol *kcontrol,
+					    struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+					snd_soc_kcontrol_component(kcontrol);
+	struct pcm1796_drvdata *data = snd_soc_component_get_drvdata(component);
+
+	return dd_vol_get(&data->vol, kcontrol, ucontrol);
+}
+
+static int pcm1796_digital_playback_volume_put(struct snd_kcontrol *kcontrol,
+					    struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+					snd_soc_kcontrol_component(kcontrol);
+	struct pcm1796_drvdata *data = snd_soc_component_get_drvdata(component);
+
+	return dd_vol_put(&data->vol, kcontrol, ucontrol);
+}
+#endif /* DD_VOLUME_COALESCE */
 /* Output Phase Reversal */
 static const char * const pcm1796_channel_polarity_texts[] = {
 	"Normal", "Invert",
@@ -493,6 +619,22 @@ static SOC_ENUM_SINGLE_DECL(pcm1796_filter_shape_enum, /* name */
 			    PCM1796_REG19_FLT_SHIFT, /* xshift */
 			    pcm1796_filter_shape_texts /* xtexts */ );
 
+/* group delay per roll-off, from the datasheet digital filter tables */
+static const struct dd_filter_delay pcm1796_filter_delays[] = {
+	{ 0, 550 },	/* Sharp Roll-Off */
+	{ 1, 180 },	/* Slow Roll-Off */
+};
+
+static int pcm1796_filter_shape_put(struct snd_kcontrol *kcontrol,
+				    struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+					snd_soc_kcontrol_component(kcontrol);
+	struct pcm1796_drvdata *data = snd_soc_component_get_drvdata(component);
+
+	return dd_filter_put(kcontrol, ucontrol, &data->filter);
+}
+
 /* De-emphasis select */
 static const char * const pcm1796_deemph_select_texts[] = {
 	"Disabled", "48kHz", "44.1kHz", "32kHz",
@@ -525,6 +667,18 @@ static const DECLARE_TLV_DB_SCALE(pcm1796_dac_tlv, -12000, 50, 1);
 
 static const struct snd_kcontrol_new pcm1796_controls[] = {
 	/* Volume Control */
+#ifdef DD_VOLUME_COALESCE
+	DD_VOL_DOUBLE_R_RANGE_TLV("Digital Playback Volume", /* xname */
+			       PCM1796_REG16_ATL, /* reg_left */
+			       PCM1796_REG17_ATR, /* reg_right */
+			       PCM1796_REG16_ATL_SHIFT, /* xshift */
+			       0x0F, /* xmin */
+			       0xFF, /* xmax */
+			       0, /* xinvert */
+			       pcm1796_digital_playback_volume_get,
+			       pcm1796_digital_playback_volume_put,
+			       pcm1796_dac_tlv /* tlv_array */ ),
+#else
 	SOC_DOUBLE_R_RANGE_TLV("Digital Playback Volume", /* xname */
 			       PCM1796_REG16_ATL, /* reg_left */
 			       PCM1796_REG17_ATR, /* reg_right */
@@ -533,6 +687,7 @@ static const struct snd_kcontrol_new pcm1796_controls[] = {
 			       0xFF, /* xmax */
 			       0, /* xinvert */
 			       pcm1796_dac_tlv /* tlv_array */ ),
+#endif /* DD_VOLUME_COALESCE */
 #ifdef PCM1796_MUTE_SWITCH
 	/* Mute */
 	SOC_SINGLE_EXT("Digital Playback Switch", /* xname */
@@ -546,7 +701,8 @@ static const struct snd_kcontrol_new pcm1796_controls[] = {
 	/* Output Phase Reversal */
 	SOC_ENUM("Phase", pcm1796_polarity_enum),
 	/* Digital Filter Roll-off Control */
-	SOC_ENUM("Filter", pcm1796_filter_shape_enum),
+	SOC_ENUM_EXT("Filter", pcm1796_filter_shape_enum,
+		     snd_soc_get_enum_double, pcm1796_filter_shape_put),
 	/* De-emphasis filter enable/disable */
 	SOC_SINGLE("De-Em", PCM1796_REG18_DME, PCM1796_REG18_DME_SHIFT, 1, 0),
 	/* De-emphasis filter frequency select */
@@ -581,7 +737,49 @@ static const struct snd_soc_dapm_route pcm1796_dapm_routes[] = {
 	{ "IOUTR-", NULL, "IDACR-" },
 };
 
+#ifdef CONFIG_DEBUG_FS
+static void pcm1796_debugfs_init(struct snd_soc_component *component)
+{
+	struct pcm1796_drvdata *data = snd_soc_component_get_drvdata(component);
+	struct dentry *dentry = component->debugfs_root;
+
+	dd_regmap_i2c_debugfs(dev_get_regmap(component->dev, NULL), dentry);
+	dd_rate_switches_debugfs(dentry, data->stats.rate_switches);
+	dd_hist_debugfs("hw_params_us", dentry, &data->stats.hw_params);
+	dd_hist_debugfs("mute_stream_us", dentry, &data->stats.mute_stream);
+}
+#endif /* CONFIG_DEBUG_FS */
+
+static int pcm1796_component_probe(struct snd_soc_component *component)
+{
+	dd_trace(component->dev, "%s: ENTER\n", __func__);
+
+#ifdef CONFIG_DEBUG_FS
+	pcm1796_debugfs_init(component);
+#endif /* CONFIG_DEBUG_FS */
+
+	dd_trace(component->dev, "%s: EXIT [0]\n", __func__);
+	return 0;
+}
+
+#ifdef DD_VOLUME_COALESCE
+/* land any pending volume before the system sleeps */
+static int pcm1796_component_suspend(struct snd_soc_component *component)
+{
+	struct pcm1796_drvdata *data = snd_soc_component_get_drvdata(component);
+
+	dd_trace(component->dev, "%s: ENTER\n", __func__);
+	dd_vol_flush(&data->vol);
+	dd_trace(component->dev, "%s: EXIT [0]\n", __func__);
+	return 0;
+}
+#endif /* DD_VOLUME_COALESCE */
+
 static const struct snd_soc_component_driver pcm1796_comp_drv = {
+	.probe                 = pcm1796_component_probe,
+#ifdef DD_VOLUME_COALESCE
+	.suspend               = pcm1796_component_suspend,
+#endif /* DD_VOLUME_COALESCE */
 	.controls              = pcm1796_controls,
 	.num_controls          = ARRAY_SIZE(pcm1796_controls),
 	.dapm_widgets          = pcm1796_dapm_widgets,
@@ -594,12 +792,32 @@ static const struct snd_soc_component_driver pcm1796_comp_drv = {
 	.non_legacy_dai_naming = 1,
 };
 
+/*
+ * Called with the stream lock held, so no register access: the roll-off
+ * comes from the value recorded by the Filter put.
+ */
+static snd_pcm_sframes_t pcm1796_dai_delay(struct snd_pcm_substream *substream,
+					   struct snd_soc_dai *dai)
+{
+	struct pcm1796_drvdata *data =
+				snd_soc_component_get_drvdata(dai->component);
+
+	return dd_filter_delay(pcm1796_filter_delays,
+			       ARRAY_SIZE(pcm1796_filter_delays),
+			       READ_ONCE(data->filter));
+}
+
 static const struct snd_soc_dai_ops pcm1796_dai_ops = {
+#ifdef PCM1796_SCLK_ON_DEMAND
+	.startup         = pcm1796_dai_startup,
+	.shutdown        = pcm1796_dai_shutdown,
+#endif /* PCM1796_SCLK_ON_DEMAND */
 	.set_fmt         = pcm1796_dai_set_fmt,
 	.set_bclk_ratio  = pcm1796_dai_set_bclk_ratio,
 	.hw_params       = pcm1796_dai_hw_params,
 	.mute_stream     = pcm1796_dai_mute_stream,
 	.set_sysclk      = pcm1796_dai_set_sysclk,
+	.delay           = pcm1796_dai_delay,
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(5,9,0)
 	.no_capture_mute = 1,
 #endif
@@ -639,7 +857,7 @@ int pcm1796_probe(struct device *dev, struct regmap *regmap)
 	int ret;
 	struct pcm1796_drvdata *data;
 
-	dev_dbg(dev, "%s: ENTER\n", __func__);
+	dd_trace(dev, "%s: ENTER\n", __func__);
 
 	/*
 	 * allocate memory for private data
@@ -655,6 +873,9 @@ int pcm1796_probe(struct device *dev, struct regmap *regmap)
 	}
 
 	mutex_init(&data->mutex);
+#ifdef DD_VOLUME_COALESCE
+	dd_vol_init(&data->vol, regmap, PCM1796_REG16_ATL);
+#endif /* DD_VOLUME_COALESCE */
 	dev_set_drvdata(dev, data);
 
 	/*
@@ -784,6 +1005,8 @@ int pcm1796_probe(struct device *dev, struct regmap *regmap)
 	if (ret < 0)
 		dev_warn(dev, "%s: failed to set REG18_MUTE_ENABLE: "
 			 "[%d]\n", __func__, ret);
+	else
+		WRITE_ONCE(data->mute, 1);
 
 	/*
 	 * disable analogue output
@@ -835,7 +1058,12 @@ int pcm1796_probe(struct device *dev, struct regmap *regmap)
 		goto gpio_err;
         }
 
-        dev_dbg(dev, "%s: EXIT [0]\n", __func__);
+#ifdef PCM1796_SCLK_ON_DEMAND
+	/* reset is done, from now on sclk is held by open streams only */
+	clk_disable_unprepare(data->sclk);
+#endif /* PCM1796_SCLK_ON_DEMAND */
+
+        dd_trace(dev, "%s: EXIT [0]\n", __func__);
 
 	return 0;
 
@@ -860,7 +1088,7 @@ clk_err:
 		else
 			dev_err(dev, "%s: EXIT [%d]\n", __func__, ret);
 	} else
-		dev_dbg(dev, "%s: EXIT [%d]\n", __func__, ret);
+		dd_trace(dev, "%s: EXIT [%d]\n", __func__, ret);
 
 	return ret;
 }
@@ -870,7 +1098,11 @@ void pcm1796_remove(struct device *dev)
 {
 	struct pcm1796_drvdata *data = dev_get_drvdata(dev);
 
-        dev_dbg(dev, "%s: ENTER\n", __func__);
+        dd_trace(dev, "%s: ENTER\n", __func__);
+
+#ifdef DD_VOLUME_COALESCE
+	dd_vol_cancel(&data->vol);
+#endif /* DD_VOLUME_COALESCE */
 
         /* gpio mute */
         if (data->mute_gpio) {
@@ -881,11 +1113,13 @@ void pcm1796_remove(struct device *dev)
 		gpiod_set_raw_value_cansleep(data->mute_gpio, 0);
 	}
 
+#ifndef PCM1796_SCLK_ON_DEMAND
 	/* disable/unprepare clock */
 #ifdef DDEBUG
 	dev_dbg(dev, "%s: clk_disable_unprepare(sclk)\n", __func__);
 #endif /* DDEBUG */
 	clk_disable_unprepare(data->sclk);
+#endif /* PCM1796_SCLK_ON_DEMAND */
 
 	/* put DAC into RESET */
 #ifdef DDEBUG
@@ -893,7 +1127,7 @@ void pcm1796_remove(struct device *dev)
 #endif /* DDEBUG */
 	gpiod_set_raw_value_cansleep(data->reset_gpio, 0);
 
-	dev_dbg(dev, "%s: EXIT [void]\n", __func__);
+	dd_trace(dev, "%s: EXIT [void]\n", __func__);
 }
 EXPORT_SYMBOL_GPL(pcm1796_remove);
 
@@ -0,0 +1,1218 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * dd-latency-bench.c
+ *
+ * Userspace latency benchmark for the hb-dacplus and hb-dac2hd cards, real
+ * or emulated (README.dd-emu). Times, in loops, the paths the drivers
+ * optimise:
+ *
+ *  open   open -> hw_params -> prepare -> first period consumed -> close
+ *  rate   back-to-back rate switches (hw_free -> hw_params -> prepare ->
+ *         first period) across dac2hd_rates/zpcm512x_dai_rates
+ *  pause  pause push/release round trip on a running stream (mute_stream),
+ *         or drop -> prepare -> start where the device cannot pause
+ *  mixer  control write -> return, and -> register commit on the bus
+ *
+ * and reports percentiles, together with the change in the drivers'
+ * debugfs transaction counters (i2c_reads, i2c_writes, pll_resets, ...)
+ * over each test.
+ *
+ * Author: Clive Messer <clive.messer@digitaldreamtime.co.uk>
+ *         Copyright (c) Digital Dreamtime Ltd 2020-2021
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#define _GNU_SOURCE
+#include <alsa/asoundlib.h>
+#include <dirent.h>
+#include <errno.h>
+#include <getopt.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DRV_VERSION "1.0.0"
+
+#define ARRAY_SIZE(a)	(sizeof(a) / sizeof((a)[0]))
+
+/* as hifiberry_dac2hd.c and zpcm512x.c */
+static const unsigned int dac2hd_rates[] = {
+	44100, 48000, 88200, 96000, 176400, 192000,
+};
+
+static const unsigned int zpcm512x_dai_rates[] = {
+	8000, 11025, 16000, 22050, 32000, 44100, 48000, 64000,
+	88200, 96000, 176400, 192000, 352800, 384000,
+};
+
+/* monotonically increasing debugfs counters, see dd-utils.c */
+static const char * const bench_counter_names[] = {
+	"i2c_reads", "i2c_writes",
+	"rate_switches_44k1", "rate_switches_48k",
+	"pll_resets", "fast_switches", "lock_timeouts",
+	"resumes", "state_restores",
+	"mute_poll_timeouts", "clk_detect_errors",
+};
+
+#define BENCH_TEST_OPEN		(1 << 0)
+#define BENCH_TEST_RATE		(1 << 1)
+#define BENCH_TEST_PAUSE	(1 << 2)
+#define BENCH_TEST_MIXER	(1 << 3)
+#define BENCH_TEST_ALL		(BENCH_TEST_OPEN | BENCH_TEST_RATE |\
+				 BENCH_TEST_PAUSE | BENCH_TEST_MIXER)
+
+#define BENCH_MAX_RATES		32
+#define BENCH_COMMIT_TIMEOUT_US	100000
+
+struct bench_opts {
+	const char *device;
+	const char *control;
+	const char *debugfs;
+	unsigned int tests;
+	unsigned int loops;
+	unsigned int warmup;
+	unsigned int idle_ms;
+	unsigned int rate;
+	unsigned int rates[BENCH_MAX_RATES];
+	unsigned int num_rates;
+	snd_pcm_format_t format;
+	snd_pcm_uframes_t period;
+	unsigned int periods;
+	char ctl_name[32];
+};
+
+struct bench_samples {
+	const char *name;
+	double *v;
+	unsigned int n;
+	unsigned int size;
+};
+
+struct bench_counter {
+	char path[PATH_MAX];
+	unsigned long long val;
+};
+
+struct bench_counters {
+	struct bench_counter *c;
+	unsigned int n;
+	unsigned int size;
+};
+
+/* a configured playback stream */
+struct bench_pcm {
+	snd_pcm_t *pcm;
+	snd_pcm_uframes_t period;
+	snd_pcm_uframes_t buffer;
+	unsigned int frame_bytes;
+	void *silence;
+};
+
+static double bench_now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/*
+ * SAMPLES
+ */
+static void bench_samples_init(struct bench_samples *s, const char *name)
+{
+	memset(s, 0, sizeof(*s));
+	s->name = name;
+}
+
+static void bench_samples_add(struct bench_samples *s, double us)
+{
+	if (s->n == s->size) {
+		s->size = s->size ? s->size * 2 : 64;
+		s->v = realloc(s->v, s->size * sizeof(*s->v));
+		if (!s->v) {
+			perror("realloc");
+			exit(EXIT_FAILURE);
+		}
+	}
+	s->v[s->n++] = us;
+}
+
+static int bench_cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+/* nearest rank */
+static double bench_percentile(const struct bench_samples *s, double p)
+{
+	unsigned int rank = (unsigned int)(p / 100.0 * s->n + 0.999999);
+
+	return s->v[rank ? rank - 1 : 0];
+}
+
+static void bench_report_header(void)
+{
+	printf("  %-26s %6s %9s %9s %9s %9s %9s %9s\n", "(us)", "n",
+	       "min", "p50", "p90", "p99", "max", "mean");
+}
+
+static void bench_report(struct bench_samples *s)
+{
+	double sum = 0;
+	unsigned int i;
+
+	if (!s->n)
+		return;
+
+	qsort(s->v, s->n, sizeof(*s->v), bench_cmp_double);
+	for (i = 0; i < s->n; i++)
+		sum += s->v[i];
+
+	printf("  %-26s %6u %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f\n",
+	       s->name, s->n, s->v[0], bench_percentile(s, 50),
+	       bench_percentile(s, 90), bench_percentile(s, 99),
+	       s->v[s->n - 1], sum / s->n);
+}
+
+static void bench_samples_free(struct bench_samples *s)
+{
+	free(s->v);
+	s->v = NULL;
+	s->n = s->size = 0;
+}
+
+/*
+ * DRIVER STATS
+ *
+ * Every whitelisted counter below <debugfs>/asoc and <debugfs>/clk, where
+ * the codec, machine and clock drivers create theirs.
+ */
+static bool bench_is_counter(const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(bench_counter_names); i++)
+		if (!strcmp(name, bench_counter_names[i]))
+			return true;
+
+	return false;
+}
+
+static int bench_read_ull(const char *path, unsigned long long *val)
+{
+	FILE *f = fopen(path, "r");
+	int ret;
+
+	if (!f)
+		return -errno;
+	ret = fscanf(f, "%llu", val) == 1 ? 0 : -EINVAL;
+	fclose(f);
+
+	return ret;
+}
+
+static void bench_counters_scan(struct bench_counters *cs, const char *dir,
+				int depth)
+{
+	struct dirent *de;
+	struct stat st;
+	char path[PATH_MAX];
+	DIR *d;
+
+	if (depth > 6)
+		return;
+	d = opendir(dir);
+	if (!d)
+		return;
+
+	while ((de = readdir(d))) {
+		if (de->d_name[0] == '.')
+			continue;
+		snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+		if (lstat(path, &st))
+			continue;
+		if (S_ISDIR(st.st_mode)) {
+			bench_counters_scan(cs, path, depth + 1);
+			continue;
+		}
+		if (!S_ISREG(st.st_mode) || !bench_is_counter(de->d_name))
+			continue;
+
+		if (cs->n == cs->size) {
+			cs->size = cs->size ? cs->size * 2 : 32;
+			cs->c = realloc(cs->c, cs->size * sizeof(*cs->c));
+			if (!cs->c) {
+				perror("realloc");
+				exit(EXIT_FAILURE);
+			}
+		}
+		snprintf(cs->c[cs->n].path, sizeof(cs->c[cs->n].path), "%s",
+			 path);
+		if (!bench_read_ull(path, &cs->c[cs->n].val))
+			cs->n++;
+	}
+	closedir(d);
+}
+
+static void bench_counters_snapshot(struct bench_counters *cs,
+				    const char *debugfs)
+{
+	char dir[PATH_MAX];
+
+	cs->n = 0;
+	snprintf(dir, sizeof(dir), "%s/asoc", debugfs);
+	bench_counters_scan(cs, dir, 0);
+	snprintf(dir, sizeof(dir), "%s/clk", debugfs);
+	bench_counters_scan(cs, dir, 0);
+}
+
+static void bench_counters_report(const struct bench_counters *before,
+				  const struct bench_counters *after,
+				  const char *debugfs, unsigned int loops)
+{
+	size_t skip = strlen(debugfs) + 1;
+	unsigned long long delta;
+	unsigned int i, j;
+	bool any = false;
+
+	if (!after->n) {
+		printf("  driver stats: none found below %s (not mounted, "
+		       "not root or built without CONFIG_DEBUG_FS)\n",
+		       debugfs);
+		return;
+	}
+
+	for (i = 0; i < after->n; i++) {
+		delta = after->c[i].val;
+		for (j = 0; j < before->n; j++) {
+			if (!strcmp(before->c[j].path, after->c[i].path)) {
+				delta -= before->c[j].val;
+				break;
+			}
+		}
+		if (!delta)
+			continue;
+		if (!any)
+			printf("  %-54s %9s %9s\n", "driver stats", "delta",
+			       "per loop");
+		any = true;
+		printf("  %-54s %9llu %9.2f\n", after->c[i].path + skip, delta,
+		       (double)delta / loops);
+	}
+	if (!any)
+		printf("  driver stats: no change\n");
+}
+
+/* sum of every i2c_writes counter below <debugfs>/asoc */
+static unsigned long long bench_asoc_writes(const struct bench_counters *cs)
+{
+	unsigned long long sum = 0, val;
+	const char *name;
+	unsigned int i;
+
+	for (i = 0; i < cs->n; i++) {
+		name = strrchr(cs->c[i].path, '/');
+		if (!name || strcmp(name + 1, "i2c_writes") ||
+		    !strstr(cs->c[i].path, "/asoc/"))
+			continue;
+		if (!bench_read_ull(cs->c[i].path, &val))
+			sum += val;
+	}
+
+	return sum;
+}
+
+/*
+ * PCM
+ */
+static int bench_pcm_hw(struct bench_pcm *bp, const struct bench_opts *opts,
+			unsigned int rate)
+{
+	snd_pcm_hw_params_t *hw;
+	snd_pcm_uframes_t period = opts->period;
+	unsigned int periods = opts->periods;
+	int err;
+
+	snd_pcm_hw_params_alloca(&hw);
+	err = snd_pcm_hw_params_any(bp->pcm, hw);
+	if (!err)
+		err = snd_pcm_hw_params_set_access(bp->pcm, hw,
+					SND_PCM_ACCESS_RW_INTERLEAVED);
+	if (!err)
+		err = snd_pcm_hw_params_set_format(bp->pcm, hw, opts->format);
+	if (!err)
+		err = snd_pcm_hw_params_set_channels(bp->pcm, hw, 2);
+	if (!err)
+		err = snd_pcm_hw_params_set_rate(bp->pcm, hw, rate, 0);
+	if (!err)
+		err = snd_pcm_hw_params_set_period_size_near(bp->pcm, hw,
+							     &period, NULL);
+	if (!err)
+		err = snd_pcm_hw_params_set_periods_near(bp->pcm, hw,
+							 &periods, NULL);
+	if (!err)
+		err = snd_pcm_hw_params(bp->pcm, hw);
+	if (err < 0) {
+		fprintf(stderr, "hw_params(%u): %s\n", rate, snd_strerror(err));
+		return err;
+	}
+
+	snd_pcm_hw_params_get_period_size(hw, &bp->period, NULL);
+	snd_pcm_hw_params_get_buffer_size(hw, &bp->buffer);
+	bp->frame_bytes = snd_pcm_format_physical_width(opts->format) / 8 * 2;
+
+	return 0;
+}
+
+/*
+ * Start on the first period written. With free_run the stream never
+ * stops on underrun but plays silence, so it can be left running while
+ * pause and mixer writes are timed.
+ */
+static int bench_pcm_sw(struct bench_pcm *bp, bool free_run)
+{
+	snd_pcm_sw_params_t *sw;
+	snd_pcm_uframes_t boundary;
+	int err;
+
+	snd_pcm_sw_params_alloca(&sw);
+	err = snd_pcm_sw_params_current(bp->pcm, sw);
+	if (!err)
+		err = snd_pcm_sw_params_set_start_threshold(bp->pcm, sw,
+							    bp->period);
+	if (!err)
+		err = snd_pcm_sw_params_set_avail_min(bp->pcm, sw, bp->period);
+	if (!err && free_run) {
+		err = snd_pcm_sw_params_get_boundary(sw, &boundary);
+		if (!err)
+			err = snd_pcm_sw_params_set_stop_threshold(bp->pcm, sw,
+								   boundary);
+		if (!err)
+			err = snd_pcm_sw_params_set_silence_size(bp->pcm, sw,
+								 boundary);
+	}
+	if (!err)
+		err = snd_pcm_sw_params(bp->pcm, sw);
+	if (err < 0) {
+		fprintf(stderr, "sw_params: %s\n", snd_strerror(err));
+		return err;
+	}
+
+	return 0;
+}
+
+static int bench_pcm_silence(struct bench_pcm *bp)
+{
+	free(bp->silence);
+	bp->silence = calloc(bp->buffer, bp->frame_bytes);
+	if (!bp->silence)
+		return -ENOMEM;
+
+	return 0;
+}
+
+/*
+ * Fill the whole buffer, which starts the stream, and return once the
+ * first period has been consumed. *start is when the write began.
+ */
+static int bench_pcm_first_period(struct bench_pcm *bp, double *start)
+{
+	snd_pcm_sframes_t frames;
+	int err;
+
+	*start = bench_now_us();
+	frames = snd_pcm_writei(bp->pcm, bp->silence, bp->buffer);
+	if (frames < 0) {
+		fprintf(stderr, "writei: %s\n", snd_strerror(frames));
+		return frames;
+	}
+	err = snd_pcm_wait(bp->pcm, 1000);
+	if (err < 0) {
+		fprintf(stderr, "wait: %s\n", snd_strerror(err));
+		return err;
+	}
+	if (!err) {
+		fprintf(stderr, "wait: timed out after 1s\n");
+		return -ETIMEDOUT;
+	}
+
+	return 0;
+}
+
+static int bench_pcm_open(struct bench_pcm *bp, const struct bench_opts *opts)
+{
+	int err;
+
+	memset(bp, 0, sizeof(*bp));
+	err = snd_pcm_open(&bp->pcm, opts->device, SND_PCM_STREAM_PLAYBACK, 0);
+	if (err < 0)
+		fprintf(stderr, "open %s: %s\n", opts->device,
+			snd_strerror(err));
+
+	return err;
+}
+
+static void bench_pcm_close(struct bench_pcm *bp)
+{
+	if (bp->pcm)
+		snd_pcm_close(bp->pcm);
+	free(bp->silence);
+	memset(bp, 0, sizeof(*bp));
+}
+
+static double bench_period_us(const struct bench_pcm *bp, unsigned int rate)
+{
+	return bp->period * 1e6 / rate;
+}
+
+/*
+ * TESTS
+ */
+static int bench_test_open(const struct bench_opts *opts)
+{
+	struct bench_samples s_open, s_hw, s_prep, s_first, s_excess, s_close,
+			     s_total;
+	struct bench_counters before = { 0 }, after = { 0 };
+	struct bench_pcm bp;
+	double t0, t1, t2, t3, t4, t5, tw, period_us;
+	unsigned int i;
+	int err = 0;
+
+	bench_samples_init(&s_open, "open");
+	bench_samples_init(&s_hw, "hw_params");
+	bench_samples_init(&s_prep, "prepare");
+	bench_samples_init(&s_first, "first_period");
+	bench_samples_init(&s_excess, "first_period-period_time");
+	bench_samples_init(&s_close, "close");
+	bench_samples_init(&s_total, "open->first_period");
+
+	printf("\nopen: open -> hw_params -> prepare -> first period -> "
+	       "close @ %uHz\n", opts->rate);
+
+	for (i = 0; i < opts->warmup + opts->loops; i++) {
+		if (i == opts->warmup)
+			bench_counters_snapshot(&before, opts->debugfs);
+
+		t0 = bench_now_us();
+		err = bench_pcm_open(&bp, opts);
+		if (err < 0)
+			break;
+		t1 = bench_now_us();
+		err = bench_pcm_hw(&bp, opts, opts->rate);
+		period_us = bench_period_us(&bp, opts->rate);
+		if (!err)
+			err = bench_pcm_sw(&bp, false);
+		if (!err)
+			err = bench_pcm_silence(&bp);
+		t2 = bench_now_us();
+		if (!err)
+			err = snd_pcm_prepare(bp.pcm);
+		t3 = bench_now_us();
+		if (!err)
+			err = bench_pcm_first_period(&bp, &tw);
+		t4 = bench_now_us();
+		if (!err)
+			err = snd_pcm_drop(bp.pcm);
+		bench_pcm_close(&bp);
+		t5 = bench_now_us();
+		if (err < 0)
+			break;
+
+		if (i >= opts->warmup) {
+			bench_samples_add(&s_open, t1 - t0);
+			bench_samples_add(&s_hw, t2 - t1);
+			bench_samples_add(&s_prep, t3 - t2);
+			bench_samples_add(&s_first, t4 - t3);
+			bench_samples_add(&s_excess, t4 - tw - period_us);
+			bench_samples_add(&s_close, t5 - t4);
+			bench_samples_add(&s_total, t4 - t0);
+		}
+		if (opts->idle_ms)
+			usleep(opts->idle_ms * 1000);
+	}
+	bench_counters_snapshot(&after, opts->debugfs);
+
+	bench_report_header();
+	bench_report(&s_open);
+	bench_report(&s_hw);
+	bench_report(&s_prep);
+	bench_report(&s_first);
+	bench_report(&s_excess);
+	bench_report(&s_close);
+	bench_report(&s_total);
+	bench_counters_report(&before, &after, opts->debugfs, opts->loops);
+
+	bench_samples_free(&s_open);
+	bench_samples_free(&s_hw);
+	bench_samples_free(&s_prep);
+	bench_samples_free(&s_first);
+	bench_samples_free(&s_excess);
+	bench_samples_free(&s_close);
+	bench_samples_free(&s_total);
+	free(before.c);
+	free(after.c);
+
+	return err;
+}
+
+static bool bench_same_family(unsigned int a, unsigned int b)
+{
+	return !(a % 11025) == !(b % 11025);
+}
+
+static int bench_test_rate(const struct bench_opts *opts)
+{
+	struct bench_samples s_hw, s_prep, s_first, s_same, s_cross;
+	struct bench_counters before = { 0 }, after = { 0 };
+	struct bench_pcm bp;
+	unsigned int i, rate, last;
+	double t0, t1, t2, t3, tw;
+	int err;
+
+	if (opts->num_rates < 2) {
+		printf("\nrate: skipped, fewer than two usable rates\n");
+		return 0;
+	}
+
+	bench_samples_init(&s_hw, "hw_free+hw_params");
+	bench_samples_init(&s_prep, "prepare");
+	bench_samples_init(&s_first, "first_period");
+	bench_samples_init(&s_same, "switch (same family)");
+	bench_samples_init(&s_cross, "switch (44k1<->48k)");
+
+	printf("\nrate: hw_free -> hw_params -> prepare -> first period, "
+	       "cycling");
+	for (i = 0; i < opts->num_rates; i++)
+		printf(" %u", opts->rates[i]);
+	printf("\n");
+
+	err = bench_pcm_open(&bp, opts);
+	if (err < 0)
+		return err;
+	last = opts->rates[opts->num_rates - 1];
+	err = bench_pcm_hw(&bp, opts, last);
+	if (err < 0)
+		goto out;
+
+	for (i = 0; i < opts->warmup + opts->loops; i++) {
+		if (i == opts->warmup)
+			bench_counters_snapshot(&before, opts->debugfs);
+		rate = opts->rates[i % opts->num_rates];
+
+		t0 = bench_now_us();
+		err = snd_pcm_drop(bp.pcm);
+		if (!err)
+			err = snd_pcm_hw_free(bp.pcm);
+		if (!err)
+			err = bench_pcm_hw(&bp, opts, rate);
+		if (!err)
+			err = bench_pcm_sw(&bp, false);
+		if (!err)
+			err = bench_pcm_silence(&bp);
+		t1 = bench_now_us();
+		if (!err)
+			err = snd_pcm_prepare(bp.pcm);
+		t2 = bench_now_us();
+		if (!err)
+			err = bench_pcm_first_period(&bp, &tw);
+		t3 = bench_now_us();
+		if (err < 0)
+			break;
+
+		if (i >= opts->warmup) {
+			bench_samples_add(&s_hw, t1 - t0);
+			bench_samples_add(&s_prep, t2 - t1);
+			bench_samples_add(&s_first, t3 - t2);
+			/* switch cost without the period itself */
+			bench_samples_add(bench_same_family(rate, last) ?
+					  &s_same : &s_cross,
+					  t3 - t0 - bench_period_us(&bp, rate));
+		}
+		last = rate;
+	}
+	snd_pcm_drop(bp.pcm);
+	bench_counters_snapshot(&after, opts->debugfs);
+
+	bench_report_header();
+	bench_report(&s_hw);
+	bench_report(&s_prep);
+	bench_report(&s_first);
+	bench_report(&s_same);
+	bench_report(&s_cross);
+	bench_counters_report(&before, &after, opts->debugfs, opts->loops);
+
+out:
+	bench_pcm_close(&bp);
+	bench_samples_free(&s_hw);
+	bench_samples_free(&s_prep);
+	bench_samples_free(&s_first);
+	bench_samples_free(&s_same);
+	bench_samples_free(&s_cross);
+	free(before.c);
+	free(after.c);
+
+	return err;
+}
+
+/* open, configure free running and start a stream for pause/mixer */
+static int bench_pcm_run(struct bench_pcm *bp, const struct bench_opts *opts)
+{
+	double tw;
+	int err;
+
+	err = bench_pcm_open(bp, opts);
+	if (err < 0)
+		return err;
+	err = bench_pcm_hw(bp, opts, opts->rate);
+	if (!err)
+		err = bench_pcm_sw(bp, true);
+	if (!err)
+		err = bench_pcm_silence(bp);
+	if (!err)
+		err = snd_pcm_prepare(bp->pcm);
+	if (!err)
+		err = bench_pcm_first_period(bp, &tw);
+	if (err < 0)
+		bench_pcm_close(bp);
+
+	return err;
+}
+
+static int bench_test_pause(const struct bench_opts *opts)
+{
+	struct bench_samples s_push, s_release, s_round;
+	struct bench_counters before = { 0 }, after = { 0 };
+	struct bench_pcm bp;
+	snd_pcm_hw_params_t *hw;
+	double t0, t1, t2, tw;
+	unsigned int i;
+	bool can_pause;
+	int err;
+
+	err = bench_pcm_run(&bp, opts);
+	if (err < 0)
+		return err;
+
+	snd_pcm_hw_params_alloca(&hw);
+	snd_pcm_hw_params_current(bp.pcm, hw);
+	can_pause = snd_pcm_hw_params_can_pause(hw);
+
+	if (can_pause) {
+		bench_samples_init(&s_push, "pause push");
+		bench_samples_init(&s_release, "pause release");
+		printf("\npause: pause push -> pause release @ %uHz\n",
+		       opts->rate);
+	} else {
+		bench_samples_init(&s_push, "drop");
+		bench_samples_init(&s_release, "prepare+start");
+		printf("\npause: device cannot pause, drop -> prepare -> "
+		       "start @ %uHz\n", opts->rate);
+	}
+	bench_samples_init(&s_round, "round trip");
+
+	for (i = 0; i < opts->warmup + opts->loops; i++) {
+		if (i == opts->warmup)
+			bench_counters_snapshot(&before, opts->debugfs);
+
+		t0 = bench_now_us();
+		if (can_pause)
+			err = snd_pcm_pause(bp.pcm, 1);
+		else
+			err = snd_pcm_drop(bp.pcm);
+		t1 = bench_now_us();
+		if (!err && can_pause) {
+			err = snd_pcm_pause(bp.pcm, 0);
+		} else if (!err) {
+			err = snd_pcm_prepare(bp.pcm);
+			if (!err)
+				err = bench_pcm_first_period(&bp, &tw);
+		}
+		t2 = bench_now_us();
+		if (err < 0) {
+			fprintf(stderr, "pause: %s\n", snd_strerror(err));
+			break;
+		}
+
+		if (i >= opts->warmup) {
+			bench_samples_add(&s_push, t1 - t0);
+			bench_samples_add(&s_release, t2 - t1);
+			bench_samples_add(&s_round, t2 - t0);
+		}
+		/* let the (async) unmute settle before the next mute */
+		usleep(bench_period_us(&bp, opts->rate));
+	}
+	bench_counters_snapshot(&after, opts->debugfs);
+
+	bench_report_header();
+	bench_report(&s_push);
+	bench_report(&s_release);
+	bench_report(&s_round);
+	bench_counters_report(&before, &after, opts->debugfs, opts->loops);
+
+	snd_pcm_drop(bp.pcm);
+	bench_pcm_close(&bp);
+	bench_samples_free(&s_push);
+	bench_samples_free(&s_release);
+	bench_samples_free(&s_round);
+	free(before.c);
+	free(after.c);
+
+	return err;
+}
+
+/*
+ * Time the control write ioctl and, when the driver stats are readable,
+ * until the codec's i2c_writes counter moves, i.e. the value reached the
+ * chip. Runs against a playing stream so the codec is not runtime
+ * suspended (cache only) and the volume coalescing worker is exercised.
+ */
+static int bench_test_mixer(const struct bench_opts *opts)
+{
+	struct bench_samples s_write, s_commit;
+	struct bench_counters before = { 0 }, after = { 0 };
+	snd_ctl_elem_value_t *val, *orig;
+	snd_ctl_elem_info_t *info;
+	snd_ctl_elem_id_t *id;
+	struct bench_pcm bp;
+	snd_ctl_t *ctl;
+	unsigned long long writes;
+	unsigned int i, j, count;
+	long v, vmin, vmax;
+	double t0, t1, t2;
+	bool commit;
+	int err;
+
+	err = snd_ctl_open(&ctl, opts->ctl_name, 0);
+	if (err < 0) {
+		fprintf(stderr, "ctl open %s: %s\n", opts->ctl_name,
+			snd_strerror(err));
+		return err;
+	}
+
+	snd_ctl_elem_id_alloca(&id);
+	snd_ctl_elem_info_alloca(&info);
+	snd_ctl_elem_value_alloca(&val);
+	snd_ctl_elem_value_alloca(&orig);
+
+	snd_ctl_elem_id_set_interface(id, SND_CTL_ELEM_IFACE_MIXER);
+	snd_ctl_elem_id_set_name(id, opts->control);
+	snd_ctl_elem_info_set_id(info, id);
+	err = snd_ctl_elem_info(ctl, info);
+	if (err < 0 ||
+	    snd_ctl_elem_info_get_type(info) != SND_CTL_ELEM_TYPE_INTEGER) {
+		printf("\nmixer: skipped, no integer control '%s' on %s\n",
+		       opts->control, opts->ctl_name);
+		snd_ctl_close(ctl);
+		return 0;
+	}
+	count = snd_ctl_elem_info_get_count(info);
+	vmin = snd_ctl_elem_info_get_min(info);
+	vmax = snd_ctl_elem_info_get_max(info);
+
+	snd_ctl_elem_value_set_id(val, id);
+	snd_ctl_elem_value_set_id(orig, id);
+	err = snd_ctl_elem_read(ctl, orig);
+	if (err < 0) {
+		fprintf(stderr, "ctl read: %s\n", snd_strerror(err));
+		snd_ctl_close(ctl);
+		return err;
+	}
+
+	err = bench_pcm_run(&bp, opts);
+	if (err < 0) {
+		snd_ctl_close(ctl);
+		return err;
+	}
+
+	bench_samples_init(&s_write, "write");
+	bench_samples_init(&s_commit, "write->commit");
+	printf("\nmixer: '%s' write -> commit, playing @ %uHz\n",
+	       opts->control, opts->rate);
+
+	for (i = 0; i < opts->warmup + opts->loops; i++) {
+		if (i == opts->warmup)
+			bench_counters_snapshot(&before, opts->debugfs);
+
+		/* toggle between the two top steps, inaudible */
+		v = (i & 1) && vmax > vmin ? vmax - 1 : vmax;
+		for (j = 0; j < count; j++)
+			snd_ctl_elem_value_set_integer(val, j, v);
+
+		bench_counters_snapshot(&after, opts->debugfs);
+		writes = bench_asoc_writes(&after);
+
+		t0 = bench_now_us();
+		err = snd_ctl_elem_write(ctl, val);
+		t1 = bench_now_us();
+		if (err < 0) {
+			fprintf(stderr, "ctl write: %s\n", snd_strerror(err));
+			break;
+		}
+
+		commit = false;
+		t2 = t1;
+		while (after.n && t2 - t0 < BENCH_COMMIT_TIMEOUT_US) {
+			if (bench_asoc_writes(&after) != writes) {
+				commit = true;
+				break;
+			}
+			usleep(20);
+			t2 = bench_now_us();
+		}
+		t2 = bench_now_us();
+
+		if (i >= opts->warmup) {
+			bench_samples_add(&s_write, t1 - t0);
+			if (commit)
+				bench_samples_add(&s_commit, t2 - t0);
+		}
+	}
+	bench_counters_snapshot(&after, opts->debugfs);
+
+	bench_report_header();
+	bench_report(&s_write);
+	if (s_commit.n)
+		bench_report(&s_commit);
+	else
+		printf("  %-26s not observed (needs readable driver stats)\n",
+		       "write->commit");
+	bench_counters_report(&before, &after, opts->debugfs, opts->loops);
+
+	snd_ctl_elem_write(ctl, orig);
+	snd_pcm_drop(bp.pcm);
+	bench_pcm_close(&bp);
+	snd_ctl_close(ctl);
+	bench_samples_free(&s_write);
+	bench_samples_free(&s_commit);
+	free(before.c);
+	free(after.c);
+
+	return err < 0 ? err : 0;
+}
+
+/*
+ * SETUP
+ */
+static void bench_print_emu(void)
+{
+	static const char * const params[] = {
+		"xfer_delay_us", "bus_khz", "dacpro", "pll_lock_us",
+		"mute_ramp_us", "clk_fault",
+	};
+	char path[PATH_MAX], buf[32];
+	unsigned int i;
+	FILE *f;
+
+	for (i = 0; i < ARRAY_SIZE(params); i++) {
+		snprintf(path, sizeof(path),
+			 "/sys/module/snd_soc_dd_i2c_emu/parameters/%s",
+			 params[i]);
+		f = fopen(path, "r");
+		if (!f)
+			return;
+		if (!i)
+			printf("emulator:");
+		if (fgets(buf, sizeof(buf), f))
+			printf(" %s=%.*s", params[i],
+			       (int)strcspn(buf, "\n"), buf);
+		fclose(f);
+	}
+	printf("\n");
+}
+
+/*
+ * Keep the rates the device accepts in the configured format, so the rate
+ * test only times real switches. Returns the card index.
+ */
+static int bench_probe_device(struct bench_opts *opts)
+{
+	snd_pcm_hw_params_t *hw;
+	snd_pcm_info_t *info;
+	snd_pcm_t *pcm;
+	unsigned int i, n = 0;
+	int err, card;
+
+	err = snd_pcm_open(&pcm, opts->device, SND_PCM_STREAM_PLAYBACK, 0);
+	if (err < 0) {
+		fprintf(stderr, "open %s: %s\n", opts->device,
+			snd_strerror(err));
+		return err;
+	}
+
+	snd_pcm_info_alloca(&info);
+	err = snd_pcm_info(pcm, info);
+	card = err < 0 ? err : snd_pcm_info_get_card(info);
+
+	snd_pcm_hw_params_alloca(&hw);
+	snd_pcm_hw_params_any(pcm, hw);
+	snd_pcm_hw_params_set_access(pcm, hw, SND_PCM_ACCESS_RW_INTERLEAVED);
+	snd_pcm_hw_params_set_format(pcm, hw, opts->format);
+	snd_pcm_hw_params_set_channels(pcm, hw, 2);
+	for (i = 0; i < opts->num_rates; i++)
+		if (!snd_pcm_hw_params_test_rate(pcm, hw, opts->rates[i], 0))
+			opts->rates[n++] = opts->rates[i];
+	opts->num_rates = n;
+
+	snd_pcm_close(pcm);
+
+	return card;
+}
+
+static void bench_rates_add(struct bench_opts *opts, unsigned int rate)
+{
+	unsigned int i;
+
+	for (i = 0; i < opts->num_rates; i++)
+		if (opts->rates[i] == rate)
+			return;
+	if (opts->num_rates < BENCH_MAX_RATES)
+		opts->rates[opts->num_rates++] = rate;
+}
+
+static int bench_cmp_uint(const void *a, const void *b)
+{
+	unsigned int x = *(const unsigned int *)a, y = *(const unsigned int *)b;
+
+	return (x > y) - (x < y);
+}
+
+/* "dac2hd", "zpcm512x", "auto" (both) or a comma separated list */
+static int bench_parse_rates(struct bench_opts *opts, const char *arg)
+{
+	char *copy, *tok, *save;
+	bool dac2hd, zpcm512x;
+	unsigned int i;
+
+	opts->num_rates = 0;
+	dac2hd = !strcmp(arg, "dac2hd") || !strcmp(arg, "auto");
+	zpcm512x = !strcmp(arg, "zpcm512x") || !strcmp(arg, "auto");
+	if (dac2hd || zpcm512x) {
+		for (i = 0; dac2hd && i < ARRAY_SIZE(dac2hd_rates); i++)
+			bench_rates_add(opts, dac2hd_rates[i]);
+		for (i = 0; zpcm512x && i < ARRAY_SIZE(zpcm512x_dai_rates);
+		     i++)
+			bench_rates_add(opts, zpcm512x_dai_rates[i]);
+		/* ascending alternates 44k1 and 48k families */
+		qsort(opts->rates, opts->num_rates, sizeof(*opts->rates),
+		      bench_cmp_uint);
+		return 0;
+	}
+
+	copy = strdup(arg);
+	if (!copy)
+		return -ENOMEM;
+	for (tok = strtok_r(copy, ",", &save); tok;
+	     tok = strtok_r(NULL, ",", &save))
+		bench_rates_add(opts, strtoul(tok, NULL, 0));
+	free(copy);
+
+	return opts->num_rates ? 0 : -EINVAL;
+}
+
+static int bench_parse_tests(struct bench_opts *opts, const char *arg)
+{
+	char *copy, *tok, *save;
+	int err = 0;
+
+	copy = strdup(arg);
+	if (!copy)
+		return -ENOMEM;
+	opts->tests = 0;
+	for (tok = strtok_r(copy, ",", &save); tok;
+	     tok = strtok_r(NULL, ",", &save)) {
+		if (!strcmp(tok, "open"))
+			opts->tests |= BENCH_TEST_OPEN;
+		else if (!strcmp(tok, "rate"))
+			opts->tests |= BENCH_TEST_RATE;
+		else if (!strcmp(tok, "pause"))
+			opts->tests |= BENCH_TEST_PAUSE;
+		else if (!strcmp(tok, "mixer"))
+			opts->tests |= BENCH_TEST_MIXER;
+		else if (!strcmp(tok, "all"))
+			opts->tests |= BENCH_TEST_ALL;
+		else
+			err = -EINVAL;
+	}
+	free(copy);
+
+	return err;
+}
+
+static void bench_usage(const char *prog)
+{
+	printf("dd-latency-bench %s\n"
+	       "usage: %s [options]\n"
+	       "  -D, --device=NAME    PCM device (default hw:0,0)\n"
+	       "  -t, --tests=LIST     open,rate,pause,mixer or all "
+	       "(default all)\n"
+	       "  -n, --loops=N        timed iterations per test "
+	       "(default 100)\n"
+	       "  -w, --warmup=N       untimed iterations first (default 5)\n"
+	       "  -i, --idle=MS        sleep between open iterations, eg. "
+	       "6000 to\n"
+	       "                       outlast pmdown_time (default 0)\n"
+	       "  -r, --rate=HZ        rate for open/pause/mixer "
+	       "(default 48000)\n"
+	       "  -R, --rates=LIST     rate test cycle: dac2hd, zpcm512x, "
+	       "auto or\n"
+	       "                       comma separated (default auto)\n"
+	       "  -b, --bits=16|24|32  sample format (default 32)\n"
+	       "  -p, --period=FRAMES  period size (default 1024)\n"
+	       "  -P, --periods=N      periods per buffer (default 4)\n"
+	       "  -m, --control=NAME   mixer control (default "
+	       "\"Digital Playback Volume\")\n"
+	       "  -s, --debugfs=DIR    debugfs mount (default "
+	       "/sys/kernel/debug)\n"
+	       "  -h, --help\n", DRV_VERSION, prog);
+}
+
+int main(int argc, char *argv[])
+{
+	static const struct option long_opts[] = {
+		{ "device", required_argument, NULL, 'D' },
+		{ "tests", required_argument, NULL, 't' },
+		{ "loops", required_argument, NULL, 'n' },
+		{ "warmup", required_argument, NULL, 'w' },
+		{ "idle", required_argument, NULL, 'i' },
+		{ "rate", required_argument, NULL, 'r' },
+		{ "rates", required_argument, NULL, 'R' },
+		{ "bits", required_argument, NULL, 'b' },
+		{ "period", required_argument, NULL, 'p' },
+		{ "periods", required_argument, NULL, 'P' },
+		{ "control", required_argument, NULL, 'm' },
+		{ "debugfs", required_argument, NULL, 's' },
+		{ "help", no_argument, NULL, 'h' },
+		{ },
+	};
+	struct bench_opts opts = {
+		.device = "hw:0,0",
+		.control = "Digital Playback Volume",
+		.debugfs = "/sys/kernel/debug",
+		.tests = BENCH_TEST_ALL,
+		.loops = 100,
+		.warmup = 5,
+		.rate = 48000,
+		.format = SND_PCM_FORMAT_S32_LE,
+		.period = 1024,
+		.periods = 4,
+	};
+	snd_ctl_card_info_t *card_info;
+	snd_ctl_t *ctl;
+	int c, card, err = 0;
+
+	bench_parse_rates(&opts, "auto");
+
+	while ((c = getopt_long(argc, argv, "D:t:n:w:i:r:R:b:p:P:m:s:h",
+				long_opts, NULL)) != -1) {
+		switch (c) {
+		case 'D':
+			opts.device = optarg;
+			break;
+		case 't':
+			err = bench_parse_tests(&opts, optarg);
+			break;
+		case 'n':
+			opts.loops = strtoul(optarg, NULL, 0);
+			break;
+		case 'w':
+			opts.warmup = strtoul(optarg, NULL, 0);
+			break;
+		case 'i':
+			opts.idle_ms = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			opts.rate = strtoul(optarg, NULL, 0);
+			break;
+		case 'R':
+			err = bench_parse_rates(&opts, optarg);
+			break;
+		case 'b':
+			switch (atoi(optarg)) {
+			case 16:
+				opts.format = SND_PCM_FORMAT_S16_LE;
+				break;
+			case 24:
+				opts.format = SND_PCM_FORMAT_S24_LE;
+				break;
+			case 32:
+				opts.format = SND_PCM_FORMAT_S32_LE;
+				break;
+			default:
+				err = -EINVAL;
+			}
+			break;
+		case 'p':
+			opts.period = strtoul(optarg, NULL, 0);
+			break;
+		case 'P':
+			opts.periods = strtoul(optarg, NULL, 0);
+			break;
+		case 'm':
+			opts.control = optarg;
+			break;
+		case 's':
+			opts.debugfs = optarg;
+			break;
+		case 'h':
+			bench_usage(argv[0]);
+			return EXIT_SUCCESS;
+		default:
+			err = -EINVAL;
+		}
+		if (err) {
+			bench_usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if (!opts.loops) {
+		bench_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	card = bench_probe_device(&opts);
+	if (card < 0)
+		return EXIT_FAILURE;
+	snprintf(opts.ctl_name, sizeof(opts.ctl_name), "hw:%d", card);
+
+	printf("dd-latency-bench %s: device=%s", DRV_VERSION, opts.device);
+	snd_ctl_card_info_alloca(&card_info);
+	if (!snd_ctl_open(&ctl, opts.ctl_name, 0)) {
+		if (!snd_ctl_card_info(ctl, card_info))
+			printf(" card=%s [%s]",
+			       snd_ctl_card_info_get_id(card_info),
+			       snd_ctl_card_info_get_name(card_info));
+		snd_ctl_close(ctl);
+	}
+	printf("\nformat=%s period=%lu periods=%u loops=%u warmup=%u\n",
+	       snd_pcm_format_name(opts.format), opts.period, opts.periods,
+	       opts.loops, opts.warmup);
+	bench_print_emu();
+
+	if (opts.tests & BENCH_TEST_OPEN)
+		err |= bench_test_open(&opts);
+	if (opts.tests & BENCH_TEST_RATE)
+		err |= bench_test_rate(&opts);
+	if (opts.tests & BENCH_TEST_PAUSE)
+		err |= bench_test_pause(&opts);
+	if (opts.tests & BENCH_TEST_MIXER)
+		err |= bench_test_mixer(&opts);
+
+	return err ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -33,6 +33,7 @@
 #include <linux/delay.h>
 #include <linux/i2c.h>
 #include <linux/version.h>
+#include <linux/debugfs.h>
 
 #include <sound/core.h>
 #include <sound/pcm.h>
@@ -41,9 +42,31 @@
 #include <sound/jack.h>
 
 #include "zpcm512x.h"
+#include "dd-utils.h"
+#include "dd-debug.h"
+#include "dd-trace.h"
 
 #define DRV_VERSION "4.0.0"
 
+/**
+ * struct dacplus_stats - card level counters and latency histograms, exported
+ * via debugfs
+ * @rate: rate of the last successful hw_params, for the switch counters
+ */
+struct dacplus_stats {
+	unsigned int rate;
+	u32 rate_switches[DD_NUM_RATE_FAMILIES];
+	struct dd_hist hw_params;
+};
+
+/**
+ * struct dacplus_drvdata - per card private data
+ * @stats: updated from hw_params, serialised by the card's pcm mutex
+ */
+struct dacplus_drvdata {
+	struct dacplus_stats stats;
+};
+
 #define HIFIBERRY_DACPRO_NOCLOCK 0
 #define HIFIBERRY_DACPRO_CLK44EN 1
 #define HIFIBERRY_DACPRO_CLK48EN 2
@@ -114,7 +137,7 @@ static void snd_rpi_hb_dacplus_select_clk(
 #endif
 	struct device *dev = soc_runtime->card->dev;
 
-	dev_dbg(dev, "%s: ENTER\n", __func__);
+	dd_trace(dev, "%s: ENTER\n", __func__);
 
 	switch (clk_id) {
 	case HIFIBERRY_DACPRO_NOCLOCK:
@@ -142,7 +165,7 @@ static void snd_rpi_hb_dacplus_select_clk(
 #endif /* DDEBUG */
 	usleep_range(2000, 2100);
 
-	dev_dbg(dev, "%s: EXIT [void]\n", __func__);
+	dd_trace(dev, "%s: EXIT [void]\n", __func__);
 }
 
 static void snd_rpi_hb_dacplus_clk_gpio(struct snd_soc_pcm_runtime *soc_runtime)
@@ -155,7 +178,7 @@ static void snd_rpi_hb_dacplus_clk_gpio(struct snd_soc_pcm_runtime *soc_runtime)
 #endif
 	struct device *dev = soc_runtime->card->dev;
 
-	dev_dbg(dev, "%s: ENTER\n", __func__);
+	dd_trace(dev, "%s: ENTER\n", __func__);
 
 	/* set the direction of GPIO3 and GPIO6 as outputs */
 	snd_soc_component_update_bits(component, PCM512x_GPIO_EN, 0x24, 0x24);
@@ -166,7 +189,7 @@ static void snd_rpi_hb_dacplus_clk_gpio(struct snd_soc_pcm_runtime *soc_runtime)
 	snd_soc_component_update_bits(component, PCM512x_GPIO_OUTPUT_6,
 				      0x0f, 0x02);
 
-	dev_dbg(dev, "%s: EXIT [void]\n", __func__);
+	dd_trace(dev, "%s: EXIT [void]\n", __func__);
 }
 
 static bool snd_rpi_hb_dacplus_is_sclk(struct snd_soc_pcm_runtime *soc_runtime)
@@ -181,7 +204,7 @@ static bool snd_rpi_hb_dacplus_is_sclk(struct snd_soc_pcm_runtime *soc_runtime)
 #endif
 	struct device *dev = soc_runtime->card->dev;
 
-	dev_dbg(dev, "%s: ENTER\n", __func__);
+	dd_trace(dev, "%s: ENTER\n", __func__);
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(5,9,0)
 	sck = snd_soc_component_read(component, PCM512x_RATE_DET_4);
 #else
@@ -190,7 +213,7 @@ static bool snd_rpi_hb_dacplus_is_sclk(struct snd_soc_pcm_runtime *soc_runtime)
 	/* CDST: This bit indicates whether the SCK clock is present or not. */
 	is_sclk = !(sck & 0x40);
 
-	dev_dbg(dev, "%s: EXIT [%s]\n", __func__, is_sclk ? "true" : "false");
+	dd_trace(dev, "%s: EXIT [%s]\n", __func__, is_sclk ? "true" : "false");
 
 	return (is_sclk);
 }
@@ -201,7 +224,7 @@ static bool snd_rpi_hb_dacplus_is_pro_card(
 	bool isClk44EN, isClk48En, isNoClk, isPro;
 	struct device *dev = soc_runtime->card->dev;
 
-	dev_dbg(dev, "%s: ENTER\n", __func__);
+	dd_trace(dev, "%s: ENTER\n", __func__);
 
 	snd_rpi_hb_dacplus_clk_gpio(soc_runtime);
 
@@ -211,12 +234,13 @@ static bool snd_rpi_hb_dacplus_is_pro_card(
 	snd_rpi_hb_dacplus_select_clk(soc_runtime, HIFIBERRY_DACPRO_NOCLOCK);
 	isNoClk = snd_rpi_hb_dacplus_is_sclk(soc_runtime);
 
+	/* must end on CLK48EN, the clock driver's initial state */
 	snd_rpi_hb_dacplus_select_clk(soc_runtime, HIFIBERRY_DACPRO_CLK48EN);
 	isClk48En = snd_rpi_hb_dacplus_is_sclk(soc_runtime);
 
 	isPro = isClk44EN && isClk48En && !isNoClk;
 
-	dev_dbg(dev, "%s: EXIT [%s]\n", __func__, isPro ? "true" : "false");
+	dd_trace(dev, "%s: EXIT [%s]\n", __func__, isPro ? "true" : "false");
 
 	return isPro;
 }
@@ -227,7 +251,7 @@ static int snd_rpi_hb_dacplus_clk_for_rate(
 	int type;
 	struct device *dev = soc_runtime->card->dev;
 
-	dev_dbg(dev, "%s: ENTER: sample_rate=%d\n", __func__, sample_rate);
+	dd_trace(dev, "%s: ENTER: sample_rate=%d\n", __func__, sample_rate);
 	
 	switch (sample_rate) {
 	case 11025:
@@ -243,15 +267,15 @@ static int snd_rpi_hb_dacplus_clk_for_rate(
 		break;
 	}
 	
-	dev_dbg(dev, "%s: EXIT [%s]\n", __func__,
-		(type == HIFIBERRY_DACPRO_CLK44EN) ? "CLK_44EN_RATE"
+	dd_trace(dev, "%s: EXIT [%s]\n", __func__,
+		 (type == HIFIBERRY_DACPRO_CLK44EN) ? "CLK_44EN_RATE"
 						   : "CLK_48EN_RATE");	
 
 	return type;
 }
 
-static void snd_rpi_hb_dacplus_set_sclk(struct snd_soc_pcm_runtime *soc_runtime,
-					int sample_rate)
+static int snd_rpi_hb_dacplus_set_sclk(struct snd_soc_pcm_runtime *soc_runtime,
+				       int sample_rate)
 {
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(5,9,0)
 	struct snd_soc_component *component =
@@ -262,23 +286,59 @@ static void snd_rpi_hb_dacplus_set_sclk(struct snd_soc_pcm_runtime *soc_runtime,
 	struct zpcm512x_priv *priv = snd_soc_component_get_drvdata(component);
 	struct device *dev = soc_runtime->card->dev;
 	unsigned long clock_rate;
+	unsigned int sel;
+	int ctype;
+	int ret;
 	
-	dev_dbg(dev, "%s: ENTER\n", __func__);
+	dd_trace(dev, "%s: ENTER\n", __func__);
 
-	if (!IS_ERR(priv->sclk)) {
-		int ctype;
+	if (IS_ERR(priv->sclk)) {
+		dd_trace(dev, "%s: EXIT [0]: no sclk\n", __func__);
+		return 0;
+	}
 
-		ctype = snd_rpi_hb_dacplus_clk_for_rate(soc_runtime,
-							sample_rate);
-		clock_rate = (ctype == HIFIBERRY_DACPRO_CLK44EN)
-					? CLK_44EN_RATE : CLK_48EN_RATE;
-		dev_dbg(dev, "%s: clk_set_rate(%lu)\n", __func__, clock_rate);
-		clk_set_rate(priv->sclk, clock_rate);
-		snd_rpi_hb_dacplus_select_clk(soc_runtime, ctype);
+	ctype = snd_rpi_hb_dacplus_clk_for_rate(soc_runtime, sample_rate);
+	clock_rate = (ctype == HIFIBERRY_DACPRO_CLK44EN)
+				? CLK_44EN_RATE : CLK_48EN_RATE;
+	/*
+	 * The clock drives the oscillator select itself and is a noop (no
+	 * GPIO write, no settle) if ctype is already active.
+	 */
+	dev_dbg(dev, "%s: clk_set_rate(%lu)\n", __func__, clock_rate);
+	ret = clk_set_rate(priv->sclk, clock_rate);
+	if (ret) {
+		dev_err(dev, "%s: EXIT [%d]: clk_set_rate(%lu) failed!\n",
+			__func__, ret, clock_rate);
+		return ret;
 	}
 
-	dev_dbg(dev, "%s: EXIT [void]\n", __func__);
+	/*
+	 * Overlays without a hifiberry,codec phandle give the clock no way
+	 * to reach the select GPIOs, so check it happened (cache hit) and
+	 * drive them from here otherwise.
+	 */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,9,0)
+	sel = snd_soc_component_read(component, PCM512x_GPIO_CONTROL_1);
+#else
+	sel = snd_soc_component_read32(component, PCM512x_GPIO_CONTROL_1);
+#endif
+	if ((sel & 0x24) != ((ctype == HIFIBERRY_DACPRO_CLK44EN) ? 0x20 : 0x04))
+		snd_rpi_hb_dacplus_select_clk(soc_runtime, ctype);
+
+	dd_trace(dev, "%s: EXIT [0]\n", __func__);
+	return 0;
+}
+
+#ifdef CONFIG_DEBUG_FS
+static void snd_rpi_hb_dacplus_debugfs_init(struct snd_soc_card *card)
+{
+	struct dacplus_drvdata *data = snd_soc_card_get_drvdata(card);
+	struct dentry *dentry = card->debugfs_card_root;
+
+	dd_rate_switches_debugfs(dentry, data->stats.rate_switches);
+	dd_hist_debugfs("hw_params_us", dentry, &data->stats.hw_params);
 }
+#endif /* CONFIG_DEBUG_FS */
 
 static int snd_rpi_hb_dacplus_init(struct snd_soc_pcm_runtime *soc_runtime)
 {
@@ -293,7 +353,7 @@ static int snd_rpi_hb_dacplus_init(struct snd_soc_pcm_runtime *soc_runtime)
 //	struct snd_soc_card *card = &snd_rpi_hifiberry_dacplus;
 	struct snd_soc_card *card = soc_runtime->card;
 
-	dev_dbg(dev, "%s: ENTER\n", __func__);
+	dd_trace(dev, "%s: ENTER\n", __func__);
 
 	if (slave)
 		snd_rpi_hb_is_dacpro = false;
@@ -361,7 +421,11 @@ static int snd_rpi_hb_dacplus_init(struct snd_soc_pcm_runtime *soc_runtime)
 	if (snd_mute_gpio)
 		gpiod_set_value_cansleep(snd_mute_gpio, mute_ext);
 
-	dev_dbg(dev, "%s: EXIT [0]\n", __func__);
+#ifdef CONFIG_DEBUG_FS
+	snd_rpi_hb_dacplus_debugfs_init(soc_runtime->card);
+#endif /* CONFIG_DEBUG_FS */
+
+	dd_trace(dev, "%s: EXIT [0]\n", __func__);
 
 	return 0;
 }
@@ -380,32 +444,26 @@ static int snd_rpi_hb_dacplus_update_rate_den(
 #endif
 	struct zpcm512x_priv *priv = snd_soc_component_get_drvdata(component);
 	struct device *dev = soc_runtime->card->dev;
-	struct snd_ratnum *rats_no_pll;
+	/* on the stack: hw_params must not allocate */
+	struct snd_ratnum rats_no_pll = {
+		.den_min = 1,
+		.den_max = 128,
+		.den_step = 1,
+	};
 	unsigned int num = 0, den = 0;
 	int err;
 
-	dev_dbg(dev, "%s: ENTER: params->rate_num=%d, params->rate_den=%d\n",
-		__func__, params->rate_num, params->rate_den);
+	dd_trace(dev, "%s: ENTER: params->rate_num=%d, params->rate_den=%d\n",
+		 __func__, params->rate_num, params->rate_den);
 
-	rats_no_pll = devm_kzalloc(soc_runtime->dev, sizeof(*rats_no_pll),
-				   GFP_KERNEL);
-	if (!rats_no_pll) {
-		dev_err(dev, "%s: EXIT [-ENOMEM]: failed to allocate memory "
-			"for rats_no_pll!\n", __func__);
-		return -ENOMEM;
-	}
-
-	rats_no_pll->num = clk_get_rate(priv->sclk) / 64;
-	rats_no_pll->den_min = 1;
-	rats_no_pll->den_max = 128;
-	rats_no_pll->den_step = 1;
+	rats_no_pll.num = clk_get_rate(priv->sclk) / 64;
 
         dev_dbg(component->dev, "%s: refine ratnum interval value: num=%d, "
         	"den_min=%d, den_max=%d, den_step=%d\n", __func__,
-        	rats_no_pll->num, rats_no_pll->den_min, rats_no_pll->den_max, 
-        	rats_no_pll->den_step);
+        	rats_no_pll.num, rats_no_pll.den_min, rats_no_pll.den_max, 
+        	rats_no_pll.den_step);
 
-	err = snd_interval_ratnum(interval, 1, rats_no_pll, &num, &den);
+	err = snd_interval_ratnum(interval, 1, &rats_no_pll, &num, &den);
 	if (err >= 0 && den) {
 		dev_dbg(component->dev, "%s: setting params->rate_num=%d, " 
 			"params->rate_den=%d\n", __func__, num, den);
@@ -413,14 +471,13 @@ static int snd_rpi_hb_dacplus_update_rate_den(
 		params->rate_den = den;
 	}
 
-	devm_kfree(soc_runtime->dev, rats_no_pll);
-	dev_dbg(dev, "%s: EXIT [0]\n", __func__);
+	dd_trace(dev, "%s: EXIT [0]\n", __func__);
 
 	return 0;
 }
 
-static int snd_rpi_hb_dacplus_hw_params(struct snd_pcm_substream *substream,
-					struct snd_pcm_hw_params *params)
+static int __snd_rpi_hb_dacplus_hw_params(struct snd_pcm_substream *substream,
+					  struct snd_pcm_hw_params *params)
 {
 	int ret = 0;
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(5,9,0)
@@ -441,17 +498,20 @@ static int snd_rpi_hb_dacplus_hw_params(struct snd_pcm_substream *substream,
 	snd_pcm_format_t format = params_format(params);
 	unsigned int rate = params_rate(params);
 
-        dev_dbg(dev, "%s: ENTER: frequency=%u, format=%s, "
-                "sample_bits=%u, physical_bits=%u, channels=%u\n", __func__,
-                rate, snd_pcm_format_name(format),
-                snd_pcm_format_width(format),
-                snd_pcm_format_physical_width(format),
-                channels);
+        dd_trace(dev, "%s: ENTER: frequency=%u, format=%s, "
+		 "sample_bits=%u, physical_bits=%u, channels=%u\n", __func__,
+		 rate, snd_pcm_format_name(format),
+		 snd_pcm_format_width(format),
+		 snd_pcm_format_physical_width(format),
+		 channels);
 
 	if (snd_rpi_hb_is_dacpro) {
 		width = snd_pcm_format_physical_width(params_format(params));
 
-		snd_rpi_hb_dacplus_set_sclk(soc_runtime, params_rate(params));
+		ret = snd_rpi_hb_dacplus_set_sclk(soc_runtime,
+						  params_rate(params));
+		if (ret)
+			return ret;
 
 		ret = snd_rpi_hb_dacplus_update_rate_den(substream, params);
 	}
@@ -476,12 +536,36 @@ static int snd_rpi_hb_dacplus_hw_params(struct snd_pcm_substream *substream,
 		return ret;
 	}
 	
-	dev_dbg(dev, "%s: EXIT [%d]\n", __func__, ret);
+	dd_trace(dev, "%s: EXIT [%d]\n", __func__, ret);
 
 	return ret;
 }
 
-static int snd_rpi_hb_dacplus_startup(struct snd_pcm_substream *substream)
+static int snd_rpi_hb_dacplus_hw_params(struct snd_pcm_substream *substream,
+					struct snd_pcm_hw_params *params)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,9,0)
+	struct snd_soc_pcm_runtime *soc_runtime =
+					asoc_substream_to_rtd(substream);
+#else
+	struct snd_soc_pcm_runtime *soc_runtime = substream->private_data;
+#endif /* LINUX_VERSION_CODE >= KERNEL_VERSION(5,9,0) */
+	struct dacplus_drvdata *data = snd_soc_card_get_drvdata(soc_runtime->card);
+	struct dd_span span;
+	int ret;
+
+	dd_span_begin(&span, dd_substream_codec_regmap(substream));
+	ret = __snd_rpi_hb_dacplus_hw_params(substream, params);
+	trace_dd_hw_params(substream->pcm->card->dev, params_rate(params),
+			   params_width(params), ret, &span);
+	dd_hist_add(&data->stats.hw_params, span.start);
+	if (!ret)
+		dd_rate_switch(data->stats.rate_switches, &data->stats.rate,
+			       params_rate(params));
+	return ret;
+}
+
+static int __snd_rpi_hb_dacplus_startup(struct snd_pcm_substream *substream)
 {
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(5,9,0)
 	struct snd_soc_pcm_runtime *soc_runtime =
@@ -494,13 +578,13 @@ static int snd_rpi_hb_dacplus_startup(struct snd_pcm_substream *substream)
 #endif
 	struct device *dev = soc_runtime->card->dev;
 
-	dev_dbg(dev, "%s: ENTER\n", __func__);
+	dd_trace(dev, "%s: ENTER\n", __func__);
 
 	if (auto_mute)
 		gpiod_set_value_cansleep(snd_mute_gpio, 0);
 
 	if (leds_off) {
-		dev_dbg(dev, "%s: EXIT [0]: noop - leds_off\n", __func__);
+		dd_trace(dev, "%s: EXIT [0]: noop - leds_off\n", __func__);
 		return 0;
 	}
 
@@ -510,11 +594,23 @@ static int snd_rpi_hb_dacplus_startup(struct snd_pcm_substream *substream)
 	if (auto_mute)
 		gpiod_set_value_cansleep(snd_mute_gpio, 1);
 
-	dev_dbg(dev, "%s: EXIT [0]\n", __func__);
+	dd_trace(dev, "%s: EXIT [0]\n", __func__);
 
 	return 0;
 }
 
+static int snd_rpi_hb_dacplus_startup(struct snd_pcm_substream *substream)
+{
+	struct dd_span span;
+	int ret;
+
+	dd_span_begin(&span, dd_substream_codec_regmap(substream));
+	ret = __snd_rpi_hb_dacplus_startup(substream);
+	trace_dd_startup(substream->pcm->card->dev, substream->stream, 0, ret,
+			 &span);
+	return ret;
+}
+
 static void snd_rpi_hb_dacplus_shutdown(struct snd_pcm_substream *substream)
 {
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(5,9,0)
@@ -528,7 +624,7 @@ static void snd_rpi_hb_dacplus_shutdown(struct snd_pcm_substream *substream)
 #endif
 	struct device *dev = soc_runtime->card->dev;
 
-	dev_dbg(dev, "%s: ENTER\n", __func__);
+	dd_trace(dev, "%s: ENTER\n", __func__);
 
 	snd_soc_component_update_bits(component, PCM512x_GPIO_CONTROL_1,
 				      0x08, 0x00);
@@ -536,23 +632,12 @@ static void snd_rpi_hb_dacplus_shutdown(struct snd_pcm_substream *substream)
 	if (auto_mute)
 		gpiod_set_value_cansleep(snd_mute_gpio, 1);
 
-	if (snd_rpi_hb_is_dacpro) {
-		struct zpcm512x_priv *priv =
-				snd_soc_component_get_drvdata(component);
-		/*
-		 * Default sclk to CLK_48EN_RATE, otherwise codec
-		 * pcm512x_dai_startup_master method could call
-		 * snd_pcm_hw_constraint_ratnums using CLK_44EN/64
-		 * which will mask 384k sample rate.
-		 */
-		if (!IS_ERR(priv->sclk)) {
-			dev_dbg(dev, "%s: clk_set_rate(%lu)\n", __func__,
-				CLK_48EN_RATE);
-			clk_set_rate(priv->sclk, CLK_48EN_RATE);
-		}
-	}
+	/*
+	 * sclk stays on the last used family: the codec's startup constraint
+	 * covers both CLK_44EN and CLK_48EN, so 384k is not masked.
+	 */
 
-	dev_dbg(dev, "%s: EXIT [void]\n", __func__);
+	dd_trace(dev, "%s: EXIT [void]\n", __func__);
 }
 
 /* machine stream operations */
@@ -630,9 +715,21 @@ static int snd_rpi_hb_dacplus_probe(struct platform_device *pdev)
 	struct property *tpa_prop;
 	struct of_changeset ocs;
 	struct property *pp;
+	struct dacplus_drvdata *data;
 	int tmp;
 
-	dev_dbg(dev, "%s: ENTER\n", __func__);
+	dd_trace(dev, "%s: ENTER\n", __func__);
+
+#ifdef DDEBUG
+	dev_dbg(dev, "%s: allocate memory for private data\n", __func__);
+#endif /* DDEBUG */
+	data = devm_kzalloc(dev, sizeof(*data), GFP_KERNEL);
+	if (!data) {
+		dev_err(dev, "%s: EXIT [-ENOMEM]: failed to allocate memory "
+			"for private driver data!\n", __func__);
+		return -ENOMEM;
+	}
+	snd_soc_card_set_drvdata(&dacplus_card, data);
 
 	/* probe for head phone amp */
 #ifdef DDEBUG
@@ -829,7 +926,7 @@ static int snd_rpi_hb_dacplus_probe(struct platform_device *pdev)
 	of_node_put(i2s_node);
 	of_node_put(tpa_node);
 
-	dev_dbg(dev, "%s: EXIT [0]\n", __func__);
+	dd_trace(dev, "%s: EXIT [0]\n", __func__);
 	return 0;
 
 i2s_err:
@@ -843,7 +940,7 @@ tpa_err:
 		else
 			dev_info(dev, "%s: EXIT [-EPROBE_DEFER]\n", __func__);
 	} else
-		dev_dbg(dev, "%s: EXIT [%d]\n", __func__, ret);
+		dd_trace(dev, "%s: EXIT [%d]\n", __func__, ret);
 
 	return ret;
 }
@@ -15,6 +15,8 @@
 #include <linux/acpi.h>
 
 #include "zpcm512x.h"
+#include "dd-utils.h"
+#include "dd-debug.h"
 
 #define DRV_VERSION "4.0.0"
 
@@ -26,13 +28,13 @@ static int zpcm512x_i2c_probe(struct i2c_client *client,
 	struct regmap_config config = zpcm512x_regmap;
 	struct regmap *regmap;
 
-	dev_dbg(dev, "%s: ENTER\n", __func__);
+	dd_trace(dev, "%s: ENTER\n", __func__);
 
 	/* msb needs to be set to enable auto-increment of addresses */
 	config.read_flag_mask = 0x80;
 	config.write_flag_mask = 0x80;
 
-	regmap = devm_regmap_init_i2c(client, &config);
+	regmap = dd_regmap_init_i2c(client, &config);
 	if (IS_ERR(regmap)) {
 		ret = PTR_ERR(regmap);
 		dev_err(dev, "%s: EXIT [%d]: regmap_init_i2c failed!\n",
@@ -48,7 +50,7 @@ static int zpcm512x_i2c_probe(struct i2c_client *client,
 		else
 			dev_info(dev, "%s: EXIT [-EPROBE_DEFER]\n", __func__);
 	else
-		dev_dbg(dev, "%s: EXIT [%d]\n", __func__, ret);
+		dd_trace(dev, "%s: EXIT [%d]\n", __func__, ret);
 
 	return ret;
 }
@@ -57,11 +59,11 @@ static int zpcm512x_i2c_remove(struct i2c_client *client)
 {
 	struct device *dev = &client->dev;
 
-	dev_dbg(dev, "%s: ENTER\n", __func__);
+	dd_trace(dev, "%s: ENTER\n", __func__);
 
 	zpcm512x_remove(dev);
 
-	dev_dbg(dev, "%s: EXIT [0]\n", __func__);
+	dd_trace(dev, "%s: EXIT [0]\n", __func__);
 	return 0;
 }
 
@@ -14,12 +14,18 @@
 #include <linux/init.h>
 #include <linux/module.h>
 #include <linux/clk.h>
+#include <linux/debugfs.h>
 #include <linux/kernel.h>
 #include <linux/pm_runtime.h>
 #include <linux/regmap.h>
 #include <linux/regulator/consumer.h>
 #include <linux/gcd.h>
 #include <linux/version.h>
+#include <linux/spinlock.h>
+#ifdef PCM512X_ASYNC_MUTE
+#include <linux/completion.h>
+#include <linux/workqueue.h>
+#endif /* PCM512X_ASYNC_MUTE */
 #include <sound/soc.h>
 //#include <sound/soc-dapm.h>
 #include <sound/pcm_params.h>
@@ -27,6 +33,8 @@
 
 #include "zpcm512x.h"
 #include "dd-utils.h"
+#include "dd-debug.h"
+#include "dd-trace.h"
 
 #define DRV_VERSION "4.0.0"
 
@@ -43,6 +51,55 @@ static const char * const zpcm512x_supply_names[PCM512x_NUM_SUPPLIES] = {
 	"CPVDD",
 };
 
+#define PCM512x_NUM_SCLK_FAMILIES 2
+#define PCM512x_CLK_CACHE_SIZE 32
+
+/*
+ * One zpcm512x_set_dividers clock-tree search: the inputs it depends on
+ * (key) and every register value it chose (solution).
+ */
+struct zpcm512x_clk_solution {
+	/* key */
+	unsigned long sclk_rate;
+	unsigned long bclk_rate;	/* PLL mode only, else 0 */
+	unsigned int rate;
+	int lrclk_div;
+	unsigned long overclock_pll;
+	unsigned long overclock_dac;
+	unsigned long overclock_dsp;
+	/* solution */
+	int pll_p;
+	int pll_j;
+	int pll_d;
+	int pll_r;
+	unsigned long real_pll;
+	bool dacin_pllin;		/* DAC clocked from the PLL input */
+	int dsp_div;
+	int dac_div;
+	int ncp_div;
+	int osr_div;
+	int bclk_div;
+	int idac;
+	int fssp;
+	unsigned long sample_rate;
+};
+
+/**
+ * struct zpcm512x_stats - counters and latency histograms, exported via
+ * debugfs
+ * @rate: rate of the last successful hw_params, for the switch counters
+ */
+struct zpcm512x_stats {
+	unsigned int rate;
+	u32 rate_switches[DD_NUM_RATE_FAMILIES];
+	u32 pll_resets;
+	u32 mute_poll_timeouts;
+	u32 clk_detect_errors;
+	struct dd_hist hw_params;
+	struct dd_hist mute_stream;
+	struct dd_hist runtime_resume;
+};
+
 struct zpcm512x_priv {
 	struct regmap *regmap;
 	struct clk *sclk;
@@ -51,21 +108,50 @@ struct zpcm512x_priv {
 	int fmt;
 	int pll_in;
 	int pll_out;
-	int pll_r;
-	int pll_j;
-	int pll_d;
-	int pll_p;
-	unsigned long real_pll;
 	unsigned long overclock_pll;
 	unsigned long overclock_dac;
 	unsigned long overclock_dsp;
-	int mute;
+	/*
+	 * 0x1 stream, 0x2 right switch, 0x4 left switch. Changed under
+	 * mute_lock, read locklessly with READ_ONCE(), so the mixer never
+	 * waits behind hardware I/O held under mutex.
+	 */
+	unsigned int mute;
+	spinlock_t mute_lock;
+	/*
+	 * DSP_PROGRAM as last written by the DSP Program or Latency Profile
+	 * put, read from the (atomic) delay op
+	 */
+	unsigned int dsp_program;
 	struct mutex mutex;
+#ifdef PCM512X_ASYNC_MUTE
+	/* analog mute confirmation and gpio sequencing, off the ALSA path */
+	struct work_struct mute_work;
+	struct completion mute_done;
+	unsigned int mute_seq;
+#endif /* PCM512X_ASYNC_MUTE */
+#ifdef DD_VOLUME_COALESCE
+	/* Digital Playback Volume, flushed to VOLUME_2/3 as one block */
+	struct dd_vol vol;
+#endif /* DD_VOLUME_COALESCE */
 	unsigned int bclk_ratio;
 	struct gpio_desc *mute_gpio;
 	bool auto_gpio_mute;
 	bool disable_pwrdown;
 	bool disable_standby;
+#ifdef PCM512X_LATENCY_PROFILE
+	/* Latency Profile, changed under mutex */
+	unsigned int profile;
+	bool profile_no_standby;
+#endif /* PCM512X_LATENCY_PROFILE */
+	/* master mode, no PLL: built once at probe, reused on every open */
+	struct snd_ratnum rats_no_pll[PCM512x_NUM_SCLK_FAMILIES];
+	struct snd_pcm_hw_constraint_ratnums constraints_no_pll;
+	/* clock-tree solutions, round robin once full */
+	struct zpcm512x_clk_solution clk_cache[PCM512x_CLK_CACHE_SIZE];
+	int clk_cache_used;
+	int clk_cache_next;
+	struct zpcm512x_stats stats;
 };
 
 /*
@@ -246,11 +332,11 @@ static int zpcm512x_overclock_pll_get(struct snd_kcontrol *kcontrol,
 	struct zpcm512x_priv *zpcm512x =
 				snd_soc_component_get_drvdata(component);
 #ifdef DDDEBUG
-	dev_dbg(component->dev, "%s: ENTER\n", __func__);
+	dd_trace(component->dev, "%s: ENTER\n", __func__);
 #endif
 	ucontrol->value.integer.value[0] = zpcm512x->overclock_pll;
 #ifdef DDDEBUG
-	dev_dbg(component->dev, "%s: EXIT [0]\n", __func__);
+	dd_trace(component->dev, "%s: EXIT [0]\n", __func__);
 #endif
 	return 0;
 }
@@ -263,7 +349,7 @@ static int zpcm512x_overclock_pll_put(struct snd_kcontrol *kcontrol,
 	struct zpcm512x_priv *zpcm512x =
 				snd_soc_component_get_drvdata(component);
 #ifdef DDDEBUG
-	dev_dbg(component->dev, "%s: ENTER\n", __func__);
+	dd_trace(component->dev, "%s: ENTER\n", __func__);
 #endif
 	switch (snd_soc_component_get_bias_level(component)) {
 	case SND_SOC_BIAS_OFF:
@@ -276,7 +362,7 @@ static int zpcm512x_overclock_pll_put(struct snd_kcontrol *kcontrol,
 
 	zpcm512x->overclock_pll = ucontrol->value.integer.value[0];
 #ifdef DDDEBUG
-	dev_dbg(component->dev, "%s: EXIT [0]\n", __func__);
+	dd_trace(component->dev, "%s: EXIT [0]\n", __func__);
 #endif
 	return 0;
 }
@@ -289,11 +375,11 @@ static int zpcm512x_overclock_dsp_get(struct snd_kcontrol *kcontrol,
 	struct zpcm512x_priv *zpcm512x =
 				snd_soc_component_get_drvdata(component);
 #ifdef DDDEBUG
-	dev_dbg(component->dev, "%s: ENTER\n", __func__);
+	dd_trace(component->dev, "%s: ENTER\n", __func__);
 #endif
 	ucontrol->value.integer.value[0] = zpcm512x->overclock_dsp;
 #ifdef DDDEBUG	
-	dev_dbg(component->dev, "%s: EXIT [0]\n", __func__);
+	dd_trace(component->dev, "%s: EXIT [0]\n", __func__);
 #endif
 	return 0;
 }
@@ -306,7 +392,7 @@ static int zpcm512x_overclock_dsp_put(struct snd_kcontrol *kcontrol,
 	struct zpcm512x_priv *zpcm512x =
 				snd_soc_component_get_drvdata(component);
 #ifdef DDDEBUG
-	dev_dbg(component->dev, "%s: ENTER\n", __func__);
+	dd_trace(component->dev, "%s: ENTER\n", __func__);
 #endif
 	switch (snd_soc_component_get_bias_level(component)) {
 	case SND_SOC_BIAS_OFF:
@@ -319,7 +405,7 @@ static int zpcm512x_overclock_dsp_put(struct snd_kcontrol *kcontrol,
 
 	zpcm512x->overclock_dsp = ucontrol->value.integer.value[0];
 #ifdef DDDEBUG
-	dev_dbg(component->dev, "%s: EXIT [0]\n", __func__);
+	dd_trace(component->dev, "%s: EXIT [0]\n", __func__);
 #endif
 	return 0;
 }
@@ -332,11 +418,11 @@ static int zpcm512x_overclock_dac_get(struct snd_kcontrol *kcontrol,
 	struct zpcm512x_priv *zpcm512x =
 				snd_soc_component_get_drvdata(component);
 #ifdef DDDEBUG
-	dev_dbg(component->dev, "%s: ENTER\n", __func__);
+	dd_trace(component->dev, "%s: ENTER\n", __func__);
 #endif
 	ucontrol->value.integer.value[0] = zpcm512x->overclock_dac;
 #ifdef DDDEBUG
-	dev_dbg(component->dev, "%s: EXIT [0]\n", __func__);
+	dd_trace(component->dev, "%s: EXIT [0]\n", __func__);
 #endif
 	return 0;
 }
@@ -349,7 +435,7 @@ static int zpcm512x_overclock_dac_put(struct snd_kcontrol *kcontrol,
 	struct zpcm512x_priv *zpcm512x =
 				snd_soc_component_get_drvdata(component);
 #ifdef DDDEBUG
-	dev_dbg(component->dev, "%s: ENTER\n", __func__);
+	dd_trace(component->dev, "%s: ENTER\n", __func__);
 #endif
 	switch (snd_soc_component_get_bias_level(component)) {
 	case SND_SOC_BIAS_OFF:
@@ -362,7 +448,7 @@ static int zpcm512x_overclock_dac_put(struct snd_kcontrol *kcontrol,
 
 	zpcm512x->overclock_dac = ucontrol->value.integer.value[0];
 #ifdef DDDEBUG
-	dev_dbg(component->dev, "%s: EXIT [0]\n", __func__);
+	dd_trace(component->dev, "%s: EXIT [0]\n", __func__);
 #endif
 	return 0;
 }
@@ -392,6 +478,26 @@ static SOC_VALUE_ENUM_SINGLE_DECL(zpcm512x_dsp_program,
 				  zpcm512x_dsp_program_texts,
 				  zpcm512x_dsp_program_values);
 
+/* group delay per DSP program, from the datasheet interpolation filters */
+static const struct dd_filter_delay zpcm512x_filter_delays[] = {
+	{ 1, 220 },	/* FIR interpolation */
+	{ 2,  35 },	/* Low latency IIR */
+	{ 3, 430 },	/* High attenuation */
+	{ 5, 220 },	/* Fixed process flow, normal FIR */
+	{ 7,  43 },	/* Ringing-less low latency FIR */
+};
+
+static int zpcm512x_dsp_program_put(struct snd_kcontrol *kcontrol,
+				    struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+					snd_soc_kcontrol_component(kcontrol);
+	struct zpcm512x_priv *zpcm512x =
+				snd_soc_component_get_drvdata(component);
+
+	return dd_filter_put(kcontrol, ucontrol, &zpcm512x->dsp_program);
+}
+
 static const char * const zpcm512x_clk_missing_text[] = {
 	"1s", "2s", "3s", "4s", "5s", "6s", "7s", "8s"
 };
@@ -455,31 +561,56 @@ static SOC_ENUM_SINGLE_DECL(zpcm512x_dac_mode_enum, /* name */
 			    PCM512x_PAGE000_REG121_DAMD_SHIFT, /* xshift */
 			    zpcm512x_dac_mode_texts /* xtexts */ );
 
+/* returns the previous mute bitmask */
+static unsigned int zpcm512x_mute_bits(struct zpcm512x_priv *zpcm512x,
+				       unsigned int clear, unsigned int set)
+{
+	unsigned int old;
+
+	spin_lock(&zpcm512x->mute_lock);
+	old = zpcm512x->mute;
+	WRITE_ONCE(zpcm512x->mute, (old & ~clear) | set);
+	spin_unlock(&zpcm512x->mute_lock);
+
+	return old;
+}
+
+/* only evaluated when the message is actually emitted */
+static const char *zpcm512x_log_mute(unsigned int val)
+{
+	switch (val) {
+	case PCM512x_RQML | PCM512x_RQMR: return "LEFT|RIGHT";
+	case PCM512x_RQML: return "LEFT";
+	case PCM512x_RQMR: return "RIGHT";
+	case 0: return "0FF";
+	default: return "????";
+	}
+}
+
+/* call with zpcm512x->mutex held, applies the latest mute bitmask */
 static int zpcm512x_update_mute(struct snd_soc_component *component)
 {
 	int ret;
 	struct device *dev = component->dev;
 	struct zpcm512x_priv *zpcm512x =
 				snd_soc_component_get_drvdata(component);
-	unsigned int val = (!!(zpcm512x->mute & 0x5) << PCM512x_RQML_SHIFT)
-			    | (!!(zpcm512x->mute & 0x3) << PCM512x_RQMR_SHIFT);
-	char *val_log = (val == (PCM512x_RQML | PCM512x_RQMR) ? "LEFT|RIGHT"
-			 : (val == PCM512x_RQML) ? "LEFT"
-			 : (val == PCM512x_RQMR) ? "RIGHT"
-			 : (!val) ? "0FF" : "????");
+	unsigned int mute = READ_ONCE(zpcm512x->mute);
+	unsigned int val = (!!(mute & 0x5) << PCM512x_RQML_SHIFT)
+			    | (!!(mute & 0x3) << PCM512x_RQMR_SHIFT);
 
-	dev_dbg(dev, "%s: ENTER\n", __func__);
+	dd_trace(dev, "%s: ENTER\n", __func__);
 
-	dev_dbg(dev, "%s: set PCM512x_MUTE=%s\n", __func__, val_log);
+	dev_dbg(dev, "%s: set PCM512x_MUTE=%s\n", __func__,
+		zpcm512x_log_mute(val));
 	ret = regmap_update_bits(zpcm512x->regmap, PCM512x_MUTE,
 				 PCM512x_RQML | PCM512x_RQMR, val);
 	if (ret < 0) {
 		dev_err(dev, "%s: EXIT [%d]: set PCM512x_MUTE=%s returns: "
-			"[%d]\n", __func__, ret, val_log, ret);
+			"[%d]\n", __func__, ret, zpcm512x_log_mute(val), ret);
 		return ret;
 	}
 
-	dev_dbg(dev, "%s: EXIT [0]\n", __func__);
+	dd_trace(dev, "%s: EXIT [0]\n", __func__);
 	return 0;
 }
 
@@ -490,17 +621,14 @@ static int zpcm512x_digital_playback_switch_get(struct snd_kcontrol *kcontrol,
 				snd_soc_kcontrol_component(kcontrol);
 	struct zpcm512x_priv *zpcm512x =
 				snd_soc_component_get_drvdata(component);
+	unsigned int mute = READ_ONCE(zpcm512x->mute);
 #ifdef DDDEBUG
-	dev_dbg(component->dev, "%s: ENTER\n", __func__);
+	dd_trace(component->dev, "%s: ENTER\n", __func__);
 #endif
-	mutex_lock(&zpcm512x->mutex);
-
-	ucontrol->value.integer.value[0] = !(zpcm512x->mute & 0x4);
-	ucontrol->value.integer.value[1] = !(zpcm512x->mute & 0x2);
-
-	mutex_unlock(&zpcm512x->mutex);
+	ucontrol->value.integer.value[0] = !(mute & 0x4);
+	ucontrol->value.integer.value[1] = !(mute & 0x2);
 #ifdef DDDEBUG
-	dev_dbg(component->dev, "%s: EXIT [0]\n", __func__);
+	dd_trace(component->dev, "%s: EXIT [0]\n", __func__);
 #endif
 	return 0;
 }
@@ -512,41 +640,273 @@ static int zpcm512x_digital_playback_switch_put(struct snd_kcontrol *kcontrol,
 				snd_soc_kcontrol_component(kcontrol);
 	struct zpcm512x_priv *zpcm512x =
 				snd_soc_component_get_drvdata(component);
-	int ret, changed = 0;
+	unsigned int set = (!ucontrol->value.integer.value[0] << 2)
+			   | (!ucontrol->value.integer.value[1] << 1);
+	int ret, changed;
 #ifdef DDDEBUG
-	dev_dbg(component->dev, "%s: ENTER\n", __func__);
+	dd_trace(component->dev, "%s: ENTER\n", __func__);
 #endif
-	mutex_lock(&zpcm512x->mutex);
-
-	if ((zpcm512x->mute & 0x4) == (ucontrol->value.integer.value[0] << 2)) {
-		zpcm512x->mute ^= 0x4;
-		changed = 1;
-	}
-	if ((zpcm512x->mute & 0x2) == (ucontrol->value.integer.value[1] << 1)) {
-		zpcm512x->mute ^= 0x2;
-		changed = 1;
-	}
+	changed = (zpcm512x_mute_bits(zpcm512x, 0x6, set) & 0x6) != set;
 
+	/*
+	 * Back to back puts coalesce: whoever gets the mutex last writes
+	 * the newest bitmask, the others find the register already set.
+	 */
 	if (changed) {
+		mutex_lock(&zpcm512x->mutex);
 		ret = zpcm512x_update_mute(component);
+		mutex_unlock(&zpcm512x->mutex);
 		if (ret != 0) {
 			dev_err(component->dev, "%s: EXIT [%d]: failed to "
 				"update digital mute!\n", __func__, ret);
-			mutex_unlock(&zpcm512x->mutex);
 			return ret;
 		}
 	}
-
-	mutex_unlock(&zpcm512x->mutex);
 #ifdef DDDEBUG
-	dev_dbg(component->dev, "%s: EXIT [%d]\n", __func__, changed);
+	dd_trace(component->dev, "%s: EXIT [%d]\n", __func__, changed);
 #endif
 	return changed;
 }
 
+#ifdef DD_VOLUME_COALESCE
+static int zpcm512x_digital_playback_volume_get(struct snd_kcontrol *kcontrol,
+					struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+					snd_soc_kcontrol_component(kcontrol);
+	struct zpcm512x_priv *zpcm512x =
+				snd_soc_component_get_drvdata(component);
+
+	return dd_vol_get(&zpcm512x->vol, kcontrol, ucontrol);
+}
+
+static int zpcm512x_digital_playback_volume_put(struct snd_kcontrol *kcontrol,
+					struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+					snd_soc_kcontrol_component(kcontrol);
+	struct zpcm512x_priv *zpcm512x =
+				snd_soc_component_get_drvdata(component);
+
+	return dd_vol_put(&zpcm512x->vol, kcontrol, ucontrol);
+}
+#endif /* DD_VOLUME_COALESCE */
+
+#ifdef PCM512X_LATENCY_PROFILE
+/*
+ * Latency Profile: one control that sets the DSP program, volume ramps,
+ * auto mute timing and standby/powerdown policy together. The register
+ * part is one regmap_multi_reg_write() under the component mutex, but
+ * DSP_PROGRAM (43), AUTO_MUTE (59) and DIGITAL_MUTE_1 (63) are not
+ * adjacent, so that is still three I2C writes: the chip, and regmap users
+ * between the transfers, can see a half applied profile.
+ */
+struct zpcm512x_latency_profile {
+	unsigned int dsp_program;
+	unsigned int auto_mute;		/* PCM512x_AUTO_MUTE */
+	unsigned int ramp;		/* PCM512x_DIGITAL_MUTE_1 */
+	bool no_standby;
+	bool no_pwrdown;
+};
+
+#define PCM512x_ATM(t) (((t) << PCM512x_ATML_SHIFT) | \
+			((t) << PCM512x_ATMR_SHIFT))
+#define PCM512x_RAMP(f, s) (((f) << PCM512x_VNDF_SHIFT) | \
+			    ((s) << PCM512x_VNDS_SHIFT) | \
+			    ((f) << PCM512x_VNUF_SHIFT) | \
+			    ((s) << PCM512x_VNUS_SHIFT))
+
+static const char * const zpcm512x_latency_profile_texts[] = {
+	"Low Latency",
+	"Balanced",
+	"Quality",
+};
+
+static const struct zpcm512x_latency_profile zpcm512x_latency_profiles[] = {
+	/* Low latency IIR, immediate ramps, 10.66s auto mute, always on */
+	{ 2, PCM512x_ATM(7), PCM512x_RAMP(3, 0), true,  true  },
+	/* Ringing-less FIR, 2 samples/2dB ramps, 1.07s auto mute, standby */
+	{ 7, PCM512x_ATM(4), PCM512x_RAMP(1, 1), false, true  },
+	/* register defaults */
+	{ 1, PCM512x_ATM(0), PCM512x_RAMP(0, 2), false, false },
+};
+
+#define PCM512x_PROFILE_DEFAULT 2
+
+static SOC_ENUM_SINGLE_EXT_DECL(zpcm512x_latency_profile_enum,
+				zpcm512x_latency_profile_texts);
+
+static int zpcm512x_latency_profile_get(struct snd_kcontrol *kcontrol,
+					struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+					snd_soc_kcontrol_component(kcontrol);
+	struct zpcm512x_priv *zpcm512x =
+				snd_soc_component_get_drvdata(component);
+
+	ucontrol->value.enumerated.item[0] = READ_ONCE(zpcm512x->profile);
+	return 0;
+}
+
+/* controls backed by the registers a profile rewrites */
+static const char * const zpcm512x_latency_profile_ctls[] = {
+	"DSP Program",
+	"Auto Mute Time Left",
+	"Auto Mute Time Right",
+	"Volume Ramp Down Rate",
+	"Volume Ramp Down Step",
+	"Volume Ramp Up Rate",
+	"Volume Ramp Up Step",
+};
+
+static void zpcm512x_latency_profile_notify(struct snd_soc_component *component)
+{
+	struct snd_soc_card *card = component->card;
+	struct snd_kcontrol *kctl;
+	char name[SNDRV_CTL_ELEM_ID_NAME_MAXLEN];
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(zpcm512x_latency_profile_ctls); i++) {
+		if (component->name_prefix)
+			snprintf(name, sizeof(name), "%s %s",
+				 component->name_prefix,
+				 zpcm512x_latency_profile_ctls[i]);
+		else
+			strscpy(name, zpcm512x_latency_profile_ctls[i],
+				sizeof(name));
+
+		kctl = snd_soc_card_get_kcontrol(card, name);
+		if (kctl)
+			snd_ctl_notify(card->snd_card,
+				       SNDRV_CTL_EVENT_MASK_VALUE, &kctl->id);
+	}
+}
+
+/* re-record DSP_PROGRAM from the regcache, i.e. what reached the chip */
+static void zpcm512x_dsp_program_sync(struct zpcm512x_priv *zpcm512x)
+{
+	unsigned int program;
+
+	if (regmap_read(zpcm512x->regmap, PCM512x_DSP_PROGRAM, &program) == 0)
+		WRITE_ONCE(zpcm512x->dsp_program, program);
+}
+
+static int zpcm512x_latency_profile_put(struct snd_kcontrol *kcontrol,
+					struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+					snd_soc_kcontrol_component(kcontrol);
+	struct zpcm512x_priv *zpcm512x =
+				snd_soc_component_get_drvdata(component);
+	struct device *dev = component->dev;
+	const struct zpcm512x_latency_profile *old, *new;
+	unsigned int item = ucontrol->value.enumerated.item[0];
+	struct reg_sequence seq[3];
+	bool pm_get, pm_put;
+	int ret;
+
+	if (item >= ARRAY_SIZE(zpcm512x_latency_profiles))
+		return -EINVAL;
+
+	mutex_lock(&zpcm512x->mutex);
+
+	if (item == zpcm512x->profile) {
+		mutex_unlock(&zpcm512x->mutex);
+		return 0;
+	}
+
+	old = &zpcm512x_latency_profiles[zpcm512x->profile];
+	new = &zpcm512x_latency_profiles[item];
+	pm_get = !zpcm512x->disable_pwrdown && new->no_pwrdown &&
+		 !old->no_pwrdown;
+	pm_put = !zpcm512x->disable_pwrdown && old->no_pwrdown &&
+		 !new->no_pwrdown;
+
+	/* holding a runtime pm reference keeps the DAC out of RQPD */
+	if (pm_get) {
+		ret = pm_runtime_get_sync(dev);
+		if (ret < 0) {
+			pm_runtime_put_noidle(dev);
+			dev_err(dev, "%s: EXIT [%d]: pm_runtime_get_sync "
+				"failed!\n", __func__, ret);
+			goto out;
+		}
+	}
+
+	/* leave standby before the new filter is loaded */
+	if (new->no_standby && !old->no_standby &&
+	    !zpcm512x->disable_standby) {
+		ret = regmap_update_bits(zpcm512x->regmap, PCM512x_POWER,
+					 PCM512x_RQST, 0);
+		if (ret != 0)
+			goto err_pm;
+	}
+
+	seq[0].reg = PCM512x_DSP_PROGRAM;
+	seq[0].def = new->dsp_program;
+	seq[0].delay_us = 0;
+	seq[1].reg = PCM512x_AUTO_MUTE;
+	seq[1].def = new->auto_mute;
+	seq[1].delay_us = 0;
+	seq[2].reg = PCM512x_DIGITAL_MUTE_1;
+	seq[2].def = new->ramp;
+	seq[2].delay_us = 0;
+
+	ret = regmap_multi_reg_write(zpcm512x->regmap, seq, ARRAY_SIZE(seq));
+	/* keep .delay in step even when the write stopped part way */
+	zpcm512x_dsp_program_sync(zpcm512x);
+	if (ret != 0) {
+		dev_err(dev, "%s: EXIT [%d]: failed to write profile "
+			"%s!\n", __func__, ret,
+			zpcm512x_latency_profile_texts[item]);
+		goto err_pm;
+	}
+
+	WRITE_ONCE(zpcm512x->profile_no_standby, new->no_standby);
+
+	/* standby allowed again: only re-enter it if the bias is off */
+	if (old->no_standby && !new->no_standby &&
+	    !zpcm512x->disable_standby &&
+	    snd_soc_component_get_bias_level(component) == SND_SOC_BIAS_OFF) {
+		ret = regmap_update_bits(zpcm512x->regmap, PCM512x_POWER,
+					 PCM512x_RQST, PCM512x_RQST);
+		if (ret != 0)
+			dev_warn(dev, "%s: failed to request standby: %d\n",
+				 __func__, ret);
+	}
+
+	if (pm_put)
+		pm_runtime_put(dev);
+
+	WRITE_ONCE(zpcm512x->profile, item);
+	mutex_unlock(&zpcm512x->mutex);
+
+	zpcm512x_latency_profile_notify(component);
+#ifdef DDEBUG
+	dev_dbg(dev, "%s: applied %s\n", __func__,
+		zpcm512x_latency_profile_texts[item]);
+#endif /* DDEBUG */
+	return 1;
+
+err_pm:
+	if (pm_get)
+		pm_runtime_put(dev);
+out:
+	mutex_unlock(&zpcm512x->mutex);
+	return ret;
+}
+#endif /* PCM512X_LATENCY_PROFILE */
+
 static const struct snd_kcontrol_new zpcm512x_controls[] = {
+#ifdef DD_VOLUME_COALESCE
+DD_VOL_DOUBLE_R_RANGE_TLV("Digital Playback Volume", PCM512x_DIGITAL_VOLUME_2,
+			  PCM512x_DIGITAL_VOLUME_3, 0, 0, 255, 1,
+			  zpcm512x_digital_playback_volume_get,
+			  zpcm512x_digital_playback_volume_put, digital_tlv),
+#else
 SOC_DOUBLE_R_TLV("Digital Playback Volume", PCM512x_DIGITAL_VOLUME_2,
 		 PCM512x_DIGITAL_VOLUME_3, 0, 255, 1, digital_tlv),
+#endif /* DD_VOLUME_COALESCE */
 SOC_DOUBLE_TLV("Analogue Playback Volume", PCM512x_ANALOG_GAIN_CTRL,
 	       PCM512x_LAGN_SHIFT, PCM512x_RAGN_SHIFT, 1, 1, analog_tlv),
 SOC_DOUBLE_TLV("Analogue Playback Boost Volume", PCM512x_ANALOG_GAIN_BOOST,
@@ -562,7 +922,12 @@ SOC_DOUBLE_TLV("Analogue Playback Boost Volume", PCM512x_ANALOG_GAIN_BOOST,
 },
 
 SOC_SINGLE("Deemphasis Switch", PCM512x_DSP, PCM512x_DEMP_SHIFT, 1, 1),
-SOC_ENUM("DSP Program", zpcm512x_dsp_program),
+SOC_ENUM_EXT("DSP Program", zpcm512x_dsp_program, snd_soc_get_enum_double,
+	     zpcm512x_dsp_program_put),
+#ifdef PCM512X_LATENCY_PROFILE
+SOC_ENUM_EXT("Latency Profile", zpcm512x_latency_profile_enum,
+	     zpcm512x_latency_profile_get, zpcm512x_latency_profile_put),
+#endif /* PCM512X_LATENCY_PROFILE */
 
 SOC_ENUM("Clock Missing Period", zpcm512x_clk_missing),
 SOC_ENUM("Auto Mute Time Left", zpcm512x_autom_l),
@@ -616,11 +981,11 @@ static unsigned long zpcm512x_pll_max(struct snd_soc_component *component)
 	struct zpcm512x_priv *zpcm512x =
 				snd_soc_component_get_drvdata(component);
 
-	dev_dbg(component->dev, "%s: ENTER\n", __func__);
+	dd_trace(component->dev, "%s: ENTER\n", __func__);
 
 	pll_max = zpcm512x_pll_max_(zpcm512x);
 
-	dev_dbg(component->dev, "%s: EXIT [%lu]\n", __func__, pll_max);	
+	dd_trace(component->dev, "%s: EXIT [%lu]\n", __func__, pll_max);	
 	return pll_max;
 }
 
@@ -630,11 +995,11 @@ static unsigned long zpcm512x_dsp_max(struct snd_soc_component *component)
 	struct zpcm512x_priv *zpcm512x =
 				snd_soc_component_get_drvdata(component);
 
-	dev_dbg(component->dev, "%s: ENTER\n", __func__);
+	dd_trace(component->dev, "%s: ENTER\n", __func__);
 	
 	dsp_max = 50000000 + 50000000 * zpcm512x->overclock_dsp / 100;
 
-	dev_dbg(component->dev, "%s: EXIT [%lu]\n", __func__, dsp_max);
+	dd_trace(component->dev, "%s: EXIT [%lu]\n", __func__, dsp_max);
 	return dsp_max;
 }
 
@@ -645,11 +1010,11 @@ static unsigned long zpcm512x_dac_max(struct snd_soc_component *component,
 	struct zpcm512x_priv *zpcm512x =
 				snd_soc_component_get_drvdata(component);
 
-	dev_dbg(component->dev, "%s: ENTER\n", __func__);
+	dd_trace(component->dev, "%s: ENTER\n", __func__);
 
 	dac_max = rate + rate * zpcm512x->overclock_dac / 100;
 
-	dev_dbg(component->dev, "%s: EXIT [%lu]\n", __func__, dac_max);
+	dd_trace(component->dev, "%s: EXIT [%lu]\n", __func__, dac_max);
 	return dac_max;
 }
 
@@ -666,7 +1031,7 @@ static unsigned long zpcm512x_ncp_target(struct snd_soc_component *component,
 {
 	unsigned long ncp_target;
 
-	dev_dbg(component->dev, "%s: ENTER\n", __func__);
+	dd_trace(component->dev, "%s: ENTER\n", __func__);
 
 	/*
 	 * If the DAC is not actually overclocked, use the good old
@@ -681,7 +1046,7 @@ static unsigned long zpcm512x_ncp_target(struct snd_soc_component *component,
 	else
 		ncp_target = zpcm512x_dac_max(component, 1536000);
 
-	dev_dbg(component->dev, "%s: EXIT [%lu]\n", __func__, ncp_target);
+	dd_trace(component->dev, "%s: EXIT [%lu]\n", __func__, ncp_target);
 	return ncp_target;
 }
 
@@ -732,17 +1097,75 @@ static int zpcm512x_hw_rule_rate(struct snd_pcm_hw_params *params,
 				   ARRAY_SIZE(ranges), ranges, 0);
 }
 
+/*
+ * SCLK rates of both oscillator families. A switchable master clock (e.g.
+ * the DAC+ Pro) rounds each of these to a rate it can actually run at, a
+ * fixed one rounds both to the same rate.
+ */
+static const unsigned long zpcm512x_sclk_families[PCM512x_NUM_SCLK_FAMILIES] = {
+	22579200,	/* 512 * 44.1k */
+	24576000,	/* 512 * 48k */
+};
+
+/*
+ * Offer every family the SCLK can switch to, not just the current one, so
+ * the clock can stay on the last used family across close without masking
+ * the other family's rates (e.g. 384k). Called once from probe, so stream
+ * open never has to allocate.
+ */
+static void zpcm512x_init_ratnums(struct zpcm512x_priv *zpcm512x,
+				  struct device *dev)
+{
+	struct snd_pcm_hw_constraint_ratnums *constraints_no_pll =
+						&zpcm512x->constraints_no_pll;
+	struct snd_ratnum *rats_no_pll = zpcm512x->rats_no_pll;
+	unsigned int num;
+	long rate;
+	int i, j;
+
+	constraints_no_pll->nrats = 0;
+	for (i = 0; i < ARRAY_SIZE(zpcm512x_sclk_families); i++) {
+		rate = clk_round_rate(zpcm512x->sclk,
+				      zpcm512x_sclk_families[i]);
+		if (rate <= 0)
+			continue;
+		num = rate / 64;
+		for (j = 0; j < constraints_no_pll->nrats; j++)
+			if (rats_no_pll[j].num == num)
+				break;
+		if (j < constraints_no_pll->nrats)
+			continue;
+
+		rats_no_pll[j].num = num;
+		rats_no_pll[j].den_min = 1;
+		rats_no_pll[j].den_max = 128;
+		rats_no_pll[j].den_step = 1;
+		constraints_no_pll->nrats++;
+
+		dev_dbg(dev, "%s: ratnums constraint: num=%d, den_min=%d, "
+			"den_max=%d, den_step=%d\n", __func__,
+			rats_no_pll[j].num, rats_no_pll[j].den_min,
+			rats_no_pll[j].den_max, rats_no_pll[j].den_step);
+	}
+	if (!constraints_no_pll->nrats) {
+		rats_no_pll->num = clk_get_rate(zpcm512x->sclk) / 64;
+		rats_no_pll->den_min = 1;
+		rats_no_pll->den_max = 128;
+		rats_no_pll->den_step = 1;
+		constraints_no_pll->nrats = 1;
+	}
+	constraints_no_pll->rats = rats_no_pll;
+}
+
 static int zpcm512x_dai_startup_master(struct snd_pcm_substream *substream,
 				       struct snd_soc_dai *dai)
 {
 	struct snd_soc_component *component = dai->component;
 	struct zpcm512x_priv *zpcm512x = snd_soc_component_get_drvdata(component);
 	struct device *dev = dai->dev;
-	struct snd_pcm_hw_constraint_ratnums *constraints_no_pll;
-	struct snd_ratnum *rats_no_pll;
 	int ret;
 
-	dev_dbg(component->dev, "%s: ENTER\n", __func__);
+	dd_trace(component->dev, "%s: ENTER\n", __func__);
 
 	if (IS_ERR(zpcm512x->sclk)) {
 		dev_err(dev, "%s: EXIT [%ld]: need SCLK for master mode!\n",
@@ -758,42 +1181,15 @@ static int zpcm512x_dai_startup_master(struct snd_pcm_substream *substream,
 					  SNDRV_PCM_HW_PARAM_FRAME_BITS,
 					  SNDRV_PCM_HW_PARAM_CHANNELS, -1);
 
-		dev_dbg(component->dev, "%s: EXIT [%d]\n", __func__, ret);
+		dd_trace(component->dev, "%s: EXIT [%d]\n", __func__, ret);
 		return ret;
 	}
 
-	constraints_no_pll = devm_kzalloc(dev, sizeof(*constraints_no_pll),
-					  GFP_KERNEL);
-	if (!constraints_no_pll) {
-		dev_err(component->dev, "%s: EXIT [-ENOMEM]: "
-			"constraints_no_pll devm_kzalloc error\n", __func__);
-		return -ENOMEM;
-	}
-
-	constraints_no_pll->nrats = 1;
-	rats_no_pll = devm_kzalloc(dev, sizeof(*rats_no_pll), GFP_KERNEL);
-	if (!rats_no_pll) {
-		dev_err(component->dev, "%s: EXIT [-ENOMEM]: rats_no_pll "
-			"devm_kzalloc error\n", __func__);
-		return -ENOMEM;
-	}
-
-	constraints_no_pll->rats = rats_no_pll;
-	rats_no_pll->num = clk_get_rate(zpcm512x->sclk) / 64;
-	rats_no_pll->den_min = 1;
-	rats_no_pll->den_max = 128;
-	rats_no_pll->den_step = 1;
-
-	dev_dbg(component->dev, "%s: set ratnums constraint: num=%d, "
-		"den_min=%d, den_max=%d, den_step=%d\n", __func__,
-		rats_no_pll->num, rats_no_pll->den_min, rats_no_pll->den_max,
-		rats_no_pll->den_step);
-
 	ret = snd_pcm_hw_constraint_ratnums(substream->runtime, 0,
 					    SNDRV_PCM_HW_PARAM_RATE,
-					    constraints_no_pll);
+					    &zpcm512x->constraints_no_pll);
 
-	dev_dbg(component->dev, "%s: EXIT [%d]\n", __func__, ret);
+	dd_trace(component->dev, "%s: EXIT [%d]\n", __func__, ret);
 	return ret;
 }
 
@@ -807,7 +1203,7 @@ static int zpcm512x_dai_startup_slave(struct snd_pcm_substream *substream,
 	struct regmap *regmap = zpcm512x->regmap;
 	int ret;
 
-	dev_dbg(component->dev, "%s: ENTER\n", __func__);
+	dd_trace(component->dev, "%s: ENTER\n", __func__);
 
 	if (IS_ERR(zpcm512x->sclk)) {
 		dev_dbg(dev, "%s: no SCLK, using BCLK: %ld\n",
@@ -829,28 +1225,28 @@ static int zpcm512x_dai_startup_slave(struct snd_pcm_substream *substream,
 					 SNDRV_PCM_HW_PARAM_RATE,
 					 &constraints_slave);
 
-	dev_dbg(component->dev, "%s: EXIT [%d]\n", __func__, ret);
+	dd_trace(component->dev, "%s: EXIT [%d]\n", __func__, ret);
 	return ret;
 }
 
-static int zpcm512x_dai_startup(struct snd_pcm_substream *substream,
-			        struct snd_soc_dai *dai)
+static int __zpcm512x_dai_startup(struct snd_pcm_substream *substream,
+				  struct snd_soc_dai *dai)
 {
 	struct snd_soc_component *component = dai->component;
 	struct zpcm512x_priv *zpcm512x = snd_soc_component_get_drvdata(component);
 	int ret;
 
-	dev_dbg(component->dev, "%s: ENTER\n", __func__);
+	dd_trace(component->dev, "%s: ENTER\n", __func__);
 
 	switch (zpcm512x->fmt & SND_SOC_DAIFMT_MASTER_MASK) {
 	case SND_SOC_DAIFMT_CBM_CFM:
 	case SND_SOC_DAIFMT_CBM_CFS:
 		ret = zpcm512x_dai_startup_master(substream, dai);
-		dev_dbg(component->dev, "%s: EXIT [%d]\n", __func__, ret);
+		dd_trace(component->dev, "%s: EXIT [%d]\n", __func__, ret);
 		return ret;
 	case SND_SOC_DAIFMT_CBS_CFS:
 		ret = zpcm512x_dai_startup_slave(substream, dai);
-		dev_dbg(component->dev, "%s: EXIT [%d]\n", __func__, ret);
+		dd_trace(component->dev, "%s: EXIT [%d]\n", __func__, ret);
 		return ret;
 	default:
 		dev_err(component->dev, "%s: EXIT [-EINVAL]: Invalid DAIFMT!\n",
@@ -859,6 +1255,18 @@ static int zpcm512x_dai_startup(struct snd_pcm_substream *substream,
 	}
 }
 
+static int zpcm512x_dai_startup(struct snd_pcm_substream *substream,
+			        struct snd_soc_dai *dai)
+{
+	struct dd_span span;
+	int ret;
+
+	dd_span_begin(&span, dai->component->regmap);
+	ret = __zpcm512x_dai_startup(substream, dai);
+	trace_dd_startup(dai->dev, substream->stream, 0, ret, &span);
+	return ret;
+}
+
 static char* zpcm512x_log_bias_level(enum snd_soc_bias_level level)
 {
 	switch (level) {
@@ -870,20 +1278,27 @@ static char* zpcm512x_log_bias_level(enum snd_soc_bias_level level)
 	}
 }
 
-static int zpcm512x_set_bias_level(struct snd_soc_component *component,
-				   enum snd_soc_bias_level level)
+static int __zpcm512x_set_bias_level(struct snd_soc_component *component,
+				     enum snd_soc_bias_level level)
 {
 	struct zpcm512x_priv *zpcm512x = dev_get_drvdata(component->dev);
 	int ret;
 
-	dev_dbg(component->dev, "%s: ENTER: level=%s\n", __func__,
-		zpcm512x_log_bias_level(level));
+	dd_trace(component->dev, "%s: ENTER: level=%s\n", __func__,
+		 zpcm512x_log_bias_level(level));
 
 	if (zpcm512x->disable_standby) {
-		dev_dbg(component->dev, "%s: EXIT [0]: noop - ignoring because "
-			"RQST standby is disabled\n", __func__);
+		dd_trace(component->dev, "%s: EXIT [0]: noop - ignoring because "
+			 "RQST standby is disabled\n", __func__);
+		return 0;
+	}
+#ifdef PCM512X_LATENCY_PROFILE
+	if (READ_ONCE(zpcm512x->profile_no_standby)) {
+		dd_trace(component->dev, "%s: EXIT [0]: noop - ignoring because "
+			 "latency profile keeps RQST standby off\n", __func__);
 		return 0;
 	}
+#endif /* PCM512X_LATENCY_PROFILE */
 
 	switch (level) {
 	case SND_SOC_BIAS_ON:
@@ -922,19 +1337,31 @@ static int zpcm512x_set_bias_level(struct snd_soc_component *component,
 		break;
 	}
 
-	dev_dbg(component->dev, "%s: EXIT [0]\n", __func__);
+	dd_trace(component->dev, "%s: EXIT [0]\n", __func__);
 	return 0;
 }
 
-static unsigned long zpcm512x_find_sck(struct snd_soc_dai *dai,
+static int zpcm512x_set_bias_level(struct snd_soc_component *component,
+				   enum snd_soc_bias_level level)
+{
+	enum snd_soc_bias_level old = snd_soc_component_get_bias_level(component);
+	struct dd_span span;
+	int ret;
+
+	dd_span_begin(&span, component->regmap);
+	ret = __zpcm512x_set_bias_level(component, level);
+	trace_dd_bias_level(component->dev, old, level, ret, &span);
+	return ret;
+}
+
+static unsigned long zpcm512x_find_sck(struct snd_soc_component *component,
 				       unsigned long bclk_rate)
 {
-	struct device *dev = dai->dev;
-	struct snd_soc_component *component = dai->component;
+	struct device *dev = component->dev;
 	unsigned long sck_rate;
 	int pow2;
 
-	dev_dbg(dev, "%s: ENTER: bclk_rate=%lu\n", __func__, bclk_rate);
+	dd_trace(dev, "%s: ENTER: bclk_rate=%lu\n", __func__, bclk_rate);
 
 	/* 64 MHz <= pll_rate <= 100 MHz, VREF mode */
 	/* 16 MHz <= sck_rate <=  25 MHz, VREF mode */
@@ -956,7 +1383,7 @@ static unsigned long zpcm512x_find_sck(struct snd_soc_dai *dai,
 		return 0;
 	}
 
-	dev_dbg(dev, "%s: EXIT [%lu]\n", __func__, sck_rate);
+	dd_trace(dev, "%s: EXIT [%lu]\n", __func__, sck_rate);
 	return sck_rate;
 }
 
@@ -973,21 +1400,20 @@ static unsigned long zpcm512x_find_sck(struct snd_soc_dai *dai,
  *     4 <= J <= 11
  *     R = 1
  */
-static int zpcm512x_find_pll_coeff(struct snd_soc_dai *dai,
-				   unsigned long pllin_rate,
-				   unsigned long pll_rate)
+static int __zpcm512x_find_pll_coeff(struct snd_soc_component *component,
+				     struct zpcm512x_clk_solution *sol,
+				     unsigned long pllin_rate,
+				     unsigned long pll_rate)
 {
-	struct device *dev = dai->dev;
-	struct snd_soc_component *component = dai->component;
-	struct zpcm512x_priv *zpcm512x = snd_soc_component_get_drvdata(component);
+	struct device *dev = component->dev;
 	unsigned long common;
 	int R, J, D, P;
 	unsigned long K; /* 10000 * J.D */
 	unsigned long num;
 	unsigned long den;
 
-	dev_dbg(dev, "%s: ENTER: pllin_rate=%lu, pll_rate=%lu\n", __func__,
-		pllin_rate, pll_rate);
+	dd_trace(dev, "%s: ENTER: pllin_rate=%lu, pll_rate=%lu\n", __func__,
+		 pllin_rate, pll_rate);
 
 	common = gcd(pll_rate, pllin_rate);
 	num = pll_rate / common;
@@ -1016,7 +1442,7 @@ static int zpcm512x_find_pll_coeff(struct snd_soc_dai *dai,
 
 			dev_dbg(dev, "%s: R * J / P = %d * %d / %d\n",
 				__func__, R, J, P);
-			zpcm512x->real_pll = pll_rate;
+			sol->real_pll = pll_rate;
 			goto done;
 		}
 		/* no luck */
@@ -1047,7 +1473,7 @@ static int zpcm512x_find_pll_coeff(struct snd_soc_dai *dai,
 		J = K / 10000;
 		D = K % 10000;
 		dev_dbg(dev, "%s: J.D / P = %d.%04d / %d\n", __func__, J, D, P);
-		zpcm512x->real_pll = pll_rate;
+		sol->real_pll = pll_rate;
 		goto done;
 	}
 
@@ -1077,38 +1503,58 @@ fallback:
 	J = K / 10000;
 	D = K % 10000;
 	dev_dbg(dev, "%s: J.D / P ~ %d.%04d / %d\n", __func__, J, D, P);
-	zpcm512x->real_pll = DIV_ROUND_DOWN_ULL((u64)K * pllin_rate, 10000 * P);
+	sol->real_pll = DIV_ROUND_DOWN_ULL((u64)K * pllin_rate, 10000 * P);
 
 done:
-	zpcm512x->pll_r = R;
-	zpcm512x->pll_j = J;
-	zpcm512x->pll_d = D;
-	zpcm512x->pll_p = P;
+	sol->pll_r = R;
+	sol->pll_j = J;
+	sol->pll_d = D;
+	sol->pll_p = P;
 
-	dev_dbg(dev, "%s: EXIT [0]\n", __func__);
+	dd_trace(dev, "%s: EXIT [0]\n", __func__);
 	return 0;
 }
 
-static unsigned long zpcm512x_pllin_dac_rate(struct snd_soc_dai *dai,
-					     unsigned long osr_rate,
-					     unsigned long pllin_rate)
+static int zpcm512x_find_pll_coeff(struct snd_soc_component *component,
+				   struct zpcm512x_clk_solution *sol,
+				   unsigned long pllin_rate,
+				   unsigned long pll_rate)
+{
+	struct dd_span span;
+	int ret;
+
+	dd_span_begin(&span, component->regmap);
+	ret = __zpcm512x_find_pll_coeff(component, sol, pllin_rate, pll_rate);
+	if (ret)
+		trace_dd_pll_coeff(component->dev, pllin_rate, pll_rate, 0, 0,
+				   0, 0, ret, &span);
+	else
+		trace_dd_pll_coeff(component->dev, pllin_rate, pll_rate,
+				   sol->pll_p, sol->pll_j, sol->pll_d,
+				   sol->pll_r, ret, &span);
+	return ret;
+}
+
+static unsigned long zpcm512x_pllin_dac_rate(
+					struct snd_soc_component *component,
+					unsigned long osr_rate,
+					unsigned long pllin_rate)
 {
-	struct snd_soc_component *component = dai->component;
 	struct zpcm512x_priv *zpcm512x = snd_soc_component_get_drvdata(component);
 	unsigned long dac_rate;
 
-	dev_dbg(component->dev, "%s: ENTER: osr_rate=%lu, pllin_rate=%lu\n",
-		__func__, osr_rate, pllin_rate);
+	dd_trace(component->dev, "%s: ENTER: osr_rate=%lu, pllin_rate=%lu\n",
+		 __func__, osr_rate, pllin_rate);
 
 	if (!zpcm512x->pll_out) {
-		dev_dbg(component->dev, "%s: EXIT [0]: no PLL to bypass, force "
-			"SCK as DAC input\n", __func__);
+		dd_trace(component->dev, "%s: EXIT [0]: no PLL to bypass, force "
+			 "SCK as DAC input\n", __func__);
 		return 0; /* no PLL to bypass, force SCK as DAC input */
 	}
 
 	if (pllin_rate % osr_rate) {
-		dev_dbg(component->dev, "%s: EXIT [0]: futile, quit early\n",
-			__func__);
+		dd_trace(component->dev, "%s: EXIT [0]: futile, quit early\n",
+			 __func__);
 		return 0; /* futile, quit early */
 	}
 
@@ -1119,29 +1565,32 @@ static unsigned long zpcm512x_pllin_dac_rate(struct snd_soc_dai *dai,
 	     dac_rate -= osr_rate) {
 
 		if (pllin_rate / dac_rate > 128) {
-			dev_dbg(component->dev, "%s: EXIT [0]: DAC divider "
-				"would be too big\n", __func__);
+			dd_trace(component->dev, "%s: EXIT [0]: DAC divider "
+				 "would be too big\n", __func__);
 			return 0; /* DAC divider would be too big */
 		}
 
 		if (!(pllin_rate % dac_rate)) {
-			dev_dbg(component->dev, "%s: EXIT [%lu]\n", __func__,
-				dac_rate);		
+			dd_trace(component->dev, "%s: EXIT [%lu]\n", __func__,
+				 dac_rate);		
 			return dac_rate;
 		}
 
 		dac_rate -= osr_rate;
 	}
 
-	dev_dbg(component->dev, "%s: EXIT [0]\n", __func__);
+	dd_trace(component->dev, "%s: EXIT [0]\n", __func__);
 	return 0;
 }
 
-static int zpcm512x_set_dividers(struct snd_soc_dai *dai,
-				 struct snd_pcm_hw_params *params)
+/*
+ * Search the clock tree for the inputs in the key part of @sol and fill in
+ * the rest of it. Does not touch the hardware.
+ */
+static int zpcm512x_solve_dividers(struct snd_soc_component *component,
+				   struct zpcm512x_clk_solution *sol)
 {
-	struct device *dev = dai->dev;
-	struct snd_soc_component *component = dai->component;
+	struct device *dev = component->dev;
 	struct zpcm512x_priv *zpcm512x =
 				snd_soc_component_get_drvdata(component);
 	unsigned long pllin_rate = 0;
@@ -1152,55 +1601,30 @@ static int zpcm512x_set_dividers(struct snd_soc_dai *dai,
 	unsigned long sample_rate;
 	unsigned long osr_rate;
 	unsigned long dacsrc_rate;
+	int lrclk_div = sol->lrclk_div;
 	int bclk_div;
-	int lrclk_div;
 	int dsp_div;
 	int dac_div;
 	unsigned long dac_rate;
 	int ncp_div;
 	int osr_div;
 	int ret;
-	int idac;
-	int fssp;
-	int gpio;
 
-	dev_dbg(dev, "%s: ENTER\n", __func__);
-
-	if (zpcm512x->bclk_ratio > 0) {
-		lrclk_div = zpcm512x->bclk_ratio;
-	} else {
-		lrclk_div = snd_soc_params_to_frame_size(params);
-
-		if (lrclk_div == 0) {
-			dev_err(dev, "%s: EXIT [-EINVAL]: No LRCLK?\n",
-				__func__);
-			return -EINVAL;
-		}
-	}
+	dd_trace(dev, "%s: ENTER: sclk_rate=%lu, rate=%u, lrclk_div=%d\n",
+		 __func__, sol->sclk_rate, sol->rate, lrclk_div);
 
 	if (!zpcm512x->pll_out) {
-		sck_rate = clk_get_rate(zpcm512x->sclk);
-		bclk_rate = params_rate(params) * lrclk_div;
+		sck_rate = sol->sclk_rate;
+		bclk_rate = sol->rate * lrclk_div;
 		bclk_div = DIV_ROUND_CLOSEST(sck_rate, bclk_rate);
 
 		mck_rate = sck_rate;
 	} else {
-		ret = snd_soc_params_to_bclk(params);
-		if (ret < 0) {
-			dev_err(dev, "%s: EXIT [%d]: failed to find suitable "
-				"BCLK!\n", __func__, ret);
-			return ret;
-		}
-		if (ret == 0) {
-			dev_err(dev, "%s: EXIT [-EINVAL]: no BCLK?\n",
-				__func__);
-			return -EINVAL;
-		}
-		bclk_rate = ret;
+		bclk_rate = sol->bclk_rate;
 
-		pllin_rate = clk_get_rate(zpcm512x->sclk);
+		pllin_rate = sol->sclk_rate;
 
-		sck_rate = zpcm512x_find_sck(dai, bclk_rate);
+		sck_rate = zpcm512x_find_sck(component, bclk_rate);
 		if (!sck_rate) {
 			dev_err(dev, "%s: EXIT [-EINVAL]: error finding "
 				"SCLK!\n", __func__);
@@ -1208,54 +1632,15 @@ static int zpcm512x_set_dividers(struct snd_soc_dai *dai,
 		}
 		pll_rate = 4 * sck_rate;
 
-		ret = zpcm512x_find_pll_coeff(dai, pllin_rate, pll_rate);
+		ret = zpcm512x_find_pll_coeff(component, sol, pllin_rate,
+					      pll_rate);
 		if (ret != 0) {
 			dev_err(dev, "%s: EXIT [%d]: error finding pll "
 				"coeff!\n", __func__, ret);
 			return ret;
 		}
 
-		ret = regmap_write(zpcm512x->regmap,
-				   PCM512x_PLL_COEFF_0, zpcm512x->pll_p - 1);
-		if (ret != 0) {
-			dev_err(dev, "%s: EXIT [%d]: failed to write PLL P!\n",
-				__func__, ret);
-			return ret;
-		}
-
-		ret = regmap_write(zpcm512x->regmap,
-				   PCM512x_PLL_COEFF_1, zpcm512x->pll_j);
-		if (ret != 0) {
-			dev_err(dev, "%s: EXIT [%d]: failed to write PLL J!\n",
-				__func__, ret);
-			return ret;
-		}
-
-		ret = regmap_write(zpcm512x->regmap,
-				   PCM512x_PLL_COEFF_2, zpcm512x->pll_d >> 8);
-		if (ret != 0) {
-			dev_err(dev, "%s: EXIT [%d]: failed to write PLL D "
-				"msb!\n", __func__, ret);
-			return ret;
-		}
-
-		ret = regmap_write(zpcm512x->regmap,
-				   PCM512x_PLL_COEFF_3, zpcm512x->pll_d & 0xff);
-		if (ret != 0) {
-			dev_err(dev, "%s: EXIT [%d]: failed to write PLL D "
-				"lsb!\n", __func__, ret);
-			return ret;
-		}
-
-		ret = regmap_write(zpcm512x->regmap,
-				   PCM512x_PLL_COEFF_4, zpcm512x->pll_r - 1);
-		if (ret != 0) {
-			dev_err(dev, "%s: EXIT [%d]: failed to write PLL R!\n",
-				__func__, ret);
-			return ret;
-		}
-
-		mck_rate = zpcm512x->real_pll;
+		mck_rate = sol->real_pll;
 
 		bclk_div = DIV_ROUND_CLOSEST(sck_rate, bclk_rate);
 	}
@@ -1273,7 +1658,7 @@ static int zpcm512x_set_dividers(struct snd_soc_dai *dai,
 	/* run DSP no faster than 50 MHz */
 	dsp_div = mck_rate > zpcm512x_dsp_max(component) ? 2 : 1;
 
-	dac_rate = zpcm512x_pllin_dac_rate(dai, osr_rate, pllin_rate);
+	dac_rate = zpcm512x_pllin_dac_rate(component, osr_rate, pllin_rate);
 	if (dac_rate) {
 		/* the desired clock rate is "compatible" with the pll input
 		 * clock, so use that clock as dac input instead of the pll
@@ -1281,24 +1666,7 @@ static int zpcm512x_set_dividers(struct snd_soc_dai *dai,
 		 * noise.
 		 */
 		dev_dbg(dev, "%s: using pll input as dac input\n", __func__);
-		ret = regmap_update_bits(zpcm512x->regmap, PCM512x_DAC_REF,
-					 PCM512x_SDAC, PCM512x_SDAC_GPIO);
-		if (ret != 0) {
-			dev_err(component->dev, "%s: EXIT [%d]: failed to set "
-				"gpio as dacref!\n", __func__, ret);
-			return ret;
-		}
-
-		gpio = PCM512x_GREF_GPIO1 + zpcm512x->pll_in - 1;
-		ret = regmap_update_bits(zpcm512x->regmap, PCM512x_GPIO_DACIN,
-					 PCM512x_GREF, gpio);
-		if (ret != 0) {
-			dev_err(component->dev, "%s: EXIT [%d]: failed to set "
-				"gpio %d as dacin!\n", __func__, ret, 
-				zpcm512x->pll_in);
-			return ret;
-		}
-
+		sol->dacin_pllin = true;
 		dacsrc_rate = pllin_rate;
 	} else {
 		/* run DAC no faster than 6144000 Hz */
@@ -1321,14 +1689,7 @@ static int zpcm512x_set_dividers(struct snd_soc_dai *dai,
 		dev_dbg(component->dev, "%s: dac_rate=%lu, sample_rate=%lu\n",
 			__func__, dac_rate, sample_rate);
 
-		ret = regmap_update_bits(zpcm512x->regmap, PCM512x_DAC_REF,
-					 PCM512x_SDAC, PCM512x_SDAC_SCK);
-		if (ret != 0) {
-			dev_err(component->dev, "%s: EXIT [%d]: failed to set "
-				"sck as dacref!\n", __func__, ret);
-			return ret;
-		}
-
+		sol->dacin_pllin = false;
 		dacsrc_rate = sck_rate;
 	}
 
@@ -1359,92 +1720,349 @@ static int zpcm512x_set_dividers(struct snd_soc_dai *dai,
 		}
 	}
 
-	idac = mck_rate / (dsp_div * sample_rate);
+	sol->dsp_div = dsp_div;
+	sol->dac_div = dac_div;
+	sol->ncp_div = ncp_div;
+	sol->osr_div = osr_div;
+	sol->bclk_div = bclk_div;
+	sol->idac = mck_rate / (dsp_div * sample_rate);
+	sol->sample_rate = sample_rate;
 
-	ret = regmap_write(zpcm512x->regmap, PCM512x_DSP_CLKDIV, dsp_div - 1);
-	if (ret != 0) {
-		dev_err(dev, "%s: EXIT [%d]: failed to write DSP divider!\n",
-			__func__, ret);
-		return ret;
+	if (sample_rate <= zpcm512x_dac_max(component, 48000))
+		sol->fssp = PCM512x_FSSP_48KHZ;
+	else if (sample_rate <= zpcm512x_dac_max(component, 96000))
+		sol->fssp = PCM512x_FSSP_96KHZ;
+	else if (sample_rate <= zpcm512x_dac_max(component, 192000))
+		sol->fssp = PCM512x_FSSP_192KHZ;
+	else
+		sol->fssp = PCM512x_FSSP_384KHZ;
+
+	dd_trace(dev, "%s: EXIT [0]\n", __func__);
+	return 0;
+}
+
+static bool zpcm512x_clk_key_equal(const struct zpcm512x_clk_solution *a,
+				   const struct zpcm512x_clk_solution *b)
+{
+	return a->sclk_rate == b->sclk_rate &&
+	       a->bclk_rate == b->bclk_rate &&
+	       a->rate == b->rate &&
+	       a->lrclk_div == b->lrclk_div &&
+	       a->overclock_pll == b->overclock_pll &&
+	       a->overclock_dac == b->overclock_dac &&
+	       a->overclock_dsp == b->overclock_dsp;
+}
+
+/*
+ * Return the cached solution for the key in @key, searching the clock tree
+ * and caching the result on a miss.
+ */
+static const struct zpcm512x_clk_solution *zpcm512x_clk_solution_get(
+					struct snd_soc_component *component,
+					struct zpcm512x_clk_solution *key)
+{
+	struct zpcm512x_priv *zpcm512x =
+				snd_soc_component_get_drvdata(component);
+	struct zpcm512x_clk_solution *sol;
+	int i, ret;
+
+	for (i = 0; i < zpcm512x->clk_cache_used; i++) {
+		sol = &zpcm512x->clk_cache[i];
+		if (zpcm512x_clk_key_equal(sol, key)) {
+#ifdef DDEBUG
+			dev_dbg(component->dev, "%s: cache hit [%d]\n",
+				__func__, i);
+#endif /* DDEBUG */
+			return sol;
+		}
 	}
 
-	ret = regmap_write(zpcm512x->regmap, PCM512x_DAC_CLKDIV, dac_div - 1);
-	if (ret != 0) {
-		dev_err(dev, "%s: EXIT [%d]: failed to write DAC divider!\n",
-			__func__, ret);
-		return ret;
+	ret = zpcm512x_solve_dividers(component, key);
+	if (ret != 0)
+		return ERR_PTR(ret);
+
+	sol = &zpcm512x->clk_cache[zpcm512x->clk_cache_next];
+	*sol = *key;
+	zpcm512x->clk_cache_next = (zpcm512x->clk_cache_next + 1)
+						% PCM512x_CLK_CACHE_SIZE;
+	if (zpcm512x->clk_cache_used < PCM512x_CLK_CACHE_SIZE)
+		zpcm512x->clk_cache_used++;
+
+	return sol;
+}
+
+static void zpcm512x_clk_key_init(struct zpcm512x_priv *zpcm512x,
+				  struct zpcm512x_clk_solution *key,
+				  unsigned long sclk_rate, unsigned int rate,
+				  int lrclk_div, unsigned long bclk_rate)
+{
+	memset(key, 0, sizeof(*key));
+	key->sclk_rate = sclk_rate;
+	key->bclk_rate = zpcm512x->pll_out ? bclk_rate : 0;
+	key->rate = rate;
+	key->lrclk_div = lrclk_div;
+	key->overclock_pll = zpcm512x->overclock_pll;
+	key->overclock_dac = zpcm512x->overclock_dac;
+	key->overclock_dsp = zpcm512x->overclock_dsp;
+}
+
+/*
+ * Solve every supported rate for the common 64 bit frame up front, so the
+ * first open at any of them skips the search too.
+ */
+static void zpcm512x_clk_cache_fill(struct snd_soc_component *component)
+{
+	struct zpcm512x_priv *zpcm512x =
+				snd_soc_component_get_drvdata(component);
+	struct zpcm512x_clk_solution key;
+	unsigned long sclk_rate;
+	int i, j;
+
+	dd_trace(component->dev, "%s: ENTER\n", __func__);
+
+	if (IS_ERR(zpcm512x->sclk)) {
+		dd_trace(component->dev, "%s: EXIT [void]: noop - no SCLK\n",
+			 __func__);
+		return;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(zpcm512x_dai_rates); i++) {
+		if (zpcm512x->pll_out) {
+			zpcm512x_clk_key_init(zpcm512x, &key,
+					      clk_get_rate(zpcm512x->sclk),
+					      zpcm512x_dai_rates[i], 64,
+					      zpcm512x_dai_rates[i] * 64);
+			zpcm512x_clk_solution_get(component, &key);
+			continue;
+		}
+
+		/* without PLL only the family that divides the rate */
+		for (j = 0; j < zpcm512x->constraints_no_pll.nrats; j++) {
+			sclk_rate = zpcm512x->rats_no_pll[j].num * 64;
+			if (sclk_rate % (zpcm512x_dai_rates[i] * 64))
+				continue;
+			zpcm512x_clk_key_init(zpcm512x, &key, sclk_rate,
+					      zpcm512x_dai_rates[i], 64, 0);
+			zpcm512x_clk_solution_get(component, &key);
+		}
 	}
 
-	ret = regmap_write(zpcm512x->regmap, PCM512x_NCP_CLKDIV, ncp_div - 1);
+	dd_trace(component->dev, "%s: EXIT [void]: %d solutions\n", __func__,
+		 zpcm512x->clk_cache_used);
+}
+
+/*
+ * Write one run of clock tree registers as a single auto-incrementing block
+ * write. The values come straight from the clock solution, so nothing is
+ * staged in the register cache and other regmap users are never shut out.
+ */
+static int zpcm512x_write_clk_block(struct zpcm512x_priv *zpcm512x,
+				    struct device *dev, unsigned int first,
+				    const u8 *buf, size_t count)
+{
+	int ret;
+
+	ret = regmap_bulk_write(zpcm512x->regmap, first, buf, count);
 	if (ret != 0) {
-		dev_err(dev, "%s: EXIT [%d]: failed to write NCP divider!\n",
-			__func__, ret);
+		dev_err(dev, "%s: failed to write regs %u..%zu: %d\n",
+			__func__, first, first + count - 1, ret);
 		return ret;
 	}
+#ifdef DDEBUG
+	dev_dbg(dev, "%s: wrote regs %u..%zu\n", __func__, first,
+		first + count - 1);
+#endif /* DDEBUG */
 
-	ret = regmap_write(zpcm512x->regmap, PCM512x_OSR_CLKDIV, osr_div - 1);
-	if (ret != 0) {
-		dev_err(dev, "%s: EXIT [%d]: failed to write OSR divider!\n",
-			__func__, ret);
-		return ret;
+	return 0;
+}
+
+/*
+ * The clock tree registers go out as three block writes, split where the
+ * map has a hole (reg 31 is reserved): PLL P/J/D/R (20-24), only when the
+ * PLL is in use, DSP/DAC/NCP/OSR dividers (27-30) and BCK/LRCK dividers,
+ * fs speed mode and IDAC (32-36).
+ */
+static int zpcm512x_write_dividers(struct snd_soc_component *component,
+				   const struct zpcm512x_clk_solution *sol)
+{
+	struct device *dev = component->dev;
+	struct zpcm512x_priv *zpcm512x =
+				snd_soc_component_get_drvdata(component);
+	u8 pll[PCM512x_PLL_COEFF_4 - PCM512x_PLL_COEFF_0 + 1];
+	u8 div[PCM512x_OSR_CLKDIV - PCM512x_DSP_CLKDIV + 1];
+	u8 mclk[PCM512x_IDAC_2 - PCM512x_MASTER_CLKDIV_1 + 1];
+	unsigned int fssp;
+	int ret;
+	int gpio;
+
+	if (sol->dacin_pllin) {
+		ret = regmap_update_bits(zpcm512x->regmap, PCM512x_DAC_REF,
+					 PCM512x_SDAC, PCM512x_SDAC_GPIO);
+		if (ret != 0) {
+			dev_err(component->dev, "%s: EXIT [%d]: failed to set "
+				"gpio as dacref!\n", __func__, ret);
+			return ret;
+		}
+
+		gpio = PCM512x_GREF_GPIO1 + zpcm512x->pll_in - 1;
+		ret = regmap_update_bits(zpcm512x->regmap, PCM512x_GPIO_DACIN,
+					 PCM512x_GREF, gpio);
+		if (ret != 0) {
+			dev_err(component->dev, "%s: EXIT [%d]: failed to set "
+				"gpio %d as dacin!\n", __func__, ret, 
+				zpcm512x->pll_in);
+			return ret;
+		}
+	} else {
+		ret = regmap_update_bits(zpcm512x->regmap, PCM512x_DAC_REF,
+					 PCM512x_SDAC, PCM512x_SDAC_SCK);
+		if (ret != 0) {
+			dev_err(component->dev, "%s: EXIT [%d]: failed to set "
+				"sck as dacref!\n", __func__, ret);
+			return ret;
+		}
 	}
 
-	ret = regmap_write(zpcm512x->regmap,
-			   PCM512x_MASTER_CLKDIV_1, bclk_div - 1);
+	/* keep the reserved bits of the fs speed mode register (cache hit) */
+	ret = regmap_read(zpcm512x->regmap, PCM512x_FS_SPEED_MODE, &fssp);
 	if (ret != 0) {
-		dev_err(dev, "%s: EXIT [%d]: failed to write BCLK divider!\n",
+		dev_err(dev, "%s: EXIT [%d]: failed to read fs speed!\n",
 			__func__, ret);
 		return ret;
 	}
+	fssp = (fssp & ~PCM512x_FSSP) | sol->fssp;
 
-	ret = regmap_write(zpcm512x->regmap,
-			   PCM512x_MASTER_CLKDIV_2, lrclk_div - 1);
-	if (ret != 0) {
-		dev_err(dev, "%s: EXIT [%d]: failed to write LRCLK divider!\n",
-			__func__, ret);
-		return ret;
+	if (zpcm512x->pll_out) {
+		pll[0] = sol->pll_p - 1;
+		pll[1] = sol->pll_j;
+		pll[2] = sol->pll_d >> 8;
+		pll[3] = sol->pll_d & 0xff;
+		pll[4] = sol->pll_r - 1;
+
+		ret = zpcm512x_write_clk_block(zpcm512x, dev,
+					       PCM512x_PLL_COEFF_0, pll,
+					       ARRAY_SIZE(pll));
+		if (ret != 0)
+			return ret;
 	}
 
-	ret = regmap_write(zpcm512x->regmap, PCM512x_IDAC_1, idac >> 8);
-	if (ret != 0) {
-		dev_err(dev, "%s: EXIT [%d]: failed to write IDAC msb "
-			"divider!\n", __func__, ret);
+	div[0] = sol->dsp_div - 1;
+	div[1] = sol->dac_div - 1;
+	div[2] = sol->ncp_div - 1;
+	div[3] = sol->osr_div - 1;
+
+	ret = zpcm512x_write_clk_block(zpcm512x, dev, PCM512x_DSP_CLKDIV, div,
+				       ARRAY_SIZE(div));
+	if (ret != 0)
 		return ret;
+
+	mclk[0] = sol->bclk_div - 1;
+	mclk[1] = sol->lrclk_div - 1;
+	mclk[2] = fssp;
+	mclk[3] = sol->idac >> 8;
+	mclk[4] = sol->idac & 0xff;
+
+	return zpcm512x_write_clk_block(zpcm512x, dev, PCM512x_MASTER_CLKDIV_1,
+					mclk, ARRAY_SIZE(mclk));
+}
+
+static int __zpcm512x_set_dividers(struct snd_soc_dai *dai,
+				   struct snd_pcm_hw_params *params)
+{
+	struct device *dev = dai->dev;
+	struct snd_soc_component *component = dai->component;
+	struct zpcm512x_priv *zpcm512x =
+				snd_soc_component_get_drvdata(component);
+	const struct zpcm512x_clk_solution *sol;
+	struct zpcm512x_clk_solution key;
+	unsigned long bclk_rate = 0;
+	int lrclk_div;
+	int ret;
+
+	dd_trace(dev, "%s: ENTER\n", __func__);
+
+	if (zpcm512x->bclk_ratio > 0) {
+		lrclk_div = zpcm512x->bclk_ratio;
+	} else {
+		lrclk_div = snd_soc_params_to_frame_size(params);
+
+		if (lrclk_div == 0) {
+			dev_err(dev, "%s: EXIT [-EINVAL]: No LRCLK?\n",
+				__func__);
+			return -EINVAL;
+		}
 	}
 
-	ret = regmap_write(zpcm512x->regmap, PCM512x_IDAC_2, idac & 0xff);
-	if (ret != 0) {
-		dev_err(dev, "%s: EXIT [%d]: failed to write IDAC lsb "
-			"divider!\n", __func__, ret);
-		return ret;
+	if (zpcm512x->pll_out) {
+		ret = snd_soc_params_to_bclk(params);
+		if (ret < 0) {
+			dev_err(dev, "%s: EXIT [%d]: failed to find suitable "
+				"BCLK!\n", __func__, ret);
+			return ret;
+		}
+		if (ret == 0) {
+			dev_err(dev, "%s: EXIT [-EINVAL]: no BCLK?\n",
+				__func__);
+			return -EINVAL;
+		}
+		bclk_rate = ret;
 	}
 
-	if (sample_rate <= zpcm512x_dac_max(component, 48000))
-		fssp = PCM512x_FSSP_48KHZ;
-	else if (sample_rate <= zpcm512x_dac_max(component, 96000))
-		fssp = PCM512x_FSSP_96KHZ;
-	else if (sample_rate <= zpcm512x_dac_max(component, 192000))
-		fssp = PCM512x_FSSP_192KHZ;
-	else
-		fssp = PCM512x_FSSP_384KHZ;
-	ret = regmap_update_bits(zpcm512x->regmap, PCM512x_FS_SPEED_MODE,
-				 PCM512x_FSSP, fssp);
-	if (ret != 0) {
-		dev_err(component->dev, "%s: EXIT [%d]: failed to set fs "
-			"speed!\n", __func__, ret);
+	zpcm512x_clk_key_init(zpcm512x, &key, clk_get_rate(zpcm512x->sclk),
+			      params_rate(params), lrclk_div, bclk_rate);
+	sol = zpcm512x_clk_solution_get(component, &key);
+	if (IS_ERR(sol)) {
+		ret = PTR_ERR(sol);
+		dev_err(dev, "%s: EXIT [%d]: no clock tree solution!\n",
+			__func__, ret);
 		return ret;
 	}
 
-	dev_dbg(component->dev, "%s: EXIT [0]: DSP div=%d, DAC div=%d, "
-		"NCP div=%d, OSR div=%d, BCK div=%d, LRCK div=%d, IDAC=%d, "
-		"1<<FSSP=%d\n", __func__, dsp_div, dac_div, ncp_div, osr_div,
-		bclk_div, lrclk_div, idac, 1 << fssp);
+	ret = zpcm512x_write_dividers(component, sol);
+	if (ret != 0)
+		return ret;
+
+	dd_trace(component->dev, "%s: EXIT [0]: PLL P=%d, J=%d, D=%d, R=%d, "
+		 "DSP div=%d, DAC div=%d, NCP div=%d, OSR div=%d, BCK div=%d, "
+		 "LRCK div=%d, IDAC=%d, 1<<FSSP=%d\n", __func__, sol->pll_p,
+		 sol->pll_j, sol->pll_d, sol->pll_r, sol->dsp_div, sol->dac_div,
+		 sol->ncp_div, sol->osr_div, sol->bclk_div, sol->lrclk_div,
+		 sol->idac, 1 << sol->fssp);
 	return 0;
 }
 
-static int zpcm512x_dai_hw_params(struct snd_pcm_substream *substream,
-				  struct snd_pcm_hw_params *params,
-				  struct snd_soc_dai *dai)
+static int zpcm512x_set_dividers(struct snd_soc_dai *dai,
+				 struct snd_pcm_hw_params *params)
+{
+	struct zpcm512x_priv *zpcm512x =
+				snd_soc_component_get_drvdata(dai->component);
+	struct dd_span span;
+	int ret;
+
+	dd_span_begin(&span, zpcm512x->regmap);
+	ret = __zpcm512x_set_dividers(dai, params);
+	trace_dd_set_dividers(dai->dev, params_rate(params),
+			      clk_get_rate(zpcm512x->sclk), ret, &span);
+	return ret;
+}
+
+#ifdef PCM512X_ASYNC_MUTE
+/*
+ * Bounded wait for the latest mute request to be confirmed, e.g. before
+ * powering down or reclocking.
+ */
+static void zpcm512x_mute_wait(struct zpcm512x_priv *zpcm512x,
+			       struct device *dev)
+{
+	if (!wait_for_completion_timeout(&zpcm512x->mute_done,
+					 msecs_to_jiffies(20)))
+		dev_warn(dev, "%s: mute not confirmed!\n", __func__);
+}
+#endif /* PCM512X_ASYNC_MUTE */
+
+static int __zpcm512x_dai_hw_params(struct snd_pcm_substream *substream,
+				    struct snd_pcm_hw_params *params,
+				    struct snd_soc_dai *dai)
 {
 	struct snd_soc_component *component = dai->component;
 	struct zpcm512x_priv *zpcm512x =
@@ -1455,12 +2073,12 @@ static int zpcm512x_dai_hw_params(struct snd_pcm_substream *substream,
 	
 	snd_pcm_format_t format = params_format(params);
         
-	dev_dbg(component->dev, "%s: ENTER: frequency=%u, format=%s, "
-		"sample_bits=%u, physical_bits=%u, channels=%u\n", __func__,
-		params_rate(params), snd_pcm_format_name(format),
-		snd_pcm_format_width(format),
-		snd_pcm_format_physical_width(format),
-		params_channels(params));
+	dd_trace(component->dev, "%s: ENTER: frequency=%u, format=%s, "
+		 "sample_bits=%u, physical_bits=%u, channels=%u\n", __func__,
+		 params_rate(params), snd_pcm_format_name(format),
+		 snd_pcm_format_width(format),
+		 snd_pcm_format_physical_width(format),
+		 params_channels(params));
 
 	switch (params_width(params)) {
 	case 16:
@@ -1481,6 +2099,11 @@ static int zpcm512x_dai_hw_params(struct snd_pcm_substream *substream,
 		return -EINVAL;
 	}
 
+#ifdef PCM512X_ASYNC_MUTE
+	/* don't reclock under a mute confirmation still polling the outputs */
+	zpcm512x_mute_wait(zpcm512x, component->dev);
+#endif /* PCM512X_ASYNC_MUTE */
+
 	ret = regmap_update_bits(zpcm512x->regmap, PCM512x_I2S_1,
 				 PCM512x_ALEN, alen);
 	if (ret != 0) {
@@ -1588,6 +2211,7 @@ static int zpcm512x_dai_hw_params(struct snd_pcm_substream *substream,
 				"enable pll!\n", __func__, ret);
 			return ret;
 		}
+		zpcm512x->stats.pll_resets++;
 
 		gpio = PCM512x_G1OE << (zpcm512x->pll_out - 1);
 		ret = regmap_update_bits(zpcm512x->regmap, PCM512x_GPIO_EN,
@@ -1627,10 +2251,30 @@ static int zpcm512x_dai_hw_params(struct snd_pcm_substream *substream,
 	}
 
 skip_pll:
-	dev_dbg(component->dev, "%s: EXIT [0]\n", __func__);
+	dd_trace(component->dev, "%s: EXIT [0]\n", __func__);
 	return 0;
 }
 
+static int zpcm512x_dai_hw_params(struct snd_pcm_substream *substream,
+				  struct snd_pcm_hw_params *params,
+				  struct snd_soc_dai *dai)
+{
+	struct zpcm512x_priv *zpcm512x =
+				snd_soc_component_get_drvdata(dai->component);
+	struct dd_span span;
+	int ret;
+
+	dd_span_begin(&span, zpcm512x->regmap);
+	ret = __zpcm512x_dai_hw_params(substream, params, dai);
+	trace_dd_hw_params(dai->dev, params_rate(params), params_width(params),
+			   ret, &span);
+	dd_hist_add(&zpcm512x->stats.hw_params, span.start);
+	if (!ret)
+		dd_rate_switch(zpcm512x->stats.rate_switches,
+			       &zpcm512x->stats.rate, params_rate(params));
+	return ret;
+}
+
 static int zpcm512x_dai_set_fmt(struct snd_soc_dai *dai, unsigned int fmt)
 {
 	struct snd_soc_component *component = dai->component;
@@ -1643,14 +2287,14 @@ static int zpcm512x_dai_set_fmt(struct snd_soc_dai *dai, unsigned int fmt)
 	int ret;
 
 #ifdef DDEBUG
-	dev_dbg(component->dev, "%s: ENTER: fmt=0x%x (MASTER=%s, FORMAT=%s, "
-		"INV=%s, CLOCK=%s)\n", __func__, fmt,
-		dd_utils_log_daifmt_master(fmt),
-		dd_utils_log_daifmt_format(fmt),
-		dd_utils_log_daifmt_inverse(fmt),
-		dd_utils_log_daifmt_clock(fmt));
+	dd_trace(component->dev, "%s: ENTER: fmt=0x%x (MASTER=%s, FORMAT=%s, "
+		 "INV=%s, CLOCK=%s)\n", __func__, fmt,
+		 dd_utils_log_daifmt_master(fmt),
+		 dd_utils_log_daifmt_format(fmt),
+		 dd_utils_log_daifmt_inverse(fmt),
+		 dd_utils_log_daifmt_clock(fmt));
 #else
-	dev_dbg(component->dev, "%s: ENTER: fmt=0x%x\n", __func__, fmt);
+	dd_trace(component->dev, "%s: ENTER: fmt=0x%x\n", __func__, fmt);
 #endif /* DDEBUG */
 
 	switch (fmt & SND_SOC_DAIFMT_MASTER_MASK) {
@@ -1767,7 +2411,7 @@ static int zpcm512x_dai_set_fmt(struct snd_soc_dai *dai, unsigned int fmt)
 
 	zpcm512x->fmt = fmt;
 
-	dev_dbg(component->dev, "%s: EXIT [0]\n", __func__);
+	dd_trace(component->dev, "%s: EXIT [0]\n", __func__);
 	return 0;
 }
 
@@ -1778,7 +2422,7 @@ static int zpcm512x_dai_set_bclk_ratio(struct snd_soc_dai *dai,
 	struct zpcm512x_priv *zpcm512x =
 				snd_soc_component_get_drvdata(component);
 
-	dev_dbg(component->dev, "%s: ENTER: ratio=%d\n", __func__, ratio);
+	dd_trace(component->dev, "%s: ENTER: ratio=%d\n", __func__, ratio);
 
 	if (ratio > 256) {
 		dev_err(component->dev, "%s: EXIT [-EINVAL]: ratio>256: "
@@ -1788,12 +2432,141 @@ static int zpcm512x_dai_set_bclk_ratio(struct snd_soc_dai *dai,
 
 	zpcm512x->bclk_ratio = ratio;
 
-	dev_dbg(component->dev, "%s: EXIT [0]\n", __func__);
+	dd_trace(component->dev, "%s: EXIT [0]\n", __func__);
 	return 0;
 }
 
-static int zpcm512x_dai_mute_stream(struct snd_soc_dai *dai, int mute,
-				    int direction)
+/*
+ * An analog mute that never settles is nearly always down to the clocks,
+ * so only look at the clock error status on this (already slow) path.
+ */
+static void zpcm512x_mute_poll_timeout(struct zpcm512x_priv *zpcm512x)
+{
+	unsigned int status;
+
+	zpcm512x->stats.mute_poll_timeouts++;
+	if (!regmap_read(zpcm512x->regmap, PCM512x_CLOCK_STATUS, &status) &&
+	    status)
+		zpcm512x->stats.clk_detect_errors++;
+}
+
+#ifdef PCM512X_ASYNC_MUTE
+/*
+ * Wait for the analog outputs to reach the state of the latest mute request
+ * and, for a mute, then drop the gpio mute. A newer request bumps mute_seq,
+ * which ends the poll early and leaves the gpio to the newer request.
+ */
+static void zpcm512x_mute_work(struct work_struct *work)
+{
+	struct zpcm512x_priv *zpcm512x =
+			container_of(work, struct zpcm512x_priv, mute_work);
+	struct device *dev = regmap_get_device(zpcm512x->regmap);
+	unsigned int seq, mute_det, expect, bits;
+	struct dd_span span;
+	bool mute;
+	int ret;
+
+	mutex_lock(&zpcm512x->mutex);
+	seq = zpcm512x->mute_seq;
+	bits = READ_ONCE(zpcm512x->mute);
+	mute = bits & 0x1;
+	expect = mute ? 0 : ((~bits >> 1) & 0x3);
+	mutex_unlock(&zpcm512x->mutex);
+
+	dd_span_begin(&span, zpcm512x->regmap);
+	ret = regmap_read_poll_timeout(zpcm512x->regmap,
+				       PCM512x_ANALOG_MUTE_DET, mute_det,
+				       (mute_det & 0x3) == expect ||
+				       READ_ONCE(zpcm512x->mute_seq) != seq,
+				       200, 10000);
+	trace_dd_mute_poll(dev, mute_det, expect, ret, &span);
+	if (ret == -ETIMEDOUT)
+		zpcm512x_mute_poll_timeout(zpcm512x);
+	if (ret < 0)
+		dev_warn(dev, "%s: polling for ANALOG_MUTE_DET returns [%d]\n",
+			 __func__, ret);
+
+	mutex_lock(&zpcm512x->mutex);
+	if (zpcm512x->mute_seq == seq) {
+		/* gpio mute */
+		if (mute && zpcm512x->mute_gpio && zpcm512x->auto_gpio_mute) {
+#ifdef DDEBUG
+			dev_dbg(dev, "%s: mute: "
+				"gpiod_set_raw_value_cansleep(mute, 0)\n",
+				__func__);
+#endif /* DDEBUG */
+			gpiod_set_raw_value_cansleep(zpcm512x->mute_gpio, 0);
+		}
+		complete_all(&zpcm512x->mute_done);
+	}
+	mutex_unlock(&zpcm512x->mutex);
+}
+
+static int __zpcm512x_dai_mute_stream(struct snd_soc_dai *dai, int mute,
+				      int direction)
+{
+	struct snd_soc_component *component = dai->component;
+	struct zpcm512x_priv *zpcm512x =
+				snd_soc_component_get_drvdata(component);
+	unsigned int mute_enable = PCM512x_RQML | PCM512x_RQMR;
+	int ret;
+
+	dd_trace(component->dev, "%s: ENTER: mute=%d, direction=%d\n", __func__,
+		 mute, direction);
+
+	if (direction != SNDRV_PCM_STREAM_PLAYBACK) {
+		dd_trace(component->dev, "%s: EXIT [0]: noop - (direction != "
+			 "SNDRV_PCM_STREAM_PLAYBACK)\n", __func__);
+		return 0;
+	}
+
+	mutex_lock(&zpcm512x->mutex);
+
+	if (mute) {
+		zpcm512x_mute_bits(zpcm512x, 0, 0x1);
+		ret = regmap_update_bits(zpcm512x->regmap, PCM512x_MUTE,
+					 mute_enable, mute_enable);
+	} else {
+		/* gpio unmute */
+		if (zpcm512x->mute_gpio && zpcm512x->auto_gpio_mute) {
+#ifdef DDEBUG
+			dev_dbg(component->dev, "%s: unmute: "
+				"gpiod_set_raw_value_cansleep(mute, 1)\n",
+				__func__);
+#endif /* DDEBUG */
+			gpiod_set_raw_value_cansleep(zpcm512x->mute_gpio, 1);
+		}
+
+		zpcm512x_mute_bits(zpcm512x, 0x1, 0);
+		ret = zpcm512x_update_mute(component);
+	}
+
+	if (ret != 0) {
+		mutex_unlock(&zpcm512x->mutex);
+		dev_err(component->dev, "%s: EXIT [%d]: failed to update "
+			"digital mute!\n", __func__, ret);
+		return ret;
+	}
+
+	/*
+	 * Supersede any confirmation still in flight, but only once the
+	 * request has reached the device: a failed one has nothing to
+	 * confirm and must not leave mute_done waiting for a worker that is
+	 * never queued.
+	 */
+	WRITE_ONCE(zpcm512x->mute_seq, zpcm512x->mute_seq + 1);
+	reinit_completion(&zpcm512x->mute_done);
+
+	mutex_unlock(&zpcm512x->mutex);
+
+	schedule_work(&zpcm512x->mute_work);
+
+	dd_trace(component->dev, "%s: EXIT [0]\n", __func__);
+	return 0;
+}
+#else
+static int __zpcm512x_dai_mute_stream(struct snd_soc_dai *dai, int mute,
+				      int direction)
 {
 	struct snd_soc_component *component = dai->component;
 	struct zpcm512x_priv *zpcm512x =
@@ -1803,20 +2576,21 @@ static int zpcm512x_dai_mute_stream(struct snd_soc_dai *dai, int mute,
 	unsigned int mute_enable = PCM512x_RQML | PCM512x_RQMR;
 	char *mute_enable_log = "LEFT|RIGHT";
 	int polling_timeout_us = 10000;
+	struct dd_span span;
 
-	dev_dbg(component->dev, "%s: ENTER: mute=%d, direction=%d\n", __func__,
-		mute, direction);
+	dd_trace(component->dev, "%s: ENTER: mute=%d, direction=%d\n", __func__,
+		 mute, direction);
 
 	if (direction != SNDRV_PCM_STREAM_PLAYBACK) {
-		dev_dbg(component->dev, "%s: EXIT [0]: noop - (direction != "
-			"SNDRV_PCM_STREAM_PLAYBACK)\n", __func__);
+		dd_trace(component->dev, "%s: EXIT [0]: noop - (direction != "
+			 "SNDRV_PCM_STREAM_PLAYBACK)\n", __func__);
 		return 0;
 	}
 
 	mutex_lock(&zpcm512x->mutex);
 
 	if (mute) {
-		zpcm512x->mute |= 0x1;
+		zpcm512x_mute_bits(zpcm512x, 0, 0x1);
 #ifdef DDEBUG
 		dev_dbg(component->dev, "%s: set PCM512x_MUTE=%s\n", __func__,
 			mute_enable_log);
@@ -1830,25 +2604,24 @@ static int zpcm512x_dai_mute_stream(struct snd_soc_dai *dai, int mute,
 				mute_enable_log);
 			return ret;
 		}
-#ifdef DDEBUG
-		dev_dbg(component->dev, "%s: polling for ANALOG_MUTE_DET\n",
-			__func__);
-#endif /* DDEBUG */
+		dd_span_begin(&span, zpcm512x->regmap);
 		ret = regmap_read_poll_timeout(zpcm512x->regmap,
 					       PCM512x_ANALOG_MUTE_DET,
 					       mute_det,
 					       (mute_det & 0x3) == 0,
 					       200, polling_timeout_us);
+		trace_dd_mute_poll(component->dev, mute_det, 0, ret, &span);
 		/* 
 		 * Returns 0 on success and -ETIMEDOUT upon a timeout or the 
 		 * regmap_read error return value in case of a error read.
 		 */
 		if (ret < 0) {
-			if (ret == -ETIMEDOUT)
+			if (ret == -ETIMEDOUT) {
+				zpcm512x_mute_poll_timeout(zpcm512x);
 				dev_warn(component->dev, "%s: polling for "
 					 "ANALOG_MUTE_DET returns "
 					 "[-ETIMEDOUT]\n", __func__);
-			else
+			} else
 				dev_warn(component->dev, "%s: polling for "
 					 "ANALOG_MUTE_DET returns [%d]\n",
 					 __func__, ret);
@@ -1874,7 +2647,7 @@ static int zpcm512x_dai_mute_stream(struct snd_soc_dai *dai, int mute,
 			gpiod_set_raw_value_cansleep(zpcm512x->mute_gpio, 1);
 		}
 
-		zpcm512x->mute &= ~0x1;
+		zpcm512x_mute_bits(zpcm512x, 0x1, 0);
 		ret = zpcm512x_update_mute(component);
 		if (ret != 0) {
 			mutex_unlock(&zpcm512x->mutex);
@@ -1882,25 +2655,26 @@ static int zpcm512x_dai_mute_stream(struct snd_soc_dai *dai, int mute,
 				"update digital mute!\n", __func__, ret);
 			return ret;
 		}
-#ifdef DDEBUG
-		dev_dbg(component->dev, "%s: polling for ANALOG_MUTE_DET\n",
-			__func__);
-#endif /* DEBUG */
+		dd_span_begin(&span, zpcm512x->regmap);
 		ret = regmap_read_poll_timeout(zpcm512x->regmap,
 					       PCM512x_ANALOG_MUTE_DET,
 					       mute_det,
-			(mute_det & 0x3) == ((~zpcm512x->mute >> 1) & 0x3),
+		(mute_det & 0x3) == ((~READ_ONCE(zpcm512x->mute) >> 1) & 0x3),
 					       200, polling_timeout_us);
+		trace_dd_mute_poll(component->dev, mute_det,
+				   (~READ_ONCE(zpcm512x->mute) >> 1) & 0x3, ret,
+				   &span);
 		/* 
 		 * Returns 0 on success and -ETIMEDOUT upon a timeout or the 
 		 * regmap_read error return value in case of a error read.
 		 */
 		if (ret < 0) {
-			if (ret == -ETIMEDOUT)
+			if (ret == -ETIMEDOUT) {
+				zpcm512x_mute_poll_timeout(zpcm512x);
 				dev_warn(component->dev, "%s: polling for "
 					 "ANALOG_MUTE_DET returns "
 					 "[-ETIMEDOUT]\n", __func__);
-			else
+			} else
 				dev_warn(component->dev, "%s: polling for "
 					 "ANALOG_MUTE_DET returns [%d]\n",
 					 __func__, ret);
@@ -1910,9 +2684,42 @@ static int zpcm512x_dai_mute_stream(struct snd_soc_dai *dai, int mute,
 
 	mutex_unlock(&zpcm512x->mutex);
 
-	dev_dbg(component->dev, "%s: EXIT [0]\n", __func__);
+	dd_trace(component->dev, "%s: EXIT [0]\n", __func__);
 	return 0;
 }
+#endif /* PCM512X_ASYNC_MUTE */
+
+static int zpcm512x_dai_mute_stream(struct snd_soc_dai *dai, int mute,
+				    int direction)
+{
+	struct zpcm512x_priv *zpcm512x =
+				snd_soc_component_get_drvdata(dai->component);
+	struct dd_span span;
+	int ret;
+
+	trace_dd_mute_stream_begin(dai->dev, mute, direction);
+	dd_span_begin(&span, zpcm512x->regmap);
+	ret = __zpcm512x_dai_mute_stream(dai, mute, direction);
+	trace_dd_mute_stream(dai->dev, mute, direction, ret, &span);
+	dd_hist_add(&zpcm512x->stats.mute_stream, span.start);
+	return ret;
+}
+
+/*
+ * Called with the stream lock held, so no register access: the program
+ * comes from the value recorded by the DSP Program and Latency Profile
+ * puts.
+ */
+static snd_pcm_sframes_t zpcm512x_dai_delay(struct snd_pcm_substream *substream,
+					    struct snd_soc_dai *dai)
+{
+	struct zpcm512x_priv *zpcm512x =
+				snd_soc_component_get_drvdata(dai->component);
+
+	return dd_filter_delay(zpcm512x_filter_delays,
+			       ARRAY_SIZE(zpcm512x_filter_delays),
+			       READ_ONCE(zpcm512x->dsp_program));
+}
 
 static const struct snd_soc_dai_ops zpcm512x_dai_ops = {
 	.startup         = zpcm512x_dai_startup,
@@ -1920,6 +2727,7 @@ static const struct snd_soc_dai_ops zpcm512x_dai_ops = {
 	.set_fmt         = zpcm512x_dai_set_fmt,
 	.mute_stream     = zpcm512x_dai_mute_stream,
  	.set_bclk_ratio  = zpcm512x_dai_set_bclk_ratio,
+	.delay           = zpcm512x_dai_delay,
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(5,9,0)
  	.no_capture_mute = 1,
 #endif
@@ -1941,7 +2749,43 @@ static struct snd_soc_dai_driver zpcm512x_dai_drv = {
 	.ops      = &zpcm512x_dai_ops,
 };
 
+#ifdef CONFIG_DEBUG_FS
+static void zpcm512x_debugfs_init(struct snd_soc_component *component)
+{
+	struct zpcm512x_priv *zpcm512x = snd_soc_component_get_drvdata(component);
+	struct dentry *dentry = component->debugfs_root;
+
+	dd_regmap_i2c_debugfs(zpcm512x->regmap, dentry);
+	dd_rate_switches_debugfs(dentry, zpcm512x->stats.rate_switches);
+	debugfs_create_u32("pll_resets", 0444, dentry,
+			   &zpcm512x->stats.pll_resets);
+	debugfs_create_u32("mute_poll_timeouts", 0444, dentry,
+			   &zpcm512x->stats.mute_poll_timeouts);
+	debugfs_create_u32("clk_detect_errors", 0444, dentry,
+			   &zpcm512x->stats.clk_detect_errors);
+	dd_hist_debugfs("hw_params_us", dentry, &zpcm512x->stats.hw_params);
+	dd_hist_debugfs("mute_stream_us", dentry,
+			&zpcm512x->stats.mute_stream);
+	dd_hist_debugfs("runtime_resume_us", dentry,
+			&zpcm512x->stats.runtime_resume);
+}
+#endif /* CONFIG_DEBUG_FS */
+
+static int zpcm512x_component_probe(struct snd_soc_component *component)
+{
+	dd_trace(component->dev, "%s: ENTER\n", __func__);
+
+	zpcm512x_clk_cache_fill(component);
+#ifdef CONFIG_DEBUG_FS
+	zpcm512x_debugfs_init(component);
+#endif /* CONFIG_DEBUG_FS */
+
+	dd_trace(component->dev, "%s: EXIT [0]\n", __func__);
+	return 0;
+}
+
 static const struct snd_soc_component_driver zpcm512x_comp_drv = {
+	.probe                 = zpcm512x_component_probe,
 	.set_bias_level        = zpcm512x_set_bias_level,
 	.controls              = zpcm512x_controls,
 	.num_controls          = ARRAY_SIZE(zpcm512x_controls),
@@ -1986,7 +2830,7 @@ int zpcm512x_probe(struct device *dev, struct regmap *regmap)
 	struct zpcm512x_priv *zpcm512x;
 	int i, ret;
 
-	dev_dbg(dev, "%s: ENTER\n", __func__);
+	dd_trace(dev, "%s: ENTER\n", __func__);
 
 #ifdef DDEBUG
 	dev_dbg(dev, "%s: allocate memory for private data\n", __func__);
@@ -1999,6 +2843,21 @@ int zpcm512x_probe(struct device *dev, struct regmap *regmap)
 	}
 
 	mutex_init(&zpcm512x->mutex);
+	spin_lock_init(&zpcm512x->mute_lock);
+	/* register default, see zpcm512x_reg_defaults */
+	zpcm512x->dsp_program = 0x01;
+#ifdef PCM512X_LATENCY_PROFILE
+	zpcm512x->profile = PCM512x_PROFILE_DEFAULT;
+#endif /* PCM512X_LATENCY_PROFILE */
+#ifdef PCM512X_ASYNC_MUTE
+	INIT_WORK(&zpcm512x->mute_work, zpcm512x_mute_work);
+	init_completion(&zpcm512x->mute_done);
+	/* nothing in flight yet */
+	complete_all(&zpcm512x->mute_done);
+#endif /* PCM512X_ASYNC_MUTE */
+#ifdef DD_VOLUME_COALESCE
+	dd_vol_init(&zpcm512x->vol, regmap, PCM512x_DIGITAL_VOLUME_2);
+#endif /* DD_VOLUME_COALESCE */
 	
 	dev_set_drvdata(dev, zpcm512x);
 	zpcm512x->regmap = regmap;
@@ -2125,6 +2984,8 @@ int zpcm512x_probe(struct device *dev, struct regmap *regmap)
 				"%d\n", __func__, ret);
 			goto err;
 		}
+
+		zpcm512x_init_ratnums(zpcm512x, dev);
 	}
 
 #ifdef CONFIG_OF
@@ -2225,7 +3086,7 @@ int zpcm512x_probe(struct device *dev, struct regmap *regmap)
 		goto err_gpio;
 	}
 
-	dev_dbg(dev, "%s: EXIT [0]\n", __func__);
+	dd_trace(dev, "%s: EXIT [0]\n", __func__);
 	return 0;
 
 err_gpio:
@@ -2261,7 +3122,7 @@ err:
 		else
 			dev_info(dev, "%s: EXIT [-EPROBE_DEFER]\n", __func__);
 	} else
-		dev_dbg(dev, "%s: EXIT [%d]\n", __func__, ret);
+		dd_trace(dev, "%s: EXIT [%d]\n", __func__, ret);
 
 	return ret;
 }
@@ -2271,7 +3132,14 @@ void zpcm512x_remove(struct device *dev)
 {
 	struct zpcm512x_priv *zpcm512x = dev_get_drvdata(dev);
 
-	dev_dbg(dev, "%s: ENTER\n", __func__);
+	dd_trace(dev, "%s: ENTER\n", __func__);
+
+#ifdef PCM512X_ASYNC_MUTE
+	cancel_work_sync(&zpcm512x->mute_work);
+#endif /* PCM512X_ASYNC_MUTE */
+#ifdef DD_VOLUME_COALESCE
+	dd_vol_cancel(&zpcm512x->vol);
+#endif /* DD_VOLUME_COALESCE */
 
 	/* gpio mute */
 	if (zpcm512x->mute_gpio) {
@@ -2283,6 +3151,11 @@ void zpcm512x_remove(struct device *dev)
 	}
 
 	if (!zpcm512x->disable_pwrdown) {
+#ifdef PCM512X_LATENCY_PROFILE
+		/* drop the reference held by a no-powerdown profile */
+		if (zpcm512x_latency_profiles[zpcm512x->profile].no_pwrdown)
+			pm_runtime_put_noidle(dev);
+#endif /* PCM512X_LATENCY_PROFILE */
 #ifdef DDEBUG
 		dev_dbg(dev, "%s: pm_runtime_disable()\n", __func__);
 #endif
@@ -2299,7 +3172,7 @@ void zpcm512x_remove(struct device *dev)
 	regulator_bulk_disable(ARRAY_SIZE(zpcm512x->supplies),
 			       zpcm512x->supplies);
 
-	dev_dbg(dev, "%s: EXIT\n", __func__);
+	dd_trace(dev, "%s: EXIT\n", __func__);
 }
 EXPORT_SYMBOL_GPL(zpcm512x_remove);
 
@@ -2309,7 +3182,14 @@ static int zpcm512x_suspend(struct device *dev)
 	struct zpcm512x_priv *zpcm512x = dev_get_drvdata(dev);
 	int ret;
 
-	dev_dbg(dev, "%s: ENTER\n", __func__);
+	dd_trace(dev, "%s: ENTER\n", __func__);
+#ifdef DD_VOLUME_COALESCE
+	/* land any pending volume before the cache is synced on resume */
+	dd_vol_flush(&zpcm512x->vol);
+#endif /* DD_VOLUME_COALESCE */
+#ifdef PCM512X_ASYNC_MUTE
+	zpcm512x_mute_wait(zpcm512x, dev);
+#endif /* PCM512X_ASYNC_MUTE */
 	/* gpio mute */
 	if (zpcm512x->mute_gpio && !zpcm512x->auto_gpio_mute) {
 #ifdef DDEBUG
@@ -2346,16 +3226,17 @@ static int zpcm512x_suspend(struct device *dev)
 		clk_disable_unprepare(zpcm512x->sclk);
 	}
 
-	dev_dbg(dev, "%s: EXIT [0]\n", __func__);
+	dd_trace(dev, "%s: EXIT [0]\n", __func__);
 	return 0;
 }
 
 static int zpcm512x_resume(struct device *dev)
 {
 	struct zpcm512x_priv *zpcm512x = dev_get_drvdata(dev);
+	ktime_t start = ktime_get();
 	int ret;
 
-	dev_dbg(dev, "%s: ENTER\n", __func__);
+	dd_trace(dev, "%s: ENTER\n", __func__);
 
 	if (!IS_ERR(zpcm512x->sclk)) {
 #ifdef DDEBUG
@@ -2407,7 +3288,9 @@ static int zpcm512x_resume(struct device *dev)
 		gpiod_set_raw_value_cansleep(zpcm512x->mute_gpio, 1);
 	}
 
-	dev_dbg(dev, "%s: EXIT [0]\n", __func__);
+	dd_hist_add(&zpcm512x->stats.runtime_resume, start);
+
+	dd_trace(dev, "%s: EXIT [0]\n", __func__);
 	return 0;
 }
 #endif